@@ -18,16 +18,82 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <vector>
+#include <atomic>
 #include "NDS.h"
 #include "DSi.h"
 #include "AREngine.h"
 
+#ifdef JIT_ENABLED
+#include "ARMJIT.h"
+#include "ARMJIT_Memory.h"
+#endif
+
 
 namespace AREngine
 {
 
+// AR codes aren't interpreted straight from the code file. when the code file
+// changes, the enabled codes are compiled into a flat list of predecoded
+// instructions, with main RAM accesses at fixed addresses resolved to host
+// pointers beforehand.
+
+enum
+{
+    arop_Write32 = 0,   // u32[addr+offset] = val
+    arop_Write16,       // u16[addr+offset] = val
+    arop_Write8,        // u8[addr+offset] = val
+    arop_IfGT32,        // IF val > u32[addr]
+    arop_IfLT32,        // IF val < u32[addr]
+    arop_IfEQ32,        // IF val == u32[addr]
+    arop_IfNE32,        // IF val != u32[addr]
+    arop_IfGT16,        // IF val.l > ((~val.h) & u16[addr])
+    arop_IfLT16,        // IF val.l < ((~val.h) & u16[addr])
+    arop_IfEQ16,        // IF val.l == ((~val.h) & u16[addr])
+    arop_IfNE16,        // IF val.l != ((~val.h) & u16[addr])
+    arop_LoadOffset,    // offset = u32[addr+offset]
+    arop_For,           // FOR 0..val
+    arop_Abort,         // C4 or invalid opcode (addr/val = original opcode)
+    arop_Count,         // count++ / IF (count & val.l) == val.h
+    arop_StoreOffset,   // u32[addr] = offset
+    arop_EndIf,
+    arop_Next,
+    arop_NextFlush,
+    arop_SetOffset,     // offset = val
+    arop_AddData,       // datareg += val
+    arop_SetData,       // datareg = val
+    arop_StoreData32,   // u32[addr+offset] = datareg / offset += 4
+    arop_StoreData16,   // u16[addr+offset] = datareg / offset += 2
+    arop_StoreData8,    // u8[addr+offset] = datareg / offset += 1
+    arop_LoadData32,    // datareg = u32[addr+offset]
+    arop_LoadData16,    // datareg = u16[addr+offset]
+    arop_LoadData8,     // datareg = u8[addr+offset]
+    arop_AddOffset,     // offset += val
+    arop_CopyData,      // copy val bytes of inline data to addr+offset
+    arop_CopyMem,       // copy val bytes from offset to addr
+};
+
+struct ARInstr
+{
+    u8 Op;
+    bool RunAlways; // also executed when the current condition is false
+    u32 Addr;
+    u32 Val;
+    u32 DataPos;    // arop_CopyData: position of the data in CompiledData
+};
+
+struct CompiledCode
+{
+    u32 Start, End;
+};
+
 // AR code file - frontend is responsible for managing this
 ARCodeFile* CodeFile;
+std::atomic<bool> CodeFileDirty;
+
+std::vector<ARInstr> CompiledInstrs;
+std::vector<u32> CompiledData;
+std::vector<CompiledCode> CompiledCodes;
 
 u8 (*BusRead8)(u32 addr);
 u16 (*BusRead16)(u32 addr);
@@ -40,6 +106,7 @@ void (*BusWrite32)(u32 addr, u32 val);
 bool Init()
 {
     CodeFile = nullptr;
+    CodeFileDirty = true;
 
     return true;
 }
@@ -51,6 +118,7 @@ void DeInit()
 void Reset()
 {
     CodeFile = nullptr;
+    CodeFileDirty = true;
 
     if (NDS::ConsoleType == 1)
     {
@@ -75,7 +143,79 @@ void Reset()
 
 void SetCodeFile(ARCodeFile* file)
 {
+    // the code list is compiled on the next RunCheats(), as this may be
+    // called from another thread
     CodeFile = file;
+    CodeFileDirty = true;
+}
+
+
+// main RAM is the same on both the ARM7 bus of the DS and the DSi, and is
+// where nearly all cheats write, so it is accessed directly instead of going
+// through the bus functions
+// the pointer is looked up on every access, as MainRAMMask changes when the
+// DSi switches between 4MB and 16MB, and on savestate loads
+
+u8* GetMainRAMPtr(u32 addr)
+{
+    if ((addr & 0xFF000000) != 0x02000000)
+        return nullptr;
+
+    return &NDS::MainRAM[addr & NDS::MainRAMMask];
+}
+
+template <typename T>
+inline void WriteMainRAM(u32 addr, u8* ptr, T val)
+{
+    // cheats tend to rewrite the same values every frame
+    // only invalidate JIT blocks when memory actually changes
+    if (*(T*)ptr == val)
+        return;
+
+#ifdef JIT_ENABLED
+    ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
+#endif
+    *(T*)ptr = val;
+    if (NDS::MainRAMWriteTracking) NDS::MarkMainRAMDirty(addr);
+}
+
+inline u8 Read8(u32 addr)
+{
+    u8* ptr = GetMainRAMPtr(addr);
+    return ptr ? *ptr : BusRead8(addr);
+}
+
+inline u16 Read16(u32 addr)
+{
+    u8* ptr = GetMainRAMPtr(addr);
+    return ptr ? *(u16*)ptr : BusRead16(addr);
+}
+
+inline u32 Read32(u32 addr)
+{
+    u8* ptr = GetMainRAMPtr(addr);
+    return ptr ? *(u32*)ptr : BusRead32(addr);
+}
+
+inline void Write8(u32 addr, u8 val)
+{
+    u8* ptr = GetMainRAMPtr(addr);
+    if (ptr) WriteMainRAM<u8>(addr, ptr, val);
+    else     BusWrite8(addr, val);
+}
+
+inline void Write16(u32 addr, u16 val)
+{
+    u8* ptr = GetMainRAMPtr(addr);
+    if (ptr) WriteMainRAM<u16>(addr, ptr, val);
+    else     BusWrite16(addr, val);
+}
+
+inline void Write32(u32 addr, u32 val)
+{
+    u8* ptr = GetMainRAMPtr(addr);
+    if (ptr) WriteMainRAM<u32>(addr, ptr, val);
+    else     BusWrite32(addr, val);
 }
 
 
@@ -85,177 +225,218 @@ void SetCodeFile(ARCodeFile* file)
     case ((x)+0x08): case ((x)+0x09): case ((x)+0x0A): case ((x)+0x0B): \
     case ((x)+0x0C): case ((x)+0x0D): case ((x)+0x0E): case ((x)+0x0F)
 
-void RunCheat(ARCode& arcode)
+void CompileCheat(ARCode& arcode)
 {
-    u32* code = &arcode.Code[0];
-
-    u32 offset = 0;
-    u32 datareg = 0;
-    u32 cond = 1;
-    u32 condstack = 0;
-
-    u32* loopstart = code;
-    u32 loopcount = 0;
-    u32 loopcond = 1;
-    u32 loopcondstack = 0;
-
-    // TODO: does anything reset this??
-    u32 c5count = 0;
+    CompiledCode out;
+    out.Start = CompiledInstrs.size();
 
-    for (;;)
+    u32 pos = 0;
+    while (pos + 1 < arcode.CodeLen)
     {
-        if (code >= &arcode.Code[arcode.CodeLen])
-            break;
-
-        u32 a = *code++;
-        u32 b = *code++;
+        u32 a = arcode.Code[pos++];
+        u32 b = arcode.Code[pos++];
 
         u8 op = a >> 24;
 
-        if ((op < 0xD0 && op != 0xC5) || op > 0xD2)
+        ARInstr instr;
+        instr.RunAlways = (op == 0xC5) || (op >= 0xD0 && op <= 0xD2);
+        instr.Addr = a & 0x0FFFFFFF;
+        instr.Val = b;
+        instr.DataPos = 0;
+
+        switch (op)
         {
-            if (!cond)
+        case16(0x00): instr.Op = arop_Write32; break;
+        case16(0x10): instr.Op = arop_Write16; instr.Val &= 0xFFFF; break;
+        case16(0x20): instr.Op = arop_Write8; instr.Val &= 0xFF; break;
+        case16(0x30): instr.Op = arop_IfGT32; break;
+        case16(0x40): instr.Op = arop_IfLT32; break;
+        case16(0x50): instr.Op = arop_IfEQ32; break;
+        case16(0x60): instr.Op = arop_IfNE32; break;
+        case16(0x70): instr.Op = arop_IfGT16; break;
+        case16(0x80): instr.Op = arop_IfLT16; break;
+        case16(0x90): instr.Op = arop_IfEQ16; break;
+        case16(0xA0): instr.Op = arop_IfNE16; break;
+        case16(0xB0): instr.Op = arop_LoadOffset; break;
+        case 0xC0: instr.Op = arop_For; break;
+        case 0xC5: instr.Op = arop_Count; break;
+        case 0xC6: instr.Op = arop_StoreOffset; instr.Addr = b; break;
+        case 0xD0: instr.Op = arop_EndIf; break;
+        case 0xD1: instr.Op = arop_Next; break;
+        case 0xD2: instr.Op = arop_NextFlush; break;
+        case 0xD3: instr.Op = arop_SetOffset; break;
+        case 0xD4: instr.Op = arop_AddData; break;
+        case 0xD5: instr.Op = arop_SetData; break;
+        case 0xD6: instr.Op = arop_StoreData32; instr.Addr = b; break;
+        case 0xD7: instr.Op = arop_StoreData16; instr.Addr = b; break;
+        case 0xD8: instr.Op = arop_StoreData8; instr.Addr = b; break;
+        case 0xD9: instr.Op = arop_LoadData32; instr.Addr = b; break;
+        case 0xDA: instr.Op = arop_LoadData16; instr.Addr = b; break;
+        case 0xDB: instr.Op = arop_LoadData8; instr.Addr = b; break;
+        case 0xDC: instr.Op = arop_AddOffset; break;
+
+        case16(0xE0):
             {
-                if ((op & 0xF0) == 0xE0)
+                // the data follows the opcode, padded to a multiple of 8 bytes
+                instr.Op = arop_CopyData;
+                instr.DataPos = CompiledData.size();
+
+                u32 datalen = ((b + 7) & ~7) >> 2;
+                for (u32 i = 0; i < datalen; i++)
                 {
-                    for (u32 i = 0; i < b; i += 8)
-                        code += 2;
+                    CompiledData.push_back((pos < arcode.CodeLen) ? arcode.Code[pos] : 0);
+                    pos++;
                 }
-
-                continue;
             }
-        }
-
-        switch (op)
-        {
-        case16(0x00): // 32-bit write
-            BusWrite32((a & 0x0FFFFFFF) + offset, b);
             break;
 
-        case16(0x10): // 16-bit write
-            BusWrite16((a & 0x0FFFFFFF) + offset, b & 0xFFFF);
-            break;
+        case16(0xF0): instr.Op = arop_CopyMem; break;
 
-        case16(0x20): // 8-bit write
-            BusWrite8((a & 0x0FFFFFFF) + offset, b & 0xFF);
+        default: // C4 and invalid opcodes
+            instr.Op = arop_Abort;
+            instr.Addr = a;
             break;
+        }
 
-        case16(0x30): // IF b > u32[a]
-            {
-                condstack <<= 1;
-                condstack |= cond;
-
-                u32 chk = BusRead32(a & 0x0FFFFFFF);
+        CompiledInstrs.push_back(instr);
+    }
 
-                cond = (b > chk) ? 1:0;
-            }
-            break;
+    out.End = CompiledInstrs.size();
+    if (out.End > out.Start)
+        CompiledCodes.push_back(out);
+}
 
-        case16(0x40): // IF b < u32[a]
-            {
-                condstack <<= 1;
-                condstack |= cond;
+void CompileCheats()
+{
+    CompiledInstrs.clear();
+    CompiledData.clear();
+    CompiledCodes.clear();
 
-                u32 chk = BusRead32(a & 0x0FFFFFFF);
+    if (!CodeFile) return;
 
-                cond = (b < chk) ? 1:0;
-            }
-            break;
+    for (ARCodeCatList::iterator i = CodeFile->Categories.begin(); i != CodeFile->Categories.end(); i++)
+    {
+        ARCodeCat& cat = *i;
 
-        case16(0x50): // IF b == u32[a]
-            {
-                condstack <<= 1;
-                condstack |= cond;
+        for (ARCodeList::iterator j = cat.Codes.begin(); j != cat.Codes.end(); j++)
+        {
+            ARCode& code = *j;
 
-                u32 chk = BusRead32(a & 0x0FFFFFFF);
+            if (code.Enabled)
+                CompileCheat(code);
+        }
+    }
+}
 
-                cond = (b == chk) ? 1:0;
-            }
-            break;
+void RunCheat(CompiledCode& compiled)
+{
+    ARInstr* code = CompiledInstrs.data() + compiled.Start;
+    ARInstr* end = CompiledInstrs.data() + compiled.End;
 
-        case16(0x60): // IF b != u32[a]
-            {
-                condstack <<= 1;
-                condstack |= cond;
+    u32 offset = 0;
+    u32 datareg = 0;
+    u32 cond = 1;
+    u32 condstack = 0;
 
-                u32 chk = BusRead32(a & 0x0FFFFFFF);
+    ARInstr* loopstart = code;
+    u32 loopcount = 0;
+    u32 loopcond = 1;
+    u32 loopcondstack = 0;
 
-                cond = (b != chk) ? 1:0;
-            }
-            break;
+    // TODO: does anything reset this??
+    u32 c5count = 0;
 
-        case16(0x70): // IF b.l > ((~b.h) & u16[a])
-            {
-                condstack <<= 1;
-                condstack |= cond;
+    while (code < end)
+    {
+        ARInstr& instr = *code++;
 
-                u16 val = BusRead16(a & 0x0FFFFFFF);
-                u16 chk = ~(b >> 16);
-                chk &= val;
+        if (!cond && !instr.RunAlways)
+            continue;
 
-                cond = ((b & 0xFFFF) > chk) ? 1:0;
-            }
+        switch (instr.Op)
+        {
+        case arop_Write32:
+            Write32(instr.Addr + offset, instr.Val);
             break;
 
-        case16(0x80): // IF b.l < ((~b.h) & u16[a])
-            {
-                condstack <<= 1;
-                condstack |= cond;
-
-                u16 val = BusRead16(a & 0x0FFFFFFF);
-                u16 chk = ~(b >> 16);
-                chk &= val;
+        case arop_Write16:
+            Write16(instr.Addr + offset, instr.Val);
+            break;
 
-                cond = ((b & 0xFFFF) < chk) ? 1:0;
-            }
+        case arop_Write8:
+            Write8(instr.Addr + offset, instr.Val);
             break;
 
-        case16(0x90): // IF b.l == ((~b.h) & u16[a])
+        case arop_IfGT32:
+        case arop_IfLT32:
+        case arop_IfEQ32:
+        case arop_IfNE32:
             {
                 condstack <<= 1;
                 condstack |= cond;
 
-                u16 val = BusRead16(a & 0x0FFFFFFF);
-                u16 chk = ~(b >> 16);
-                chk &= val;
+                u32 chk = Read32(instr.Addr);
+                u32 b = instr.Val;
 
-                cond = ((b & 0xFFFF) == chk) ? 1:0;
+                switch (instr.Op)
+                {
+                case arop_IfGT32: cond = (b > chk) ? 1:0; break;
+                case arop_IfLT32: cond = (b < chk) ? 1:0; break;
+                case arop_IfEQ32: cond = (b == chk) ? 1:0; break;
+                case arop_IfNE32: cond = (b != chk) ? 1:0; break;
+                }
             }
             break;
 
-        case16(0xA0): // IF b.l != ((~b.h) & u16[a])
+        case arop_IfGT16:
+        case arop_IfLT16:
+        case arop_IfEQ16:
+        case arop_IfNE16:
             {
                 condstack <<= 1;
                 condstack |= cond;
 
-                u16 val = BusRead16(a & 0x0FFFFFFF);
-                u16 chk = ~(b >> 16);
+                u16 val = Read16(instr.Addr);
+                u16 chk = ~(instr.Val >> 16);
                 chk &= val;
+                u16 b = instr.Val & 0xFFFF;
 
-                cond = ((b & 0xFFFF) != chk) ? 1:0;
+                switch (instr.Op)
+                {
+                case arop_IfGT16: cond = (b > chk) ? 1:0; break;
+                case arop_IfLT16: cond = (b < chk) ? 1:0; break;
+                case arop_IfEQ16: cond = (b == chk) ? 1:0; break;
+                case arop_IfNE16: cond = (b != chk) ? 1:0; break;
+                }
             }
             break;
 
-        case16(0xB0): // offset = u32[a + offset]
-            offset = BusRead32((a & 0x0FFFFFFF) + offset);
+        case arop_LoadOffset:
+            offset = Read32(instr.Addr + offset);
             break;
 
-        case 0xC0: // FOR 0..b
+        case arop_For:
             loopstart = code; // points to the first opcode after the FOR
-            loopcount = b;
+            loopcount = instr.Val;
             loopcond = cond;           // checkme
             loopcondstack = condstack; // (GBAtek is not very clear there)
             break;
 
-        case 0xC4: // offset = pointer to C4000000 opcode
-            // theoretically used for safe storage, by accessing [offset+4]
-            // in practice could be used for a self-modifying AR code
-            // could be implemented with some hackery, but, does anything even
-            // use it??
-            printf("AR: !! THE FUCKING C4000000 OPCODE. TELL ARISOTURA.\n");
+        case arop_Abort:
+            if ((instr.Addr >> 24) == 0xC4)
+            {
+                // offset = pointer to C4000000 opcode
+                // theoretically used for safe storage, by accessing [offset+4]
+                // in practice could be used for a self-modifying AR code
+                // could be implemented with some hackery, but, does anything even
+                // use it??
+                printf("AR: !! THE FUCKING C4000000 OPCODE. TELL ARISOTURA.\n");
+            }
+            else
+                printf("!! bad AR opcode %08X %08X\n", instr.Addr, instr.Val);
             return;
 
-        case 0xC5: // count++ / IF (count & b.l) == b.h
+        case arop_Count:
             {
                 // with weird condition checking, apparently
                 // oh well
@@ -266,23 +447,23 @@ void RunCheat(ARCode& arcode)
                 condstack <<= 1;
                 condstack |= cond;
 
-                u16 mask = b & 0xFFFF;
-                u16 chk = b >> 16;
+                u16 mask = instr.Val & 0xFFFF;
+                u16 chk = instr.Val >> 16;
 
                 cond = ((c5count & mask) == chk) ? 1:0;
             }
             break;
 
-        case 0xC6: // u32[b] = offset
-            BusWrite32(b, offset);
+        case arop_StoreOffset:
+            Write32(instr.Addr, offset);
             break;
 
-        case 0xD0: // ENDIF
+        case arop_EndIf:
             cond = condstack & 0x1;
             condstack >>= 1;
             break;
 
-        case 0xD1: // NEXT
+        case arop_Next:
             if (loopcount > 0)
             {
                 loopcount--;
@@ -295,7 +476,7 @@ void RunCheat(ARCode& arcode)
             }
             break;
 
-        case 0xD2: // NEXT+FLUSH
+        case arop_NextFlush:
             if (loopcount > 0)
             {
                 loopcount--;
@@ -310,127 +491,114 @@ void RunCheat(ARCode& arcode)
             }
             break;
 
-        case 0xD3: // offset = b
-            offset = b;
+        case arop_SetOffset:
+            offset = instr.Val;
             break;
 
-        case 0xD4: // datareg += b
-            datareg += b;
+        case arop_AddData:
+            datareg += instr.Val;
             break;
 
-        case 0xD5: // datareg = b
-            datareg = b;
+        case arop_SetData:
+            datareg = instr.Val;
             break;
 
-        case 0xD6: // u32[b+offset] = datareg / offset += 4
-            BusWrite32(b + offset, datareg);
+        case arop_StoreData32:
+            Write32(instr.Addr + offset, datareg);
             offset += 4;
             break;
 
-        case 0xD7: // u16[b+offset] = datareg / offset += 2
-            BusWrite16(b + offset, datareg & 0xFFFF);
+        case arop_StoreData16:
+            Write16(instr.Addr + offset, datareg & 0xFFFF);
             offset += 2;
             break;
 
-        case 0xD8: // u8[b+offset] = datareg / offset += 1
-            BusWrite8(b + offset, datareg & 0xFF);
+        case arop_StoreData8:
+            Write8(instr.Addr + offset, datareg & 0xFF);
             offset += 1;
             break;
 
-        case 0xD9: // datareg = u32[b+offset]
-            datareg = BusRead32(b + offset);
+        case arop_LoadData32:
+            datareg = Read32(instr.Addr + offset);
             break;
 
-        case 0xDA: // datareg = u16[b+offset]
-            datareg = BusRead16(b + offset);
+        case arop_LoadData16:
+            datareg = Read16(instr.Addr + offset);
             break;
 
-        case 0xDB: // datareg = u8[b+offset]
-            datareg = BusRead8(b + offset);
+        case arop_LoadData8:
+            datareg = Read8(instr.Addr + offset);
             break;
 
-        case 0xDC: // offset += b
-            offset += b;
+        case arop_AddOffset:
+            offset += instr.Val;
             break;
 
-        case16(0xE0): // copy b param bytes to address a+offset
+        case arop_CopyData:
             {
                 // TODO: check for bad alignment of dstaddr
 
-                u32 dstaddr = (a & 0x0FFFFFFF) + offset;
-                u32 bytesleft = b;
+                u32* data = &CompiledData[instr.DataPos];
+                u32 dstaddr = instr.Addr + offset;
+                u32 bytesleft = instr.Val;
                 while (bytesleft >= 8)
                 {
-                    BusWrite32(dstaddr, *code++); dstaddr += 4;
-                    BusWrite32(dstaddr, *code++); dstaddr += 4;
+                    Write32(dstaddr, *data++); dstaddr += 4;
+                    Write32(dstaddr, *data++); dstaddr += 4;
                     bytesleft -= 8;
                 }
                 if (bytesleft > 0)
                 {
-                    u8* leftover = (u8*)code;
-                    code += 2;
+                    u8* leftover = (u8*)data;
                     if (bytesleft >= 4)
                     {
-                        BusWrite32(dstaddr, *(u32*)leftover); dstaddr += 4;
+                        Write32(dstaddr, *(u32*)leftover); dstaddr += 4;
                         leftover += 4;
                         bytesleft -= 4;
                     }
                     while (bytesleft > 0)
                     {
-                        BusWrite8(dstaddr, *leftover++); dstaddr++;
+                        Write8(dstaddr, *leftover++); dstaddr++;
                         bytesleft--;
                     }
                 }
             }
             break;
 
-        case16(0xF0): // copy b bytes from address offset to address a
+        case arop_CopyMem:
             {
                 // TODO: check for bad alignment of srcaddr/dstaddr
 
                 u32 srcaddr = offset;
-                u32 dstaddr = (a & 0x0FFFFFFF);
-                u32 bytesleft = b;
+                u32 dstaddr = instr.Addr;
+                u32 bytesleft = instr.Val;
                 while (bytesleft >= 4)
                 {
-                    BusWrite32(dstaddr, BusRead32(srcaddr));
+                    Write32(dstaddr, Read32(srcaddr));
                     srcaddr += 4;
                     dstaddr += 4;
                     bytesleft -= 4;
                 }
                 while (bytesleft > 0)
                 {
-                    BusWrite8(dstaddr, BusRead8(srcaddr));
+                    Write8(dstaddr, Read8(srcaddr));
                     srcaddr++;
                     dstaddr++;
                     bytesleft--;
                 }
             }
             break;
-
-        default:
-            printf("!! bad AR opcode %08X %08X\n", a, b);
-            return;
         }
     }
 }
 
 void RunCheats()
 {
-    if (!CodeFile) return;
+    if (CodeFileDirty.exchange(false))
+        CompileCheats();
 
-    for (ARCodeCatList::iterator i = CodeFile->Categories.begin(); i != CodeFile->Categories.end(); i++)
-    {
-        ARCodeCat& cat = *i;
-
-        for (ARCodeList::iterator j = cat.Codes.begin(); j != cat.Codes.end(); j++)
-        {
-            ARCode& code = *j;
-
-            if (code.Enabled)
-                RunCheat(code);
-        }
-    }
+    for (CompiledCode& code : CompiledCodes)
+        RunCheat(code);
 }
 
 }
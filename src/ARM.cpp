@@ -17,10 +17,12 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "NDS.h"
 #include "DSi.h"
 #include "ARM.h"
 #include "ARMInterpreter.h"
+#include "ARM_InstrInfo.h"
 #include "Config.h"
 #include "AREngine.h"
 #include "ARMJIT.h"
@@ -112,6 +114,9 @@ void ARM::Reset()
 
     CodeMem.Mem = NULL;
 
+    IdleLoop = 0;
+    memset(IdleLoopCache, 0, sizeof(IdleLoopCache));
+
 #ifdef JIT_ENABLED
     FastBlockLookup = NULL;
     FastBlockLookupStart = 0;
@@ -218,6 +223,8 @@ void ARM::DoSavestate(Savestate* file)
             CodeRegion = R[15] >> 24;
             CodeCycles = R[15] >> 15; // cheato
         }
+
+        memset(IdleLoopCache, 0, sizeof(IdleLoopCache));
     }
 }
 
@@ -498,6 +505,93 @@ void ARM::TriggerIRQ()
     }
 }
 
+u8* ARM::GetCodePtr(u32 addr)
+{
+    if (Num == 0)
+    {
+        ARMv5* cpu = (ARMv5*)this;
+        if (addr < cpu->ITCMSize)
+            return &cpu->ITCM[addr & (ITCMPhysicalSize - 1)];
+
+        return NDS::PageLookup(NDS::ARM9ReadPages, addr);
+    }
+    else
+        return NDS::PageLookup(NDS::ARM7ReadPages, addr);
+}
+
+void ARM::DetectIdleLoop(u32 branchaddr, u32 target)
+{
+    // an interrupt is going to be taken right after the branch
+    if (IRQ && !(CPSR & 0x80))
+        return;
+
+    bool thumb = CPSR & 0x20;
+    u32 instrsize = thumb ? 2 : 4;
+    if ((branchaddr - target) >= (16 * instrsize))
+        return;
+
+    // loops that were found not to be idle are not checked again, if their
+    // code changed into an idle loop we only lose a bit of speed. this keeps
+    // busy loops, which run the most, from paying for the check
+    IdleLoopEntry* entry = &IdleLoopCache[(branchaddr >> 1) & 0xF];
+    bool cached = entry->BranchAddr == branchaddr && entry->Target == target;
+    if (cached && !entry->Idle)
+        return;
+
+    // the code may have been modified or overlaid since the loop was last
+    // seen, so it's only skipped if it's still the same
+    u32 numinstrs = ((branchaddr - target) / instrsize) + 1;
+    u32 body[16];
+    for (u32 i = 0; i < numinstrs; i++)
+    {
+        u8* ptr = GetCodePtr(target + (i * instrsize));
+        if (!ptr) return;
+
+        body[i] = thumb ? *(u16*)ptr : *(u32*)ptr;
+    }
+
+    if (!cached || memcmp(entry->Body, body, numinstrs * sizeof(u32)))
+    {
+        entry->BranchAddr = branchaddr;
+        entry->Target = target;
+        memcpy(entry->Body, body, numinstrs * sizeof(u32));
+
+        // same rules as the JIT (see ARMJIT::IsIdleLoop): the loop may read
+        // memory or I/O but not write anything, and no iteration may depend
+        // on a register value produced by the previous one. then nothing can
+        // change until the next scheduler event or IRQ
+        entry->Idle = true;
+        u16 regsWrittenTo = 0;
+        u16 regsDisallowedToWrite = 0;
+        for (u32 i = 0; i < numinstrs; i++)
+        {
+            ARMInstrInfo::Info info = ARMInstrInfo::Decode(thumb, Num, body[i]);
+
+            if (info.SpecialKind == ARMInstrInfo::special_WriteMem ||
+                (!thumb && info.Kind >= ARMInstrInfo::ak_MSR_IMM && info.Kind <= ARMInstrInfo::ak_MRC) ||
+                (i < (numinstrs - 1) && info.Branches()))
+            {
+                entry->Idle = false;
+                break;
+            }
+
+            u16 srcRegs = info.SrcRegs & ~(1 << 15);
+            u16 dstRegs = info.DstRegs & ~(1 << 15);
+
+            regsDisallowedToWrite |= srcRegs & ~regsWrittenTo;
+            if (dstRegs & regsDisallowedToWrite)
+            {
+                entry->Idle = false;
+                break;
+            }
+            regsWrittenTo |= dstRegs;
+        }
+    }
+
+    if (entry->Idle)
+        IdleLoop = 1;
+}
+
 void ARMv5::PrefetchAbort()
 {
     printf("prefetch abort\n");
@@ -535,6 +629,15 @@ void ARMv5::DataAbort()
     JumpTo(ExceptionBase + 0x10);
 }
 
+// note on instruction decoding in the interpreter loops:
+// decoding an opcode is a single lookup into ARMInstrTable/THUMBInstrTable,
+// and the handlers are already specialized per opcode class, so caching
+// pre-decoded instructions per code page doesn't buy anything here. even
+// skipping the fetch and the decode entirely doesn't make a measurable
+// difference, the time is spent in the handlers and the timing logic.
+// the ARM7 code fetch goes through the page tables (NDS::PageLookup()), the
+// ARM9 one uses ITCM and the per-region CodeMem pointer, see ARMv5::CodeRead32().
+
 void ARMv5::Execute()
 {
     if (Halted)
@@ -611,6 +714,18 @@ void ARMv5::Execute()
 
         NDS::ARM9Timestamp += Cycles;
         Cycles = 0;
+
+        if (IdleLoop)
+        {
+            // waiting for something that can't happen before the next event
+            IdleLoop = 0;
+            if (NDS::ARM9Timestamp < NDS::ARM9Target)
+            {
+                NDS::IdleLoopCycles[0] += (NDS::ARM9Target - NDS::ARM9Timestamp) >> NDS::ARM9ClockShift;
+                NDS::ARM9Timestamp = NDS::ARM9Target;
+            }
+            break;
+        }
     }
 
     if (Halted == 2)
@@ -668,6 +783,8 @@ void ARMv5::ExecuteJIT()
             {
                 if ((Halted == 1 || IdleLoop) && NDS::ARM9Timestamp < NDS::ARM9Target)
                 {
+                    if (IdleLoop)
+                        NDS::IdleLoopCycles[0] += (NDS::ARM9Target - NDS::ARM9Timestamp) >> NDS::ARM9ClockShift;
                     Cycles = 0;
                     NDS::ARM9Timestamp = NDS::ARM9Target;
                 }
@@ -756,6 +873,17 @@ void ARMv4::Execute()
 
         NDS::ARM7Timestamp += Cycles;
         Cycles = 0;
+
+        if (IdleLoop)
+        {
+            IdleLoop = 0;
+            if (NDS::ARM7Timestamp < NDS::ARM7Target)
+            {
+                NDS::IdleLoopCycles[1] += NDS::ARM7Target - NDS::ARM7Timestamp;
+                NDS::ARM7Timestamp = NDS::ARM7Target;
+            }
+            break;
+        }
     }
 
     if (Halted == 2)
@@ -818,6 +946,8 @@ void ARMv4::ExecuteJIT()
             {
                 if ((Halted == 1 || IdleLoop) && NDS::ARM7Timestamp < NDS::ARM7Target)
                 {
+                    if (IdleLoop)
+                        NDS::IdleLoopCycles[1] += NDS::ARM7Target - NDS::ARM7Timestamp;
                     Cycles = 0;
                     NDS::ARM7Timestamp = NDS::ARM7Target;
                 }
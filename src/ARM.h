@@ -99,6 +99,9 @@ public:
 
     void SetupCodeMem(u32 addr);
 
+    // called by the interpreter on taken backward conditional branches
+    void DetectIdleLoop(u32 branchaddr, u32 target);
+
 
     virtual void DataRead8(u32 addr, u32* val) = 0;
     virtual void DataRead16(u32 addr, u32* val) = 0;
@@ -163,6 +166,17 @@ protected:
     void (*BusWrite8)(u32 addr, u8 val);
     void (*BusWrite16)(u32 addr, u16 val);
     void (*BusWrite32)(u32 addr, u32 val);
+
+    struct IdleLoopEntry
+    {
+        u32 BranchAddr;
+        u32 Target;
+        u32 Body[16]; // the loop's instructions, in case the code changes
+        bool Idle;
+    };
+    IdleLoopEntry IdleLoopCache[16];
+
+    u8* GetCodePtr(u32 addr);
 };
 
 class ARMv5 : public ARM
@@ -321,17 +335,23 @@ public:
 
     u16 CodeRead16(u32 addr)
     {
+        u8* ptr = NDS::PageLookup(NDS::ARM7ReadPages, addr);
+        if (ptr) return *(u16*)ptr;
         return BusRead16(addr);
     }
 
     u32 CodeRead32(u32 addr)
     {
+        u8* ptr = NDS::PageLookup(NDS::ARM7ReadPages, addr);
+        if (ptr) return *(u32*)ptr;
         return BusRead32(addr);
     }
 
     void DataRead8(u32 addr, u32* val)
     {
-        *val = BusRead8(addr);
+        u8* ptr = NDS::PageLookup(NDS::ARM7ReadPages, addr);
+        if (ptr) *val = *(u8*)ptr;
+        else     *val = BusRead8(addr);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -340,7 +360,9 @@ public:
     {
         addr &= ~1;
 
-        *val = BusRead16(addr);
+        u8* ptr = NDS::PageLookup(NDS::ARM7ReadPages, addr);
+        if (ptr) *val = *(u16*)ptr;
+        else     *val = BusRead16(addr);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -349,7 +371,9 @@ public:
     {
         addr &= ~3;
 
-        *val = BusRead32(addr);
+        u8* ptr = NDS::PageLookup(NDS::ARM7ReadPages, addr);
+        if (ptr) *val = *(u32*)ptr;
+        else     *val = BusRead32(addr);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][2];
     }
@@ -358,13 +382,17 @@ public:
     {
         addr &= ~3;
 
-        *val = BusRead32(addr);
+        u8* ptr = NDS::PageLookup(NDS::ARM7ReadPages, addr);
+        if (ptr) *val = *(u32*)ptr;
+        else     *val = BusRead32(addr);
         DataCycles += NDS::ARM7MemTimings[addr >> 15][3];
     }
 
     void DataWrite8(u32 addr, u8 val)
     {
-        BusWrite8(addr, val);
+        u8* ptr = NDS::PageLookup(NDS::ARM7WritePages, addr);
+        if (ptr) *(u8*)ptr = val;
+        else     BusWrite8(addr, val);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -373,7 +401,9 @@ public:
     {
         addr &= ~1;
 
-        BusWrite16(addr, val);
+        u8* ptr = NDS::PageLookup(NDS::ARM7WritePages, addr);
+        if (ptr) *(u16*)ptr = val;
+        else     BusWrite16(addr, val);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][0];
     }
@@ -382,7 +412,9 @@ public:
     {
         addr &= ~3;
 
-        BusWrite32(addr, val);
+        u8* ptr = NDS::PageLookup(NDS::ARM7WritePages, addr);
+        if (ptr) *(u32*)ptr = val;
+        else     BusWrite32(addr, val);
         DataRegion = addr;
         DataCycles = NDS::ARM7MemTimings[addr >> 15][2];
     }
@@ -391,7 +423,9 @@ public:
     {
         addr &= ~3;
 
-        BusWrite32(addr, val);
+        u8* ptr = NDS::PageLookup(NDS::ARM7WritePages, addr);
+        if (ptr) *(u32*)ptr = val;
+        else     BusWrite32(addr, val);
         DataCycles += NDS::ARM7MemTimings[addr >> 15][3];
     }
 
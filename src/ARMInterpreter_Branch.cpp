@@ -27,6 +27,8 @@ namespace ARMInterpreter
 void A_B(ARM* cpu)
 {
     s32 offset = (s32)(cpu->CurInstr << 8) >> 6;
+    if (offset <= -8 && (cpu->CurInstr >> 28) != 0xE)
+        cpu->DetectIdleLoop(cpu->R[15] - 8, cpu->R[15] + offset);
     cpu->JumpTo(cpu->R[15] + offset);
 }
 
@@ -64,6 +66,8 @@ void T_BCOND(ARM* cpu)
     if (cpu->CheckCondition((cpu->CurInstr >> 8) & 0xF))
     {
         s32 offset = (s32)(cpu->CurInstr << 24) >> 23;
+        if (offset <= -4)
+            cpu->DetectIdleLoop(cpu->R[15] - 4, cpu->R[15] + offset);
         cpu->JumpTo(cpu->R[15] + offset + 1);
     }
     else
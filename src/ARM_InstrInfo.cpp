@@ -386,7 +386,9 @@ Info Decode(bool thumb, u32 num, u32 instr)
         {
             if (res.Kind == tk_LDR_PCREL)
             {
+#ifdef JIT_ENABLED
                 if (!Config::JIT_LiteralOptimisations)
+#endif
                     res.SrcRegs |= 1 << 15;
                 res.SpecialKind = special_LoadLiteral;
             }
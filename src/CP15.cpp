@@ -785,7 +785,9 @@ void ARMv5::DataRead8(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead8(addr);
+    u8* ptr = NDS::PageLookup(NDS::ARM9ReadPages, addr);
+    if (ptr) *val = *(u8*)ptr;
+    else     *val = BusRead8(addr);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
@@ -808,7 +810,9 @@ void ARMv5::DataRead16(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead16(addr);
+    u8* ptr = NDS::PageLookup(NDS::ARM9ReadPages, addr);
+    if (ptr) *val = *(u16*)ptr;
+    else     *val = BusRead16(addr);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
@@ -831,7 +835,9 @@ void ARMv5::DataRead32(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead32(addr);
+    u8* ptr = NDS::PageLookup(NDS::ARM9ReadPages, addr);
+    if (ptr) *val = *(u32*)ptr;
+    else     *val = BusRead32(addr);
     DataCycles = MemTimings[addr >> 12][2];
 }
 
@@ -852,7 +858,9 @@ void ARMv5::DataRead32S(u32 addr, u32* val)
         return;
     }
 
-    *val = BusRead32(addr);
+    u8* ptr = NDS::PageLookup(NDS::ARM9ReadPages, addr);
+    if (ptr) *val = *(u32*)ptr;
+    else     *val = BusRead32(addr);
     DataCycles += MemTimings[addr >> 12][3];
 }
 
@@ -876,7 +884,9 @@ void ARMv5::DataWrite8(u32 addr, u8 val)
         return;
     }
 
-    BusWrite8(addr, val);
+    u8* ptr = NDS::PageLookup(NDS::ARM9WritePages, addr);
+    if (ptr) *(u8*)ptr = val;
+    else     BusWrite8(addr, val);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
@@ -902,7 +912,9 @@ void ARMv5::DataWrite16(u32 addr, u16 val)
         return;
     }
 
-    BusWrite16(addr, val);
+    u8* ptr = NDS::PageLookup(NDS::ARM9WritePages, addr);
+    if (ptr) *(u16*)ptr = val;
+    else     BusWrite16(addr, val);
     DataCycles = MemTimings[addr >> 12][1];
 }
 
@@ -928,7 +940,9 @@ void ARMv5::DataWrite32(u32 addr, u32 val)
         return;
     }
 
-    BusWrite32(addr, val);
+    u8* ptr = NDS::PageLookup(NDS::ARM9WritePages, addr);
+    if (ptr) *(u32*)ptr = val;
+    else     BusWrite32(addr, val);
     DataCycles = MemTimings[addr >> 12][2];
 }
 
@@ -952,7 +966,9 @@ void ARMv5::DataWrite32S(u32 addr, u32 val)
         return;
     }
 
-    BusWrite32(addr, val);
+    u8* ptr = NDS::PageLookup(NDS::ARM9WritePages, addr);
+    if (ptr) *(u32*)ptr = val;
+    else     BusWrite32(addr, val);
     DataCycles += MemTimings[addr >> 12][3];
 }
 
@@ -40,10 +40,13 @@ char DSiFirmwarePath[1024];
 char DSiNANDPath[1024];
 int DSiSDEnable;
 char DSiSDPath[1024];
+int DSiStorageSync;
 
 int RandomizeMAC;
 int AudioBitrate;
 
+int MapROMFiles;
+
 #ifdef JIT_ENABLED
 int JIT_Enable = false;
 int JIT_MaxBlockSize = 32;
@@ -66,10 +69,13 @@ ConfigEntry ConfigFile[] =
     {"DSiNANDPath", 1, DSiNANDPath, 0, "", 1023},
     {"DSiSDEnable", 0, &DSiSDEnable, 0, NULL, 0},
     {"DSiSDPath", 1, DSiSDPath, 0, "", 1023},
+    {"DSiStorageSync", 0, &DSiStorageSync, 1, NULL, 0},
 
     {"RandomizeMAC", 0, &RandomizeMAC, 0, NULL, 0},
     {"AudioBitrate", 0, &AudioBitrate, 0, NULL, 0},
 
+    {"MapROMFiles", 0, &MapROMFiles, 0, NULL, 0},
+
 #ifdef JIT_ENABLED
     {"JIT_Enable", 0, &JIT_Enable, 0, NULL, 0},
     {"JIT_MaxBlockSize", 0, &JIT_MaxBlockSize, 32, NULL, 0},
@@ -53,10 +53,13 @@ extern char DSiFirmwarePath[1024];
 extern char DSiNANDPath[1024];
 extern int DSiSDEnable;
 extern char DSiSDPath[1024];
+extern int DSiStorageSync;
 
 extern int RandomizeMAC;
 extern int AudioBitrate;
 
+extern int MapROMFiles;
+
 #ifdef JIT_ENABLED
 extern int JIT_Enable;
 extern int JIT_MaxBlockSize;
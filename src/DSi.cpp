@@ -39,7 +39,6 @@
 #include "DSi_DSP.h"
 #include "DSi_Camera.h"
 
-#include "tiny-AES-c/aes.hpp"
 
 
 namespace DSi
@@ -128,10 +127,12 @@ void DeInit()
 
     for (int i = 0; i < 8; i++) delete NDMAs[i];
 
+    CloseDSiNAND();
+
     delete SDMMC;
     delete SDIO;
-
-    CloseDSiNAND();
+    SDMMC = nullptr;
+    SDIO = nullptr;
 }
 
 void Reset()
@@ -367,6 +368,9 @@ bool LoadNAND()
     memset(NWRAMEnd, 0, sizeof(NWRAMEnd));
     memset(NWRAMMask, 0, sizeof(NWRAMMask));
 
+    // make sure any pending NAND writes made it to the file
+    if (SDMMC) SDMMC->CloseStorage();
+
     if (SDMMCFile)
     {
         u32 bootparams[8];
@@ -378,6 +382,19 @@ bool LoadNAND()
         printf("ARM7: offset=%08X size=%08X RAM=%08X size_aligned=%08X\n",
                bootparams[4], bootparams[5], bootparams[6], bootparams[7]);
 
+        // the boot2 binaries are read whole, make sure they lie within the image
+        fseek(SDMMCFile, 0, SEEK_END);
+        u64 nandsize = ftell(SDMMCFile);
+        for (int i = 0; i < 8; i += 4)
+        {
+            u64 binlen = ((u64)bootparams[i+3] + 0xF) & ~0xF;
+            if (bootparams[i] > nandsize || binlen > nandsize - bootparams[i])
+            {
+                printf("ERROR: NAND boot2 %s binary is out of bounds\n", i ? "ARM7" : "ARM9");
+                return false;
+            }
+        }
+
         // read and apply new-WRAM settings
 
         MBK[0][8] = 0;
@@ -425,61 +442,47 @@ bool LoadNAND()
 
         // load boot2 binaries
 
-        AES_ctx ctx;
-        const u8 boot2key[16] = {0xAD, 0x34, 0xEC, 0xF9, 0x62, 0x6E, 0xC2, 0x3A, 0xF6, 0xB4, 0x6C, 0x00, 0x80, 0x80, 0xEE, 0x98};
+        // boot2 key, in the DSi's byte order
+        const u8 boot2key[16] = {0x98, 0xEE, 0x80, 0x80, 0x00, 0x6C, 0xB4, 0xF6, 0x3A, 0xC2, 0x6E, 0x62, 0xF9, 0xEC, 0x34, 0xAD};
         u8 boot2iv[16];
-        u8 tmp[16];
-        u32 dstaddr;
+        u8* data;
+        u32 len, dstaddr;
 
-        *(u32*)&tmp[0] = bootparams[3];
-        *(u32*)&tmp[4] = -bootparams[3];
-        *(u32*)&tmp[8] = ~bootparams[3];
-        *(u32*)&tmp[12] = 0;
-        for (int i = 0; i < 16; i++) boot2iv[i] = tmp[15-i];
-
-        AES_init_ctx_iv(&ctx, boot2key, boot2iv);
+        *(u32*)&boot2iv[0] = bootparams[3];
+        *(u32*)&boot2iv[4] = -bootparams[3];
+        *(u32*)&boot2iv[8] = ~bootparams[3];
+        *(u32*)&boot2iv[12] = 0;
 
+        len = (bootparams[3] + 0xF) & ~0xF;
+        data = new u8[len];
         fseek(SDMMCFile, bootparams[0], SEEK_SET);
+        fread(data, len, 1, SDMMCFile);
+        DSi_AES::ApplyModcrypt(data, len, (u8*)boot2key, boot2iv);
+
         dstaddr = bootparams[2];
-        for (u32 i = 0; i < bootparams[3]; i += 16)
+        for (u32 i = 0; i < len; i += 4)
         {
-            u8 data[16];
-            fread(data, 16, 1, SDMMCFile);
-
-            for (int j = 0; j < 16; j++) tmp[j] = data[15-j];
-            AES_CTR_xcrypt_buffer(&ctx, tmp, 16);
-            for (int j = 0; j < 16; j++) data[j] = tmp[15-j];
-
-            ARM9Write32(dstaddr, *(u32*)&data[0]); dstaddr += 4;
-            ARM9Write32(dstaddr, *(u32*)&data[4]); dstaddr += 4;
-            ARM9Write32(dstaddr, *(u32*)&data[8]); dstaddr += 4;
-            ARM9Write32(dstaddr, *(u32*)&data[12]); dstaddr += 4;
+            ARM9Write32(dstaddr, *(u32*)&data[i]); dstaddr += 4;
         }
+        delete[] data;
 
-        *(u32*)&tmp[0] = bootparams[7];
-        *(u32*)&tmp[4] = -bootparams[7];
-        *(u32*)&tmp[8] = ~bootparams[7];
-        *(u32*)&tmp[12] = 0;
-        for (int i = 0; i < 16; i++) boot2iv[i] = tmp[15-i];
-
-        AES_init_ctx_iv(&ctx, boot2key, boot2iv);
+        *(u32*)&boot2iv[0] = bootparams[7];
+        *(u32*)&boot2iv[4] = -bootparams[7];
+        *(u32*)&boot2iv[8] = ~bootparams[7];
+        *(u32*)&boot2iv[12] = 0;
 
+        len = (bootparams[7] + 0xF) & ~0xF;
+        data = new u8[len];
         fseek(SDMMCFile, bootparams[4], SEEK_SET);
+        fread(data, len, 1, SDMMCFile);
+        DSi_AES::ApplyModcrypt(data, len, (u8*)boot2key, boot2iv);
+
         dstaddr = bootparams[6];
-        for (u32 i = 0; i < bootparams[7]; i += 16)
+        for (u32 i = 0; i < len; i += 4)
         {
-            u8 data[16];
-            fread(data, 16, 1, SDMMCFile);
-
-            for (int j = 0; j < 16; j++) tmp[j] = data[15-j];
-            AES_CTR_xcrypt_buffer(&ctx, tmp, 16);
-            for (int j = 0; j < 16; j++) data[j] = tmp[15-j];
-
-            ARM7Write32(dstaddr, *(u32*)&data[0]); dstaddr += 4;
-            ARM7Write32(dstaddr, *(u32*)&data[4]); dstaddr += 4;
-            ARM7Write32(dstaddr, *(u32*)&data[8]); dstaddr += 4;
-            ARM7Write32(dstaddr, *(u32*)&data[12]); dstaddr += 4;
+            ARM7Write32(dstaddr, *(u32*)&data[i]); dstaddr += 4;
         }
+        delete[] data;
 
         // repoint the CPUs to the boot2 binaries
 
@@ -534,6 +537,8 @@ bool LoadNAND()
 
 void CloseDSiNAND()
 {
+    if (SDMMC) SDMMC->CloseStorage();
+
     if (DSi::SDMMCFile)
         fclose(DSi::SDMMCFile);
     if (DSi::SDIOFile)
@@ -657,6 +662,8 @@ void MapNWRAM_A(u32 num, u8 val)
             NWRAMMap_A[mVal & 0x03][(mVal >> 2) & 0x3] = ptr;
         }
     }
+
+    NDS::UpdateWRAMPages();
 }
 
 void MapNWRAM_B(u32 num, u8 val)
@@ -712,6 +719,8 @@ void MapNWRAM_B(u32 num, u8 val)
             NWRAMMap_B[mVal & 0x03][(mVal >> 2) & 0x7] = ptr;
         }
     }
+
+    NDS::UpdateWRAMPages();
 }
 
 void MapNWRAM_C(u32 num, u8 val)
@@ -766,6 +775,8 @@ void MapNWRAM_C(u32 num, u8 val)
             NWRAMMap_C[mVal & 0x03][(mVal >> 2) & 0x7] = ptr;
         }
     }
+
+    NDS::UpdateWRAMPages();
 }
 
 void MapNWRAMRange(u32 cpu, u32 num, u32 val)
@@ -839,6 +850,46 @@ void MapNWRAMRange(u32 cpu, u32 num, u32 val)
         case 3: NWRAMMask[cpu][num] = 0x7; break;
         }
     }
+
+    NDS::UpdateWRAMPages();
+}
+
+void UpdateNWRAMPages()
+{
+    for (u32 cpu = 0; cpu < 2; cpu++)
+    {
+        if (!(SCFG_EXT[cpu] & (1 << 25))) continue;
+
+        u8** readpages = cpu ? NDS::ARM7ReadPages : NDS::ARM9ReadPages;
+        u8** writepages = cpu ? NDS::ARM7WritePages : NDS::ARM9WritePages;
+
+        for (u32 addr = 0x03000000; addr < 0x04000000; addr += 0x1000)
+        {
+            u8* ptr;
+            if (addr >= NWRAMStart[cpu][0] && addr < NWRAMEnd[cpu][0])
+            {
+                ptr = NWRAMMap_A[cpu][(addr >> 16) & NWRAMMask[cpu][0]];
+                if (ptr) ptr += (addr & 0xF000);
+            }
+            else if (addr >= NWRAMStart[cpu][1] && addr < NWRAMEnd[cpu][1])
+            {
+                ptr = NWRAMMap_B[cpu][(addr >> 15) & NWRAMMask[cpu][1]];
+                if (ptr) ptr += (addr & 0x7000);
+            }
+            else if (addr >= NWRAMStart[cpu][2] && addr < NWRAMEnd[cpu][2])
+            {
+                ptr = NWRAMMap_C[cpu][(addr >> 15) & NWRAMMask[cpu][2]];
+                if (ptr) ptr += (addr & 0x7000);
+            }
+            else
+                continue;
+
+            readpages[addr >> 12] = ptr;
+
+            // writes go to every part mapped there, they need the bus handlers
+            writepages[addr >> 12] = NULL;
+        }
+    }
 }
 
 void ApplyNewRAMSize(u32 size)
@@ -856,6 +907,8 @@ void ApplyNewRAMSize(u32 size)
         printf("RAM: 16MB\n");
         break;
     }
+
+    NDS::UpdateMainRAMPages();
 }
 
 
@@ -2075,6 +2128,7 @@ void ARM9IOWrite32(u32 addr, u32 val)
             SCFG_EXT[1] &= ~0x0000F080;
             SCFG_EXT[1] |= (val & 0x0000F080);
             printf("SCFG_EXT = %08X / %08X (val9 %08X)\n", SCFG_EXT[0], SCFG_EXT[1], val);
+            NDS::UpdateWRAMPages();
             /*switch ((SCFG_EXT[0] >> 14) & 0x3)
             {
             case 0:
@@ -2449,6 +2503,7 @@ void ARM7IOWrite32(u32 addr, u32 val)
         SCFG_EXT[1] &= ~0x93FF0F07;
         SCFG_EXT[1] |= (val & 0x93FF0F07);
         printf("SCFG_EXT = %08X / %08X (val7 %08X)\n", SCFG_EXT[0], SCFG_EXT[1], val);
+        NDS::UpdateWRAMPages();
         return;
     case 0x04004010:
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
@@ -80,6 +80,9 @@ void MapNWRAM_B(u32 num, u8 val);
 void MapNWRAM_C(u32 num, u8 val);
 void MapNWRAMRange(u32 cpu, u32 num, u32 val);
 
+// apply the new WRAM mapping to the interpreter page tables (see NDS::UpdateWRAMPages())
+void UpdateNWRAMPages();
+
 u8 ARM9Read8(u32 addr);
 u16 ARM9Read16(u32 addr);
 u32 ARM9Read32(u32 addr);
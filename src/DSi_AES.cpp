@@ -24,6 +24,11 @@
 #include "tiny-AES-c/aes.hpp"
 #include "Platform.h"
 
+#if defined(ARCHITECTURE_x86_64) || defined(ARCHITECTURE_ARM64)
+#define HW_AES
+#include "DSi_AES_HW.h"
+#endif
+
 
 namespace DSi_AES
 {
@@ -58,6 +63,8 @@ bool OutputMACDue;
 
 AES_ctx Ctx;
 
+bool UseHWAES;
+
 
 void Swap16(u8* dst, u8* src)
 {
@@ -94,6 +101,12 @@ bool Init()
     const u8 zero[16] = {0};
     AES_init_ctx_iv(&Ctx, zero, zero);
 
+#ifdef HW_AES
+    UseHWAES = DSi_AES_HW::IsSupported();
+#else
+    UseHWAES = false;
+#endif
+
     return true;
 }
 
@@ -154,84 +167,80 @@ void Reset()
 }
 
 
-void ProcessBlock_CCM_Decrypt()
-{
-    u8 data[16];
-    u8 data_rev[16];
-
-    *(u32*)&data[0] = InputFIFO.Read();
-    *(u32*)&data[4] = InputFIFO.Read();
-    *(u32*)&data[8] = InputFIFO.Read();
-    *(u32*)&data[12] = InputFIFO.Read();
+// the blocks given to these are stored byte-reversed, as they come from the FIFO
+// the tiny-AES context provides the key and counter in both cases
 
-    //printf("AES-CCM: "); _printhex2(data, 16);
-
-    Swap16(data_rev, data);
-
-    AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-    for (int i = 0; i < 16; i++) CurMAC[i] ^= data_rev[i];
-    AES_ECB_encrypt(&Ctx, CurMAC);
-
-    Swap16(data, data_rev);
-
-    //printf(" -> "); _printhex2(data, 16);
+void CryptCTR(AES_ctx* ctx, u8* data, u32 numblocks)
+{
+#ifdef HW_AES
+    if (UseHWAES)
+    {
+        DSi_AES_HW::CryptCTR(ctx->RoundKey, ctx->Iv, data, numblocks, true);
+        return;
+    }
+#endif
 
-    OutputFIFO.Write(*(u32*)&data[0]);
-    OutputFIFO.Write(*(u32*)&data[4]);
-    OutputFIFO.Write(*(u32*)&data[8]);
-    OutputFIFO.Write(*(u32*)&data[12]);
+    u8 data_rev[16];
+    for (u32 i = 0; i < numblocks; i++, data += 16)
+    {
+        Swap16(data_rev, data);
+        AES_CTR_xcrypt_buffer(ctx, data_rev, 16);
+        Swap16(data, data_rev);
+    }
 }
 
-void ProcessBlock_CCM_Encrypt()
+void CryptCCM(AES_ctx* ctx, u8* mac, u8* data, u32 numblocks, bool encrypt)
 {
-    u8 data[16];
-    u8 data_rev[16];
-
-    *(u32*)&data[0] = InputFIFO.Read();
-    *(u32*)&data[4] = InputFIFO.Read();
-    *(u32*)&data[8] = InputFIFO.Read();
-    *(u32*)&data[12] = InputFIFO.Read();
-
-    //printf("AES-CCM: "); _printhex2(data, 16);
-
-    Swap16(data_rev, data);
-
-    for (int i = 0; i < 16; i++) CurMAC[i] ^= data_rev[i];
-    AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-    AES_ECB_encrypt(&Ctx, CurMAC);
+#ifdef HW_AES
+    if (UseHWAES)
+    {
+        DSi_AES_HW::CryptCCM(ctx->RoundKey, ctx->Iv, mac, data, numblocks, true, encrypt);
+        return;
+    }
+#endif
 
-    Swap16(data, data_rev);
+    u8 data_rev[16];
+    for (u32 i = 0; i < numblocks; i++, data += 16)
+    {
+        Swap16(data_rev, data);
 
-    //printf(" -> "); _printhex2(data, 16);
+        if (encrypt)
+        {
+            for (int j = 0; j < 16; j++) mac[j] ^= data_rev[j];
+            AES_CTR_xcrypt_buffer(ctx, data_rev, 16);
+        }
+        else
+        {
+            AES_CTR_xcrypt_buffer(ctx, data_rev, 16);
+            for (int j = 0; j < 16; j++) mac[j] ^= data_rev[j];
+        }
+        AES_ECB_encrypt(ctx, mac);
 
-    OutputFIFO.Write(*(u32*)&data[0]);
-    OutputFIFO.Write(*(u32*)&data[4]);
-    OutputFIFO.Write(*(u32*)&data[8]);
-    OutputFIFO.Write(*(u32*)&data[12]);
+        Swap16(data, data_rev);
+    }
 }
 
-void ProcessBlock_CTR()
+void ProcessBlocks(u32 numblocks)
 {
-    u8 data[16];
-    u8 data_rev[16];
+    u8 data[16*4];
 
-    *(u32*)&data[0] = InputFIFO.Read();
-    *(u32*)&data[4] = InputFIFO.Read();
-    *(u32*)&data[8] = InputFIFO.Read();
-    *(u32*)&data[12] = InputFIFO.Read();
+    for (u32 i = 0; i < numblocks*16; i += 4)
+        *(u32*)&data[i] = InputFIFO.Read();
 
-    //printf("AES-CTR: "); _printhex2(data, 16);
+    //printf("AES: "); _printhex2(data, numblocks*16);
 
-    Swap16(data_rev, data);
-    AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-    Swap16(data, data_rev);
+    switch (AESMode)
+    {
+    case 0: CryptCCM(&Ctx, CurMAC, data, numblocks, false); break;
+    case 1: CryptCCM(&Ctx, CurMAC, data, numblocks, true); break;
+    case 2:
+    case 3: CryptCTR(&Ctx, data, numblocks); break;
+    }
 
-    //printf(" -> "); _printhex(data, 16);
+    //printf(" -> "); _printhex(data, numblocks*16);
 
-    OutputFIFO.Write(*(u32*)&data[0]);
-    OutputFIFO.Write(*(u32*)&data[4]);
-    OutputFIFO.Write(*(u32*)&data[8]);
-    OutputFIFO.Write(*(u32*)&data[12]);
+    for (u32 i = 0; i < numblocks*16; i += 4)
+        OutputFIFO.Write(*(u32*)&data[i]);
 }
 
 
@@ -402,17 +411,16 @@ void CheckOutputDMA()
 
 void Update()
 {
-    while (InputFIFO.Level() >= 4 && OutputFIFO.Level() <= 12 && RemBlocks > 0)
-    {
-        switch (AESMode)
-        {
-        case 0: ProcessBlock_CCM_Decrypt(); break;
-        case 1: ProcessBlock_CCM_Encrypt(); break;
-        case 2:
-        case 3: ProcessBlock_CTR(); break;
-        }
+    // process as many blocks as the FIFOs allow in one go
+    u32 numblocks = InputFIFO.Level() >> 2;
+    u32 outspace = (16 - OutputFIFO.Level()) >> 2;
+    if (numblocks > outspace) numblocks = outspace;
+    if (numblocks > RemBlocks) numblocks = RemBlocks;
 
-        RemBlocks--;
+    if (numblocks > 0)
+    {
+        ProcessBlocks(numblocks);
+        RemBlocks -= numblocks;
     }
 
     CheckOutputDMA();
@@ -582,24 +590,22 @@ void GetModcryptKey(u8* romheader, u8* key)
 void ApplyModcrypt(u8* data, u32 len, u8* key, u8* iv)
 {
     u8 key_rev[16], iv_rev[16];
-    u8 data_rev[16];
-    u8 oldkeys[16*2];
-    memcpy(&oldkeys[16*0], Ctx.RoundKey, 16);
-    memcpy(&oldkeys[16*1], Ctx.Iv, 16);
+    AES_ctx ctx;
 
     Swap16(key_rev, key);
     Swap16(iv_rev, iv);
-    AES_init_ctx_iv(&Ctx, key_rev, iv_rev);
+    AES_init_ctx_iv(&ctx, key_rev, iv_rev);
 
-    for (u32 i = 0; i < len; i += 16)
+    CryptCTR(&ctx, data, len >> 4);
+
+    if (len & 0xF)
     {
-        Swap16(data_rev, &data[i]);
-        AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-        Swap16(&data[i], data_rev);
+        u8 tmp[16] = {0};
+        u32 rem = len & 0xF;
+        memcpy(tmp, &data[len & ~0xF], rem);
+        CryptCTR(&ctx, tmp, 1);
+        memcpy(&data[len & ~0xF], tmp, rem);
     }
-
-    memcpy(Ctx.RoundKey, &oldkeys[16*0], 16);
-    memcpy(Ctx.Iv, &oldkeys[16*1], 16);
 }
 
 }
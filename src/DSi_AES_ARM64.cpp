@@ -0,0 +1,207 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+#include "DSi_AES_HW.h"
+
+
+namespace DSi_AES_HW
+{
+
+bool IsSupported()
+{
+#if defined(__APPLE__)
+    // every Apple ARM64 CPU has them
+    return true;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(_WIN32)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+#else
+    return false;
+#endif
+}
+
+
+static inline uint8x16_t Reverse(uint8x16_t val)
+{
+    val = vrev64q_u8(val);
+    return vextq_u8(val, val, 8);
+}
+
+static inline void LoadKey(const u8* roundkey, uint8x16_t* key)
+{
+    for (int i = 0; i < 11; i++)
+        key[i] = vld1q_u8(&roundkey[i*16]);
+}
+
+// encrypts N independent blocks at once, so that the AES units can work
+// on several of them in parallel
+// AESE does AddRoundKey before SubBytes/ShiftRows, hence the shifted key schedule
+template<int N>
+static inline void Encrypt(const uint8x16_t* key, uint8x16_t* block)
+{
+    for (int i = 0; i < 9; i++)
+    {
+        for (int j = 0; j < N; j++)
+            block[j] = vaesmcq_u8(vaeseq_u8(block[j], key[i]));
+    }
+
+    for (int j = 0; j < N; j++)
+        block[j] = veorq_u8(vaeseq_u8(block[j], key[9]), key[10]);
+}
+
+// the counter is kept as two native 64-bit halves, which makes the carry trivial
+struct Counter
+{
+    u64 Lo, Hi;
+
+    void Load(const u8* ctr)
+    {
+        uint64x2_t val = vreinterpretq_u64_u8(Reverse(vld1q_u8(ctr)));
+        Lo = vgetq_lane_u64(val, 0);
+        Hi = vgetq_lane_u64(val, 1);
+    }
+
+    void Store(u8* ctr)
+    {
+        vst1q_u8(ctr, Reverse(vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(Lo), vcreate_u64(Hi)))));
+    }
+
+    uint8x16_t Next()
+    {
+        uint8x16_t ret = Reverse(vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(Lo), vcreate_u64(Hi))));
+        if (++Lo == 0) Hi++;
+        return ret;
+    }
+};
+
+static inline uint8x16_t LoadBlock(const u8* data, bool swapped)
+{
+    uint8x16_t ret = vld1q_u8(data);
+    return swapped ? Reverse(ret) : ret;
+}
+
+static inline void StoreBlock(u8* data, uint8x16_t val, bool swapped)
+{
+    vst1q_u8(data, swapped ? Reverse(val) : val);
+}
+
+
+void CryptCTR(const u8* roundkey, u8* ctr, u8* data, u32 numblocks, bool swapped)
+{
+    uint8x16_t key[11];
+    LoadKey(roundkey, key);
+
+    Counter counter;
+    counter.Load(ctr);
+
+    while (numblocks >= 4)
+    {
+        uint8x16_t ks[4];
+        for (int i = 0; i < 4; i++) ks[i] = counter.Next();
+        Encrypt<4>(key, ks);
+
+        for (int i = 0; i < 4; i++)
+            StoreBlock(&data[i*16], veorq_u8(LoadBlock(&data[i*16], swapped), ks[i]), swapped);
+
+        data += 64;
+        numblocks -= 4;
+    }
+
+    while (numblocks > 0)
+    {
+        uint8x16_t ks = counter.Next();
+        Encrypt<1>(key, &ks);
+
+        StoreBlock(data, veorq_u8(LoadBlock(data, swapped), ks), swapped);
+
+        data += 16;
+        numblocks--;
+    }
+
+    counter.Store(ctr);
+}
+
+void CryptCCM(const u8* roundkey, u8* ctr, u8* mac, u8* data, u32 numblocks, bool swapped, bool encrypt)
+{
+    if (numblocks == 0) return;
+
+    uint8x16_t key[11];
+    LoadKey(roundkey, key);
+
+    Counter counter;
+    counter.Load(ctr);
+
+    // the MAC is a chain, but the keystream isn't: each MAC step is paired
+    // with a keystream block so there's always two encryptions in flight
+    uint8x16_t curmac = vld1q_u8(mac);
+
+    if (encrypt)
+    {
+        for (u32 i = 0; i < numblocks; i++)
+        {
+            uint8x16_t plain = LoadBlock(data, swapped);
+
+            uint8x16_t tmp[2] = {counter.Next(), veorq_u8(curmac, plain)};
+            Encrypt<2>(key, tmp);
+            curmac = tmp[1];
+
+            StoreBlock(data, veorq_u8(plain, tmp[0]), swapped);
+            data += 16;
+        }
+    }
+    else
+    {
+        // decryption needs the plaintext before the MAC step, so the
+        // keystream is generated one block ahead
+        uint8x16_t ks = counter.Next();
+        Encrypt<1>(key, &ks);
+
+        for (u32 i = 0; i < numblocks; i++)
+        {
+            uint8x16_t plain = veorq_u8(LoadBlock(data, swapped), ks);
+            StoreBlock(data, plain, swapped);
+            data += 16;
+
+            if (i < (numblocks-1))
+            {
+                uint8x16_t tmp[2] = {counter.Next(), veorq_u8(curmac, plain)};
+                Encrypt<2>(key, tmp);
+                ks = tmp[0];
+                curmac = tmp[1];
+            }
+            else
+            {
+                curmac = veorq_u8(curmac, plain);
+                Encrypt<1>(key, &curmac);
+            }
+        }
+    }
+
+    vst1q_u8(mac, curmac);
+    counter.Store(ctr);
+}
+
+}
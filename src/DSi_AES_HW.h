@@ -0,0 +1,45 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef DSI_AES_HW_H
+#define DSI_AES_HW_H
+
+#include "types.h"
+
+// AES-128 using the host CPU's AES instructions
+// (AES-NI on x64, the crypto extensions on ARM64)
+//
+// * the key is the expanded key as produced by tiny-AES (11 round keys)
+// * the counter is a 128-bit big-endian value, incremented once per block
+//   and written back, same as tiny-AES' CTR mode does
+// * if 'swapped' is set, the data blocks are stored byte-reversed, which is
+//   how the DSi AES engine gets them
+
+namespace DSi_AES_HW
+{
+
+bool IsSupported();
+
+void CryptCTR(const u8* roundkey, u8* ctr, u8* data, u32 numblocks, bool swapped);
+
+// CCM payload processing: CTR crypt plus CBC-MAC over the plaintext
+void CryptCCM(const u8* roundkey, u8* ctr, u8* mac, u8* data, u32 numblocks, bool swapped, bool encrypt);
+
+}
+
+#endif // DSI_AES_HW_H
@@ -0,0 +1,209 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include "DSi_AES_HW.h"
+
+
+namespace DSi_AES_HW
+{
+
+bool IsSupported()
+{
+    u32 regs[4];
+#ifdef _MSC_VER
+    __cpuid((int*)regs, 1);
+#else
+    if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+        return false;
+#endif
+
+    // ECX bit 25: AES-NI, bit 9: SSSE3 (for the byte shuffles)
+    return (regs[2] & (1<<25)) && (regs[2] & (1<<9));
+}
+
+
+static inline __m128i Reverse(__m128i val)
+{
+    const __m128i mask = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return _mm_shuffle_epi8(val, mask);
+}
+
+static inline void LoadKey(const u8* roundkey, __m128i* key)
+{
+    for (int i = 0; i < 11; i++)
+        key[i] = _mm_loadu_si128((const __m128i*)&roundkey[i*16]);
+}
+
+// encrypts N independent blocks at once, so that the AES units can work
+// on several of them in parallel
+template<int N>
+static inline void Encrypt(const __m128i* key, __m128i* block)
+{
+    for (int j = 0; j < N; j++)
+        block[j] = _mm_xor_si128(block[j], key[0]);
+
+    for (int i = 1; i < 10; i++)
+    {
+        for (int j = 0; j < N; j++)
+            block[j] = _mm_aesenc_si128(block[j], key[i]);
+    }
+
+    for (int j = 0; j < N; j++)
+        block[j] = _mm_aesenclast_si128(block[j], key[10]);
+}
+
+// the counter is kept as two native 64-bit halves, which makes the carry trivial
+struct Counter
+{
+    u64 Lo, Hi;
+
+    void Load(const u8* ctr)
+    {
+        __m128i val = Reverse(_mm_loadu_si128((const __m128i*)ctr));
+        Lo = _mm_cvtsi128_si64(val);
+        Hi = _mm_cvtsi128_si64(_mm_unpackhi_epi64(val, val));
+    }
+
+    void Store(u8* ctr)
+    {
+        _mm_storeu_si128((__m128i*)ctr, Reverse(_mm_set_epi64x(Hi, Lo)));
+    }
+
+    __m128i Next()
+    {
+        __m128i ret = Reverse(_mm_set_epi64x(Hi, Lo));
+        if (++Lo == 0) Hi++;
+        return ret;
+    }
+};
+
+static inline __m128i LoadBlock(const u8* data, bool swapped)
+{
+    __m128i ret = _mm_loadu_si128((const __m128i*)data);
+    return swapped ? Reverse(ret) : ret;
+}
+
+static inline void StoreBlock(u8* data, __m128i val, bool swapped)
+{
+    _mm_storeu_si128((__m128i*)data, swapped ? Reverse(val) : val);
+}
+
+
+void CryptCTR(const u8* roundkey, u8* ctr, u8* data, u32 numblocks, bool swapped)
+{
+    __m128i key[11];
+    LoadKey(roundkey, key);
+
+    Counter counter;
+    counter.Load(ctr);
+
+    while (numblocks >= 4)
+    {
+        __m128i ks[4];
+        for (int i = 0; i < 4; i++) ks[i] = counter.Next();
+        Encrypt<4>(key, ks);
+
+        for (int i = 0; i < 4; i++)
+            StoreBlock(&data[i*16], _mm_xor_si128(LoadBlock(&data[i*16], swapped), ks[i]), swapped);
+
+        data += 64;
+        numblocks -= 4;
+    }
+
+    while (numblocks > 0)
+    {
+        __m128i ks = counter.Next();
+        Encrypt<1>(key, &ks);
+
+        StoreBlock(data, _mm_xor_si128(LoadBlock(data, swapped), ks), swapped);
+
+        data += 16;
+        numblocks--;
+    }
+
+    counter.Store(ctr);
+}
+
+void CryptCCM(const u8* roundkey, u8* ctr, u8* mac, u8* data, u32 numblocks, bool swapped, bool encrypt)
+{
+    if (numblocks == 0) return;
+
+    __m128i key[11];
+    LoadKey(roundkey, key);
+
+    Counter counter;
+    counter.Load(ctr);
+
+    // the MAC is a chain, but the keystream isn't: each MAC step is paired
+    // with a keystream block so there's always two encryptions in flight
+    __m128i curmac = _mm_loadu_si128((const __m128i*)mac);
+
+    if (encrypt)
+    {
+        for (u32 i = 0; i < numblocks; i++)
+        {
+            __m128i plain = LoadBlock(data, swapped);
+
+            __m128i tmp[2] = {counter.Next(), _mm_xor_si128(curmac, plain)};
+            Encrypt<2>(key, tmp);
+            curmac = tmp[1];
+
+            StoreBlock(data, _mm_xor_si128(plain, tmp[0]), swapped);
+            data += 16;
+        }
+    }
+    else
+    {
+        // decryption needs the plaintext before the MAC step, so the
+        // keystream is generated one block ahead
+        __m128i ks = counter.Next();
+        Encrypt<1>(key, &ks);
+
+        for (u32 i = 0; i < numblocks; i++)
+        {
+            __m128i plain = _mm_xor_si128(LoadBlock(data, swapped), ks);
+            StoreBlock(data, plain, swapped);
+            data += 16;
+
+            if (i < (numblocks-1))
+            {
+                __m128i tmp[2] = {counter.Next(), _mm_xor_si128(curmac, plain)};
+                Encrypt<2>(key, tmp);
+                ks = tmp[0];
+                curmac = tmp[1];
+            }
+            else
+            {
+                curmac = _mm_xor_si128(curmac, plain);
+                Encrypt<1>(key, &curmac);
+            }
+        }
+    }
+
+    _mm_storeu_si128((__m128i*)mac, curmac);
+    counter.Store(ctr);
+}
+
+}
@@ -0,0 +1,352 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "DSi_BlockDevice.h"
+#include "Config.h"
+
+
+const u32 ReadAheadMin = 0x2000;
+const u32 ReadAheadMax = 0x40000;
+
+// amount of dirty sectors after which a write-back is started
+const u32 FlushThreshold = 256;
+
+
+DSi_BlockDevice::DSi_BlockDevice(FILE* file, const char* desc)
+{
+    File = file;
+    Desc = desc;
+
+    // anything still sitting in the stdio buffers needs to reach the file
+    // since we're bypassing them from now on
+    fflush(File);
+
+    CacheLock = Platform::Mutex_Create();
+    FlushLock = Platform::Mutex_Create();
+#ifdef _WIN32
+    FileLock = Platform::Mutex_Create();
+#endif
+
+    ReadAhead = new u8[ReadAheadMax];
+    ReadAheadAddr = 0;
+    ReadAheadLen = 0;
+    ReadAheadSize = ReadAheadMin;
+    LastReadEnd = -1;
+
+    SeqReadBytes = 0; RandReadBytes = 0; WriteBytes = 0;
+    FileReadBytes = 0; FileReadTime = 0;
+    NumFlushes = 0;
+
+    FlushSema = Platform::Semaphore_Create();
+    FlushThreadRunning = true;
+    FlushThread = Platform::Thread_Create([this]() { FlushThreadFunc(); });
+}
+
+DSi_BlockDevice::~DSi_BlockDevice()
+{
+    FlushThreadRunning = false;
+    Platform::Semaphore_Post(FlushSema);
+    Platform::Thread_Wait(FlushThread);
+    Platform::Thread_Free(FlushThread);
+    Platform::Semaphore_Free(FlushSema);
+
+    WriteBack();
+
+    // other users of the file go through stdio, make them drop whatever they had buffered
+    fflush(File);
+
+    if (SeqReadBytes || RandReadBytes || WriteBytes)
+    {
+        printf("%s: read %.2f MB sequential, %.2f MB random (%.2f MB from the file, %.1f MB/s), wrote %.2f MB in %u flushes\n",
+               Desc,
+               SeqReadBytes / 1048576.0, RandReadBytes / 1048576.0,
+               FileReadBytes / 1048576.0, FileReadTime > 0 ? (FileReadBytes / 1048576.0) / FileReadTime : 0.0,
+               WriteBytes / 1048576.0, NumFlushes.load());
+    }
+
+    delete[] ReadAhead;
+
+    Platform::Mutex_Free(CacheLock);
+    Platform::Mutex_Free(FlushLock);
+#ifdef _WIN32
+    Platform::Mutex_Free(FileLock);
+#endif
+}
+
+
+void DSi_BlockDevice::ReadFile(u64 addr, u8* data, u32 len)
+{
+#ifdef _WIN32
+    Platform::Mutex_Lock(FileLock);
+    _fseeki64(File, addr, SEEK_SET);
+    size_t res = fread(data, 1, len, File);
+    Platform::Mutex_Unlock(FileLock);
+
+    if (res < len) memset(&data[res], 0, len - res);
+#else
+    int fd = fileno(File);
+    while (len > 0)
+    {
+        ssize_t res = pread(fd, data, len, addr);
+        if (res <= 0)
+        {
+            // past the end of the image
+            memset(data, 0, len);
+            return;
+        }
+
+        data += res;
+        addr += res;
+        len -= res;
+    }
+#endif
+}
+
+void DSi_BlockDevice::WriteFile(u64 addr, const u8* data, u32 len)
+{
+#ifdef _WIN32
+    Platform::Mutex_Lock(FileLock);
+    _fseeki64(File, addr, SEEK_SET);
+    fwrite(data, 1, len, File);
+    Platform::Mutex_Unlock(FileLock);
+#else
+    int fd = fileno(File);
+    while (len > 0)
+    {
+        ssize_t res = pwrite(fd, data, len, addr);
+        if (res <= 0)
+        {
+            printf("%s: write error at %08llX\n", Desc, (unsigned long long)addr);
+            return;
+        }
+
+        data += res;
+        addr += res;
+        len -= res;
+    }
+#endif
+}
+
+void DSi_BlockDevice::SyncFile()
+{
+#ifdef _WIN32
+    Platform::Mutex_Lock(FileLock);
+    fflush(File);
+    _commit(_fileno(File));
+    Platform::Mutex_Unlock(FileLock);
+#else
+    fsync(fileno(File));
+#endif
+}
+
+
+// CacheLock must be held
+void DSi_BlockDevice::ReadSector(u64 sector, u8* data)
+{
+    auto it = Flushing.find(sector);
+    if (it != Flushing.end())
+        memcpy(data, it->second.Data, SectorSize);
+    else
+        ReadFile(sector * SectorSize, data, SectorSize);
+}
+
+// CacheLock must be held
+void DSi_BlockDevice::FillReadAhead(u64 addr, u32 len)
+{
+    auto start = std::chrono::steady_clock::now();
+    ReadFile(addr, ReadAhead, len);
+    FileReadTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    FileReadBytes += len;
+
+    ReadAheadAddr = addr;
+    ReadAheadLen = len;
+
+    // pending writes take precedence over what's in the file
+    u64 end = addr + len;
+    u64 first = addr / SectorSize;
+    u64 last = (end - 1) / SectorSize;
+
+    for (std::map<u64, Sector>* cache : {&Flushing, &Dirty})
+    {
+        for (auto it = cache->lower_bound(first); it != cache->end() && it->first <= last; it++)
+        {
+            u64 secstart = it->first * SectorSize;
+            u64 start = secstart > addr ? secstart : addr;
+            u64 stop = (secstart + SectorSize) < end ? (secstart + SectorSize) : end;
+
+            memcpy(&ReadAhead[start - addr], &it->second.Data[start - secstart], stop - start);
+        }
+    }
+}
+
+void DSi_BlockDevice::StartSequentialRead(u64 addr)
+{
+    if (addr != LastReadEnd)
+        ReadAheadSize = ReadAheadMin;
+}
+
+void DSi_BlockDevice::Read(u64 addr, u8* data, u32 len)
+{
+    bool sequential = (addr == LastReadEnd);
+
+    Platform::Mutex_Lock(CacheLock);
+
+    if (addr < ReadAheadAddr || (addr + len) > (ReadAheadAddr + ReadAheadLen))
+    {
+        // keep growing the window as long as the reads are sequential
+        if (sequential && ReadAheadSize < ReadAheadMax)
+            ReadAheadSize <<= 1;
+        else if (!sequential)
+            ReadAheadSize = ReadAheadMin;
+
+        FillReadAhead(addr, len > ReadAheadSize ? len : ReadAheadSize);
+    }
+
+    memcpy(data, &ReadAhead[addr - ReadAheadAddr], len);
+
+    Platform::Mutex_Unlock(CacheLock);
+
+    LastReadEnd = addr + len;
+
+    if (sequential) SeqReadBytes += len;
+    else            RandReadBytes += len;
+}
+
+void DSi_BlockDevice::Write(u64 addr, const u8* data, u32 len)
+{
+    if (len == 0) return;
+
+    Platform::Mutex_Lock(CacheLock);
+
+    u64 end = addr + len;
+    u64 first = addr / SectorSize;
+    u64 last = (end - 1) / SectorSize;
+
+    for (u64 s = first; s <= last; s++)
+    {
+        u64 secstart = s * SectorSize;
+        u64 start = secstart > addr ? secstart : addr;
+        u64 stop = (secstart + SectorSize) < end ? (secstart + SectorSize) : end;
+
+        auto it = Dirty.find(s);
+        if (it == Dirty.end())
+        {
+            it = Dirty.emplace(s, Sector()).first;
+
+            // partial sector writes need the rest of the sector
+            if ((stop - start) < SectorSize)
+                ReadSector(s, it->second.Data);
+        }
+
+        memcpy(&it->second.Data[start - secstart], &data[start - addr], stop - start);
+    }
+
+    // keep the read-ahead window coherent
+    if (ReadAheadLen > 0 && addr < (ReadAheadAddr + ReadAheadLen) && end > ReadAheadAddr)
+    {
+        u64 start = addr > ReadAheadAddr ? addr : ReadAheadAddr;
+        u64 stop = end < (ReadAheadAddr + ReadAheadLen) ? end : (ReadAheadAddr + ReadAheadLen);
+
+        memcpy(&ReadAhead[start - ReadAheadAddr], &data[start - addr], stop - start);
+    }
+
+    u32 numdirty = Dirty.size();
+
+    Platform::Mutex_Unlock(CacheLock);
+
+    WriteBytes += len;
+
+    if (numdirty >= FlushThreshold)
+        RequestFlush();
+}
+
+
+void DSi_BlockDevice::RequestFlush()
+{
+    Platform::Semaphore_Post(FlushSema);
+}
+
+void DSi_BlockDevice::Flush()
+{
+    WriteBack();
+}
+
+void DSi_BlockDevice::FlushThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(FlushSema);
+        if (!FlushThreadRunning) return;
+
+        WriteBack();
+    }
+}
+
+void DSi_BlockDevice::WriteBack()
+{
+    Platform::Mutex_Lock(FlushLock);
+
+    Platform::Mutex_Lock(CacheLock);
+    Flushing.swap(Dirty);
+    Platform::Mutex_Unlock(CacheLock);
+
+    if (!Flushing.empty())
+    {
+        // coalesce consecutive sectors into bigger writes
+        std::vector<u8> buffer;
+        buffer.reserve(ReadAheadMax);
+        u64 bufstart = 0;
+
+        for (auto& it : Flushing)
+        {
+            u64 addr = it.first * SectorSize;
+
+            if (!buffer.empty() && (addr != (bufstart + buffer.size()) || buffer.size() >= ReadAheadMax))
+            {
+                WriteFile(bufstart, buffer.data(), buffer.size());
+                buffer.clear();
+            }
+
+            if (buffer.empty()) bufstart = addr;
+            buffer.insert(buffer.end(), it.second.Data, it.second.Data + SectorSize);
+        }
+
+        if (!buffer.empty())
+            WriteFile(bufstart, buffer.data(), buffer.size());
+
+        if (Config::DSiStorageSync)
+            SyncFile();
+
+        Platform::Mutex_Lock(CacheLock);
+        Flushing.clear();
+        Platform::Mutex_Unlock(CacheLock);
+
+        NumFlushes++;
+    }
+
+    Platform::Mutex_Unlock(FlushLock);
+}
@@ -0,0 +1,105 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef DSI_BLOCKDEVICE_H
+#define DSI_BLOCKDEVICE_H
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include "types.h"
+#include "Platform.h"
+
+// backing storage for the DSi SD card and NAND images
+//
+// * reads are served from a read-ahead window, which grows while a
+//   multi-block read keeps going sequentially
+// * writes go to a sector cache, which is written back to the file by
+//   a separate thread, either when enough sectors are dirty or when the
+//   emulated transfer is stopped
+// * the file is accessed with pread()/pwrite() so that both threads can
+//   use it concurrently (with a fallback to locked stdio on Windows)
+
+class DSi_BlockDevice
+{
+public:
+    DSi_BlockDevice(FILE* file, const char* desc);
+    ~DSi_BlockDevice();
+
+    void Read(u64 addr, u8* data, u32 len);
+    void Write(u64 addr, const u8* data, u32 len);
+
+    // hint that a multi-block read starts at the given address
+    void StartSequentialRead(u64 addr);
+
+    // have the pending writes written back in the background
+    void RequestFlush();
+
+    // write back the pending writes before returning
+    void Flush();
+
+    static const u32 SectorSize = 0x200;
+
+private:
+    FILE* File;
+    const char* Desc;
+
+    struct Sector
+    {
+        u8 Data[SectorSize];
+    };
+
+    // keyed by sector number
+    // Flushing holds the sectors being written back by the flush thread
+    std::map<u64, Sector> Dirty;
+    std::map<u64, Sector> Flushing;
+    Platform::Mutex* CacheLock;
+    Platform::Mutex* FlushLock;
+#ifdef _WIN32
+    Platform::Mutex* FileLock;
+#endif
+
+    Platform::Thread* FlushThread;
+    Platform::Semaphore* FlushSema;
+    std::atomic_bool FlushThreadRunning;
+
+    u8* ReadAhead;
+    u64 ReadAheadAddr;
+    u32 ReadAheadLen;
+    u32 ReadAheadSize;
+    u64 LastReadEnd;
+
+    // stats
+    // the file reads are timed, not the reads served from the read-ahead window
+    u64 SeqReadBytes, RandReadBytes, WriteBytes;
+    u64 FileReadBytes;
+    double FileReadTime;
+    std::atomic<u32> NumFlushes; // counted by the flush thread
+
+    void FlushThreadFunc();
+    void WriteBack();
+
+    void ReadFile(u64 addr, u8* data, u32 len);
+    void WriteFile(u64 addr, const u8* data, u32 len);
+    void SyncFile();
+
+    void ReadSector(u64 sector, u8* data);
+    void FillReadAhead(u64 addr, u32 len);
+};
+
+#endif // DSI_BLOCKDEVICE_H
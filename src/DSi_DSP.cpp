@@ -16,6 +16,7 @@
     with melonDS. If not, see http://www.gnu.org/licenses/.
 */
 
+#include <string.h>
 #include "teakra/include/teakra/teakra.h"
 
 #include "DSi.h"
@@ -42,6 +43,13 @@ u16 DSP_REP[3];
 
 u64 DSPTimestamp;
 
+// how often the DSP is brought up to date while it's running
+const u32 DSPSlice = 16384; // from citra (TeakraSlice)
+// cap on how long it can be left alone while it's waiting
+const u32 DSPMaxIdleSlice = 1 << 20;
+
+DSPStats Stats;
+
 FIFO<u16, 16> PDATAReadFifo/*, *PDATAWriteFifo*/;
 int PDataDMALen = 0;
 
@@ -151,6 +159,8 @@ void Reset()
     TeakraCore->Reset();
 
     NDS::CancelEvent(NDS::Event_DSi_DSP);
+
+    memset(&Stats, 0, sizeof(Stats));
 }
 
 bool IsRstReleased()
@@ -235,9 +245,50 @@ bool DSPCatchUp()
     }
     Run((u32)backlog);
 
+    Stats.NumCatchUps++;
     return true;
 }
-void DSPCatchUpU32(u32 _) { DSPCatchUp(); }
+
+void DSPCatchUpU32(u32 _)
+{
+    if (!DSPCatchUp()) return;
+
+    // if the DSP is waiting for something (halted, or polling for a reply from the ARM9), it
+    // only needs to be brought up to date once one of its own components (timer, audio output,
+    // DMA) fires, or when the ARM9 accesses it, which syncs it anyway
+    u64 idle = TeakraCore->GetIdleCycles() >> NDS::ARM9ClockShift;
+    if (idle > DSPSlice)
+    {
+        NDS::CancelEvent(NDS::Event_DSi_DSP);
+        NDS::ScheduleEvent(NDS::Event_DSi_DSP, false,
+                idle > DSPMaxIdleSlice ? DSPMaxIdleSlice : (u32)idle, DSPCatchUpU32, 0);
+    }
+}
+
+// registers that only exist on the ARM9 side, and don't need the DSP to be up to date
+bool IsLocalReg(u32 addr)
+{
+    switch (addr & 0x3E)
+    {
+    case 0x04: // PADR
+    case 0x10: // PSEM (the value last written, not the DSP-side semaphore)
+    case 0x14: // PMASK
+    case 0x20: // CMD0
+    case 0x28: // CMD1
+    case 0x30: // CMD2
+        return true;
+    }
+
+    return false;
+}
+
+bool DSPCatchUp(u32 addr)
+{
+    if (IsLocalReg(addr))
+        return IsDSPCoreEnabled();
+
+    return DSPCatchUp();
+}
 
 void PDataDMAWrite(u16 wrval)
 {
@@ -388,7 +439,7 @@ u8 Read8(u32 addr)
     if (!(DSi::SCFG_EXT[0] & (1<<18)))
         return 0;
 
-    if (!DSPCatchUp()) return 0;
+    if (!DSPCatchUp(addr)) return 0;
 
     addr &= 0x3F; // mirroring wheee
 
@@ -417,7 +468,7 @@ u16 Read16(u32 addr)
     if (!(DSi::SCFG_EXT[0] & (1<<18)))
         return 0;
 
-    if (!DSPCatchUp()) return 0;
+    if (!DSPCatchUp(addr)) return 0;
 
     addr &= 0x3E; // mirroring wheee
 
@@ -491,6 +542,13 @@ void Write16(u32 addr, u16 val)
 {
     if (!(DSi::SCFG_EXT[0] & (1<<18))) return;
 
+    // PADR is the only register whose writes the DSP can't see
+    if ((addr & 0x3E) == 0x04)
+    {
+        if (IsDSPCoreEnabled()) DSP_PADR = val;
+        return;
+    }
+
     if (!DSPCatchUp()) return;
 
     addr &= 0x3E;
@@ -560,8 +618,15 @@ void Run(u32 cycles)
 
     DSPTimestamp += cycles;
 
-    NDS::ScheduleEvent(NDS::Event_DSi_DSP, false,
-            16384/*from citra (TeakraSlice)*/, DSPCatchUpU32, 0);
+    NDS::CancelEvent(NDS::Event_DSi_DSP);
+    NDS::ScheduleEvent(NDS::Event_DSi_DSP, false, DSPSlice, DSPCatchUpU32, 0);
+}
+
+void GetStats(DSPStats* stats)
+{
+    *stats = Stats;
+    stats->ExecutedCycles = TeakraCore->GetExecutedCycles();
+    stats->SkippedCycles = TeakraCore->GetSkippedCycles();
 }
 
 void DoSavestate(Savestate* file)
@@ -65,6 +65,16 @@ void Write32(u32 addr, u32 val);
 // NOTE: checks SCFG_CLK9
 void Run(u32 cycles);
 
+struct DSPStats
+{
+    u64 ExecutedCycles; // cycles the DSP spent running instructions
+    u64 SkippedCycles;  // cycles skipped in bulk while it was waiting in an idle or polling loop
+    u32 NumCatchUps;    // how many times it was brought up to the ARM9's time
+};
+
+// since the last reset
+void GetStats(DSPStats* stats);
+
 }
 
 #endif // DSI_DSP_H
@@ -62,6 +62,16 @@ DSi_SDHost::~DSi_SDHost()
     if (Ports[1]) delete Ports[1];
 }
 
+void DSi_SDHost::CloseStorage()
+{
+    if (Num != 0) return;
+
+    if (Ports[0]) delete Ports[0];
+    if (Ports[1]) delete Ports[1];
+    Ports[0] = nullptr;
+    Ports[1] = nullptr;
+}
+
 void DSi_SDHost::Reset()
 {
     if (Num == 0)
@@ -717,11 +727,13 @@ void DSi_SDHost::CheckSwapFIFO()
 DSi_MMCStorage::DSi_MMCStorage(DSi_SDHost* host, bool internal, FILE* file) : DSi_SDDevice(host)
 {
     Internal = internal;
-    File = file;
+    Storage = file ? new DSi_BlockDevice(file, MMC_DESC) : nullptr;
 }
 
 DSi_MMCStorage::~DSi_MMCStorage()
-{}
+{
+    if (Storage) delete Storage;
+}
 
 void DSi_MMCStorage::Reset()
 {
@@ -824,7 +836,7 @@ void DSi_MMCStorage::SendCMD(u8 cmd, u32 param)
 
     case 12: // stop operation
         SetState(0x04);
-        if (File) fflush(File);
+        if (Storage) Storage->RequestFlush();
         RWCommand = 0;
         Host->SendResponse(CSR, true);
         return;
@@ -854,6 +866,7 @@ void DSi_MMCStorage::SendCMD(u8 cmd, u32 param)
             BlockSize = 512;
         }
         RWCommand = 18;
+        if (Storage) Storage->StartSequentialRead(RWAddress);
         Host->SendResponse(CSR, true);
         RWAddress += ReadBlock(RWAddress);
         SetState(0x05);
@@ -941,17 +954,19 @@ void DSi_MMCStorage::ContinueTransfer()
     RWAddress += len;
 }
 
+// NAND sectors are handed out as they are stored, encrypted. Decrypting them
+// is the guest's job, done through the AES engine, which doesn't know which
+// sector it is being fed. A decrypted-sector cache would thus have to key on
+// the engine's input data, and hashing it costs more than the AES itself now
+// that the engine uses the host's AES instructions (about 1 GB/s).
 u32 DSi_MMCStorage::ReadBlock(u64 addr)
 {
     u32 len = BlockSize;
     len = Host->GetTransferrableLen(len);
 
     u8 data[0x200];
-    if (File)
-    {
-        fseek(File, addr, SEEK_SET);
-        fread(data, 1, len, File);
-    }
+    if (Storage)
+        Storage->Read(addr, data, len);
 
     return Host->DataRX(data, len);
 }
@@ -964,11 +979,8 @@ u32 DSi_MMCStorage::WriteBlock(u64 addr)
     u8 data[0x200];
     if ((len = Host->DataTX(data, len)))
     {
-        if (File)
-        {
-            fseek(File, addr, SEEK_SET);
-            fwrite(data, 1, len, File);
-        }
+        if (Storage)
+            Storage->Write(addr, data, len);
     }
 
     return len;
@@ -21,6 +21,7 @@
 
 #include <string.h>
 #include "FIFO.h"
+#include "DSi_BlockDevice.h"
 
 
 class DSi_SDDevice;
@@ -49,6 +50,9 @@ public:
 
     void SetCardIRQ();
 
+    // write back and release the SD/NAND images (they're about to be closed)
+    void CloseStorage();
+
     u16 Read(u32 addr);
     void Write(u32 addr, u16 val);
     u16 ReadFIFO16();
@@ -134,7 +138,7 @@ public:
 
 private:
     bool Internal;
-    FILE* File;
+    DSi_BlockDevice* Storage;
 
     u8 CID[16];
     u8 CSD[16];
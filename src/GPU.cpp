@@ -18,6 +18,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
+#include <chrono>
 #include "NDS.h"
 #include "GPU.h"
 
@@ -36,6 +38,13 @@ u16 TotalScanlines;
 
 bool RunFIFO;
 
+// when no DMA feeds the display FIFO, it doesn't need to be serviced every
+// 8 pixels: it is sampled lazily, before it is written to and when the
+// scanline is drawn
+bool LazyFIFO;
+u64 LazyFIFOLineStart;
+u32 LazyFIFOPos;
+
 u16 DispStat[2], VMatch[2];
 
 u8 Palette[2*1024];
@@ -79,7 +88,29 @@ u8* VRAMPtr_BBG[0x8];
 u8* VRAMPtr_BOBJ[0x8];
 
 int FrontBuffer;
-u32* Framebuffer[2][2];
+u32* Framebuffer[3][2];
+
+// triple buffering:
+// * BackBuffer is the set being rendered, owned by the emulator thread
+// * PresentBuffer is the set the frontend is reading, owned by the frontend
+// * ReadyBuffer holds the set for the latest finished frame, and is swapped
+//   with either of the two others, along with a flag telling whether it
+//   holds a frame the frontend hasn't picked up yet
+// when the frontend doesn't consume frames, BackBuffer and ReadyBuffer keep
+// alternating between the same two sets. this is the case with the OpenGL
+// renderer, whose compositor only has two outputs (sets 0 and 1)
+//
+// ResetBufferExchange() also reassigns PresentBuffer, so it must only be
+// called while the frontend can't be in AcquirePresentBuffer() or reading
+// a framebuffer: the frontend is expected to hold off presenting around
+// SetRenderSettings()
+const u32 ReadyBufferNew = 0x4;
+int BackBuffer;
+int PresentBuffer;
+std::atomic<u32> ReadyBuffer;
+u64 FrameTime[3];
+
+void ResetBufferExchange();
 int Renderer = 0;
 
 GPU2D::Unit GPU2D_A(0);
@@ -148,9 +179,12 @@ bool Init()
     GPU2D_Renderer = std::make_unique<GPU2D::SoftRenderer>();
     if (!GPU3D::Init()) return false;
 
-    FrontBuffer = 0;
-    Framebuffer[0][0] = NULL; Framebuffer[0][1] = NULL;
-    Framebuffer[1][0] = NULL; Framebuffer[1][1] = NULL;
+    ResetBufferExchange();
+    for (int i = 0; i < 3; i++)
+    {
+        Framebuffer[i][0] = NULL;
+        Framebuffer[i][1] = NULL;
+    }
     Renderer = 0;
 
     return true;
@@ -161,10 +195,11 @@ void DeInit()
     GPU2D_Renderer.reset();
     GPU3D::DeInit();
 
-    if (Framebuffer[0][0]) delete[] Framebuffer[0][0];
-    if (Framebuffer[0][1]) delete[] Framebuffer[0][1];
-    if (Framebuffer[1][0]) delete[] Framebuffer[1][0];
-    if (Framebuffer[1][1]) delete[] Framebuffer[1][1];
+    for (int i = 0; i < 3; i++)
+    {
+        if (Framebuffer[i][0]) delete[] Framebuffer[i][0];
+        if (Framebuffer[i][1]) delete[] Framebuffer[i][1];
+    }
 }
 
 void ResetVRAMCache()
@@ -201,6 +236,10 @@ void Reset()
     NextVCount = -1;
     TotalScanlines = 0;
 
+    LazyFIFO = false;
+    LazyFIFOLineStart = 0;
+    LazyFIFOPos = 0;
+
     DispStat[0] = 0;
     DispStat[1] = 0;
     VMatch[0] = 0;
@@ -251,23 +290,20 @@ void Reset()
     else
         fbsize = 256 * 192;
 
-    for (size_t i = 0; i < fbsize; i++)
+    for (int j = 0; j < 3; j++)
     {
-        Framebuffer[0][0][i] = 0xFFFFFFFF;
-        Framebuffer[1][0][i] = 0xFFFFFFFF;
-    }
-    for (size_t i = 0; i < fbsize; i++)
-    {
-        Framebuffer[0][1][i] = 0xFFFFFFFF;
-        Framebuffer[1][1][i] = 0xFFFFFFFF;
+        for (size_t i = 0; i < fbsize; i++)
+        {
+            Framebuffer[j][0][i] = 0xFFFFFFFF;
+            Framebuffer[j][1][i] = 0xFFFFFFFF;
+        }
     }
 
     GPU2D_A.Reset();
     GPU2D_B.Reset();
     GPU3D::Reset();
 
-    int backbuf = FrontBuffer ? 0 : 1;
-    GPU2D_Renderer->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
+    GPU2D_Renderer->SetFramebuffer(Framebuffer[BackBuffer][1], Framebuffer[BackBuffer][0]);
 
     ResetRenderer();
 
@@ -285,10 +321,11 @@ void Stop()
     else
         fbsize = 256 * 192;
 
-    memset(Framebuffer[0][0], 0, fbsize*4);
-    memset(Framebuffer[0][1], 0, fbsize*4);
-    memset(Framebuffer[1][0], 0, fbsize*4);
-    memset(Framebuffer[1][1], 0, fbsize*4);
+    for (int i = 0; i < 3; i++)
+    {
+        memset(Framebuffer[i][0], 0, fbsize*4);
+        memset(Framebuffer[i][1], 0, fbsize*4);
+    }
 
 #ifdef OGLRENDERER_ENABLED
     // This needs a better way to know that we're
@@ -345,6 +382,15 @@ void DoSavestate(Savestate* file)
     file->Var32(&VRAMMap_ARM7[0]);
     file->Var32(&VRAMMap_ARM7[1]);
 
+    if (file->IsAtleastVersion(9, 2))
+    {
+        file->Bool32(&LazyFIFO);
+        file->Var64(&LazyFIFOLineStart);
+        file->Var32(&LazyFIFOPos);
+    }
+    else
+        LazyFIFO = false;
+
     if (!file->Saving)
     {
         for (int i = 0; i < 0x20; i++)
@@ -366,15 +412,50 @@ void DoSavestate(Savestate* file)
 
 void AssignFramebuffers()
 {
-    int backbuf = FrontBuffer ? 0 : 1;
     if (NDS::PowerControl9 & (1<<15))
     {
-        GPU2D_Renderer->SetFramebuffer(Framebuffer[backbuf][0], Framebuffer[backbuf][1]);
+        GPU2D_Renderer->SetFramebuffer(Framebuffer[BackBuffer][0], Framebuffer[BackBuffer][1]);
     }
     else
     {
-        GPU2D_Renderer->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
+        GPU2D_Renderer->SetFramebuffer(Framebuffer[BackBuffer][1], Framebuffer[BackBuffer][0]);
+    }
+}
+
+u64 GetTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ResetBufferExchange()
+{
+    FrontBuffer = 0;
+    BackBuffer = 1;
+    PresentBuffer = 2;
+    ReadyBuffer = 0;
+    memset(FrameTime, 0, sizeof(FrameTime));
+}
+
+void PublishFrame()
+{
+    FrameTime[BackBuffer] = GetTimestamp();
+
+    FrontBuffer = BackBuffer;
+    BackBuffer = ReadyBuffer.exchange(BackBuffer | ReadyBufferNew) & 0x3;
+}
+
+int AcquirePresentBuffer(u64* frametime)
+{
+    if (ReadyBuffer.load() & ReadyBufferNew)
+    {
+        PresentBuffer = ReadyBuffer.exchange(PresentBuffer) & 0x3;
+        if (frametime) *frametime = FrameTime[PresentBuffer];
     }
+    else if (frametime)
+        *frametime = 0;
+
+    return PresentBuffer;
 }
 
 void InitRenderer(int renderer)
@@ -451,21 +532,20 @@ void SetRenderSettings(int renderer, RenderSettings& settings)
     else
         fbsize = 256 * 192;
 
-    if (Framebuffer[0][0]) { delete[] Framebuffer[0][0]; Framebuffer[0][0] = nullptr; }
-    if (Framebuffer[1][0]) { delete[] Framebuffer[1][0]; Framebuffer[1][0] = nullptr; }
-    if (Framebuffer[0][1]) { delete[] Framebuffer[0][1]; Framebuffer[0][1] = nullptr; }
-    if (Framebuffer[1][1]) { delete[] Framebuffer[1][1]; Framebuffer[1][1] = nullptr; }
+    for (int i = 0; i < 3; i++)
+    {
+        if (Framebuffer[i][0]) { delete[] Framebuffer[i][0]; Framebuffer[i][0] = nullptr; }
+        if (Framebuffer[i][1]) { delete[] Framebuffer[i][1]; Framebuffer[i][1] = nullptr; }
 
-    Framebuffer[0][0] = new u32[fbsize];
-    Framebuffer[1][0] = new u32[fbsize];
-    Framebuffer[0][1] = new u32[fbsize];
-    Framebuffer[1][1] = new u32[fbsize];
+        Framebuffer[i][0] = new u32[fbsize];
+        Framebuffer[i][1] = new u32[fbsize];
 
-    memset(Framebuffer[0][0], 0, fbsize*4);
-    memset(Framebuffer[1][0], 0, fbsize*4);
-    memset(Framebuffer[0][1], 0, fbsize*4);
-    memset(Framebuffer[1][1], 0, fbsize*4);
+        memset(Framebuffer[i][0], 0, fbsize*4);
+        memset(Framebuffer[i][1], 0, fbsize*4);
+    }
 
+    // the GL compositor relies on the buffers alternating
+    ResetBufferExchange();
     AssignFramebuffers();
 
     if (Renderer == 0)
@@ -583,6 +663,8 @@ void MapVRAM_AB(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateVRAMPages();
 }
 
 void MapVRAM_CD(u32 bank, u8 cnt)
@@ -667,6 +749,8 @@ void MapVRAM_CD(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateVRAMPages();
 }
 
 void MapVRAM_E(u32 bank, u8 cnt)
@@ -729,6 +813,8 @@ void MapVRAM_E(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateVRAMPages();
 }
 
 void MapVRAM_FG(u32 bank, u8 cnt)
@@ -827,6 +913,8 @@ void MapVRAM_FG(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateVRAMPages();
 }
 
 void MapVRAM_H(u32 bank, u8 cnt)
@@ -887,6 +975,8 @@ void MapVRAM_H(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateVRAMPages();
 }
 
 void MapVRAM_I(u32 bank, u8 cnt)
@@ -955,6 +1045,44 @@ void MapVRAM_I(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateVRAMPages();
+}
+
+u8* GetARM9VRAMPage(u32 addr)
+{
+    u8* ptr;
+
+    switch (addr & 0x00E00000)
+    {
+    case 0x00000000: ptr = VRAMPtr_ABG[(addr >> 14) & 0x1F]; break;
+    case 0x00200000: ptr = VRAMPtr_BBG[(addr >> 14) & 0x7]; break;
+    case 0x00400000: ptr = VRAMPtr_AOBJ[(addr >> 14) & 0xF]; break;
+    case 0x00600000: ptr = VRAMPtr_BOBJ[(addr >> 14) & 0x7]; break;
+    default:
+        {
+            // LCDC: all the banks back to back
+            u32 offset = addr & 0xFFFFF;
+            for (int bank = 0; bank < 9; bank++)
+            {
+                if (offset <= VRAMMask[bank])
+                {
+                    if (!(VRAMMap_LCDC & (1<<bank))) return NULL;
+                    return &VRAM[bank][offset & ~0xFFF];
+                }
+
+                offset -= (VRAMMask[bank] + 1);
+            }
+            return NULL;
+        }
+    }
+
+    return ptr ? &ptr[addr & 0x3000] : NULL;
+}
+
+u8* GetARM7VRAMPage(u32 addr)
+{
+    return GetUniqueBankPtr(VRAMMap_ARM7[(addr >> 17) & 0x1], addr & 0x1F000);
 }
 
 
@@ -978,7 +1106,7 @@ void SetPowerCnt(u32 val)
 }
 
 
-void DisplayFIFO(u32 x)
+void SampleDisplayFIFO(u32 x)
 {
     // sample the FIFO
     // as this starts 16 cycles (~3 pixels) before display start,
@@ -991,14 +1119,37 @@ void DisplayFIFO(u32 x)
             GPU2D_A.SampleFIFO(x-11, 8);
     }
 
+    if (x >= 256)
+        GPU2D_A.SampleFIFO(253, 3); // sample the remaining pixels
+}
+
+void DisplayFIFO(u32 x)
+{
+    SampleDisplayFIFO(x);
+
     if (x < 256)
     {
         // transfer the next 8 pixels
         NDS::CheckDMAs(0, 0x04);
         NDS::ScheduleEvent(NDS::Event_DisplayFIFO, true, 6*8, DisplayFIFO, x+8);
     }
-    else
-        GPU2D_A.SampleFIFO(253, 3); // sample the remaining pixels
+}
+
+// catch up with the samples that were due up to the given time
+void SyncDisplayFIFO(u64 time)
+{
+    while (LazyFIFOPos <= 256 && (LazyFIFOLineStart + 32 + (LazyFIFOPos * 6)) <= time)
+    {
+        SampleDisplayFIFO(LazyFIFOPos);
+        LazyFIFOPos += 8;
+    }
+}
+
+void SyncDisplayFIFO()
+{
+    if (!LazyFIFO) return;
+
+    SyncDisplayFIFO(NDS::ARM9Timestamp >> NDS::ARM9ClockShift);
 }
 
 void StartFrame()
@@ -1023,6 +1174,9 @@ void StartHBlank(u32 line)
         // note: this should start 48 cycles after the scanline start
         if (line < 192)
         {
+            if (LazyFIFO)
+                SyncDisplayFIFO(NDS::SchedList[NDS::Event_LCD].Timestamp);
+
             GPU2D_Renderer->DrawScanline(line, &GPU2D_A);
             GPU2D_Renderer->DrawScanline(line, &GPU2D_B);
         }
@@ -1057,7 +1211,7 @@ void StartHBlank(u32 line)
 
 void FinishFrame(u32 lines)
 {
-    FrontBuffer = FrontBuffer ? 0 : 1;
+    PublishFrame();
     AssignFramebuffers();
 
     TotalScanlines = lines;
@@ -1071,6 +1225,13 @@ void FinishFrame(u32 lines)
 
 void StartScanline(u32 line)
 {
+    if (LazyFIFO)
+    {
+        // finish the previous scanline
+        SyncDisplayFIFO(-1);
+        LazyFIFO = false;
+    }
+
     if (line == 0)
         VCount = 0;
     else if (NextVCount != 0xFFFFFFFF)
@@ -1119,7 +1280,19 @@ void StartScanline(u32 line)
         }
 
         if (RunFIFO)
-            NDS::ScheduleEvent(NDS::Event_DisplayFIFO, false, 32, DisplayFIFO, 0);
+        {
+            // the FIFO only needs to be serviced on time for DMA
+            if (NDS::DMAsInMode(0, 0x04))
+                NDS::ScheduleEvent(NDS::Event_DisplayFIFO, false, 32, DisplayFIFO, 0);
+            else
+            {
+                // events can be run late within a batch: use the time the
+                // scanline was due to start, not the time it is processed at
+                LazyFIFO = true;
+                LazyFIFOLineStart = NDS::SchedList[NDS::Event_LCD].Timestamp;
+                LazyFIFOPos = 0;
+            }
+        }
     }
 
     if (VCount == 262)
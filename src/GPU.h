@@ -72,8 +72,11 @@ extern u8* VRAMPtr_AOBJ[0x10];
 extern u8* VRAMPtr_BBG[0x8];
 extern u8* VRAMPtr_BOBJ[0x8];
 
+// FrontBuffer is the set of framebuffers holding the latest finished frame,
+// for use from the emulator thread
+// other threads should go through AcquirePresentBuffer()
 extern int FrontBuffer;
-extern u32* Framebuffer[2][2];
+extern u32* Framebuffer[3][2];
 
 extern GPU2D::Unit GPU2D_A;
 extern GPU2D::Unit GPU2D_B;
@@ -174,6 +177,8 @@ void InitRenderer(int renderer);
 void DeInitRenderer();
 void ResetRenderer();
 
+// reallocates the framebuffers and resets the buffer exchange: the frontend
+// must not be presenting a frame meanwhile (see AcquirePresentBuffer())
 void SetRenderSettings(int renderer, RenderSettings& settings);
 
 
@@ -186,6 +191,11 @@ void MapVRAM_FG(u32 bank, u8 cnt);
 void MapVRAM_H(u32 bank, u8 cnt);
 void MapVRAM_I(u32 bank, u8 cnt);
 
+// host pointer to the given 4KB page of VRAM as seen by each CPU
+// or NULL if no bank or several banks are mapped there
+u8* GetARM9VRAMPage(u32 addr);
+u8* GetARM7VRAMPage(u32 addr);
+
 
 template<typename T>
 T ReadVRAM_LCDC(u32 addr)
@@ -607,10 +617,22 @@ void SetPowerCnt(u32 val);
 
 void StartFrame();
 void FinishFrame(u32 lines);
+
+// to be called from the frontend's presentation thread
+// returns the set of framebuffers holding the latest finished frame. it is
+// reserved for the frontend until the next call and won't be rendered to.
+// frametime receives the time at which the frame was finished if it is a
+// new one, 0 otherwise (see GetTimestamp())
+// not for use with the OpenGL renderer, which presents GPU::FrontBuffer
+int AcquirePresentBuffer(u64* frametime);
+
+// monotonic time in microseconds
+u64 GetTimestamp();
 void StartScanline(u32 line);
 void StartHBlank(u32 line);
 
 void DisplayFIFO(u32 x);
+void SyncDisplayFIFO();
 
 void SetDispStat(u32 cpu, u16 val);
 
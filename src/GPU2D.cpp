@@ -385,9 +385,11 @@ void Unit::Write16(u32 addr, u16 val)
         break;
 
     case 0x068:
+        if (!Num) GPU::SyncDisplayFIFO();
         DispFIFO[DispFIFOWritePtr] = val;
         return;
     case 0x06A:
+        if (!Num) GPU::SyncDisplayFIFO();
         DispFIFO[DispFIFOWritePtr+1] = val;
         DispFIFOWritePtr += 2;
         DispFIFOWritePtr &= 0xF;
@@ -527,6 +529,7 @@ void Unit::Write32(u32 addr, u32 val)
         return;
 
     case 0x068:
+        if (!Num) GPU::SyncDisplayFIFO();
         DispFIFO[DispFIFOWritePtr] = val & 0xFFFF;
         DispFIFO[DispFIFOWritePtr+1] = val >> 16;
         DispFIFOWritePtr += 2;
@@ -159,6 +159,11 @@ public:
     virtual void RenderFrame() = 0;
     virtual void RestartFrame() {};
     virtual u32* GetLine(int line) = 0;
+
+    // the frame rendered during the last VBlank (to be shown next), for state
+    // hashing. to be called between frames. nullptr if the renderer doesn't
+    // keep it in system memory
+    virtual u32* GetFrame(int* stride) { return nullptr; }
 };
 
 extern int Renderer;
@@ -63,6 +63,7 @@ void SoftRenderer::SetupRenderThread()
         Platform::Semaphore_Reset(Sema_ScanlineCount);
 
         Platform::Semaphore_Post(Sema_RenderStart);
+        RenderThreadPending = true;
     }
     else
     {
@@ -86,6 +87,7 @@ bool SoftRenderer::Init()
     Threaded = false;
     RenderThreadRunning = false;
     RenderThreadRendering = false;
+    RenderThreadPending = false;
 
     return true;
 }
@@ -1647,7 +1649,10 @@ void SoftRenderer::RenderPolygons(bool threaded, Polygon** polygons, int npolys)
 void SoftRenderer::VCount144()
 {
     if (RenderThreadRunning.load(std::memory_order_relaxed) && !GPU3D::AbortFrame)
+    {
         Platform::Semaphore_Wait(Sema_RenderDone);
+        RenderThreadPending = false;
+    }
 }
 
 void SoftRenderer::RenderFrame()
@@ -1663,6 +1668,7 @@ void SoftRenderer::RenderFrame()
     if (RenderThreadRunning.load(std::memory_order_relaxed))
     {
         Platform::Semaphore_Post(Sema_RenderStart);
+        RenderThreadPending = true;
     }
     else if (!FrameIdentical)
     {
@@ -1710,4 +1716,19 @@ u32* SoftRenderer::GetLine(int line)
     return &ColorBuffer[(line * ScanlineWidth) + FirstPixelOffset];
 }
 
+u32* SoftRenderer::GetFrame(int* stride)
+{
+    // between frames, the render thread is working on the frame started at
+    // VCount 215. wait for it to finish, and post the semaphore back for
+    // VCount144(), which is where the GPU normally picks it up
+    if (RenderThreadRunning.load(std::memory_order_relaxed) && RenderThreadPending)
+    {
+        Platform::Semaphore_Wait(Sema_RenderDone);
+        Platform::Semaphore_Post(Sema_RenderDone);
+    }
+
+    *stride = ScanlineWidth;
+    return &ColorBuffer[FirstPixelOffset];
+}
+
 }
@@ -40,6 +40,7 @@ public:
     virtual void RenderFrame() override;
     virtual void RestartFrame() override;
     virtual u32* GetLine(int line) override;
+    virtual u32* GetFrame(int* stride) override;
 
     void SetupRenderThread();
     void StopRenderThread();
@@ -509,6 +510,7 @@ private:
     Platform::Thread* RenderThread;
     std::atomic_bool RenderThreadRunning;
     std::atomic_bool RenderThreadRendering;
+    bool RenderThreadPending; // a frame was started, and its completion wasn't waited for yet
     Platform::Semaphore* Sema_RenderStart;
     Platform::Semaphore* Sema_RenderDone;
     Platform::Semaphore* Sema_ScanlineCount;
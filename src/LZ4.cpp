@@ -0,0 +1,205 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include "LZ4.h"
+
+namespace LZ4
+{
+
+// the last match must start at least 12 bytes before the end of the block,
+// and the last 5 bytes are always literals
+const u32 MinMatch = 4;
+const u32 MatchStartLimit = 12;
+const u32 LastLiterals = 5;
+
+const int HashBits = 12;
+
+
+inline u32 Read32(const u8* ptr)
+{
+    u32 ret;
+    memcpy(&ret, ptr, 4);
+    return ret;
+}
+
+inline u32 Hash(u32 val)
+{
+    return (val * 2654435761U) >> (32 - HashBits);
+}
+
+u32 CompressBound(u32 len)
+{
+    return len + (len / 255) + 16;
+}
+
+// writes a length continuation (the part that didn't fit in the token nibble)
+inline bool PutLength(u8* dst, u32& pos, u32 dstlen, u32 len)
+{
+    while (len >= 255)
+    {
+        if (pos >= dstlen) return false;
+        dst[pos++] = 255;
+        len -= 255;
+    }
+    if (pos >= dstlen) return false;
+    dst[pos++] = len;
+    return true;
+}
+
+inline bool PutSequence(u8* dst, u32& pos, u32 dstlen, const u8* lit, u32 litlen, u32 offset, u32 matchlen)
+{
+    if (pos >= dstlen) return false;
+    u32 token = pos++;
+
+    u8 tok = (litlen >= 15 ? 15 : litlen) << 4;
+    if (litlen >= 15 && !PutLength(dst, pos, dstlen, litlen - 15)) return false;
+
+    if ((pos + litlen) > dstlen) return false;
+    memcpy(&dst[pos], lit, litlen);
+    pos += litlen;
+
+    if (matchlen > 0)
+    {
+        if ((pos + 2) > dstlen) return false;
+        dst[pos++] = offset & 0xFF;
+        dst[pos++] = offset >> 8;
+
+        matchlen -= MinMatch;
+        tok |= (matchlen >= 15 ? 15 : matchlen);
+        if (matchlen >= 15 && !PutLength(dst, pos, dstlen, matchlen - 15)) return false;
+    }
+
+    dst[token] = tok;
+    return true;
+}
+
+u32 Compress(const u8* src, u32 srclen, u8* dst, u32 dstlen)
+{
+    u32 table[1 << HashBits];
+    memset(table, 0xFF, sizeof(table));
+
+    u32 pos = 0;
+    u32 anchor = 0;
+    u32 i = 0;
+
+    if (srclen > MatchStartLimit)
+    {
+        u32 limit = srclen - MatchStartLimit;
+        u32 matchlimit = srclen - LastLiterals;
+
+        while (i < limit)
+        {
+            u32 seq = Read32(&src[i]);
+            u32 h = Hash(seq);
+            u32 ref = table[h];
+            table[h] = i;
+
+            if (ref == 0xFFFFFFFF || (i - ref) > 0xFFFF || Read32(&src[ref]) != seq)
+            {
+                // skip faster through data that doesn't compress
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+
+            u32 matchlen = MinMatch;
+            while ((i + matchlen) < matchlimit && src[ref + matchlen] == src[i + matchlen])
+                matchlen++;
+
+            if (!PutSequence(dst, pos, dstlen, &src[anchor], i - anchor, i - ref, matchlen))
+                return 0;
+
+            i += matchlen;
+            anchor = i;
+        }
+    }
+
+    if (!PutSequence(dst, pos, dstlen, &src[anchor], srclen - anchor, 0, 0))
+        return 0;
+
+    return pos;
+}
+
+bool Decompress(const u8* src, u32 srclen, u8* dst, u32 dstlen)
+{
+    u32 ip = 0;
+    u32 op = 0;
+
+    while (ip < srclen)
+    {
+        u8 token = src[ip++];
+
+        u32 litlen = token >> 4;
+        if (litlen == 15)
+        {
+            u8 b;
+            do
+            {
+                if (ip >= srclen) return false;
+                b = src[ip++];
+                litlen += b;
+            }
+            while (b == 255);
+        }
+
+        if ((ip + litlen) > srclen || (op + litlen) > dstlen) return false;
+        memcpy(&dst[op], &src[ip], litlen);
+        ip += litlen;
+        op += litlen;
+
+        // the last sequence has no match part
+        if (ip >= srclen) break;
+
+        if ((ip + 2) > srclen) return false;
+        u32 offset = src[ip] | (src[ip+1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        u32 matchlen = token & 0xF;
+        if (matchlen == 15)
+        {
+            u8 b;
+            do
+            {
+                if (ip >= srclen) return false;
+                b = src[ip++];
+                matchlen += b;
+            }
+            while (b == 255);
+        }
+        matchlen += MinMatch;
+
+        if ((op + matchlen) > dstlen) return false;
+
+        u8* out = &dst[op];
+        const u8* match = out - offset;
+        if (offset >= matchlen)
+            memcpy(out, match, matchlen);
+        else
+        {
+            // overlapping copy, the pattern repeats
+            for (u32 j = 0; j < matchlen; j++)
+                out[j] = match[j];
+        }
+        op += matchlen;
+    }
+
+    return op == dstlen;
+}
+
+}
@@ -0,0 +1,43 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "types.h"
+
+// LZ4 block format compression
+// this only implements the raw block format (no frame header/checksums),
+// which is all we need for savestates
+
+namespace LZ4
+{
+
+// worst-case compressed size for the given input length
+u32 CompressBound(u32 len);
+
+// returns the compressed length, or 0 if the output doesn't fit in dstlen
+u32 Compress(const u8* src, u32 srclen, u8* dst, u32 dstlen);
+
+// dstlen must be the exact decompressed length
+// returns false if the input is corrupted
+bool Decompress(const u8* src, u32 srclen, u8* dst, u32 dstlen);
+
+}
+
+#endif // LZ4_H
@@ -74,6 +74,11 @@ int ConsoleType;
 u8 ARM9MemTimings[0x40000][4];
 u8 ARM7MemTimings[0x20000][4];
 
+u8* ARM9ReadPages[PageTableSize];
+u8* ARM9WritePages[PageTableSize];
+u8* ARM7ReadPages[PageTableSize];
+u8* ARM7WritePages[PageTableSize];
+
 ARMv5* ARM9;
 ARMv4* ARM7;
 
@@ -89,6 +94,9 @@ const s32 kMaxIterationCycles = 64;
 
 u32 ARM9ClockShift;
 
+u32 IdleLoopCycles[2];
+IdleLoopStats IdleLoopStat;
+
 // no need to worry about those overflowing, they can keep going for atleast 4350 years
 u64 ARM9Timestamp, ARM9Target;
 u64 ARM7Timestamp, ARM7Target;
@@ -104,6 +112,8 @@ u8 ARM7BIOS[0x4000];
 
 u8* MainRAM;
 u32 MainRAMMask;
+u64 MainRAMDirty[MainRAMMaxSize / 0x1000 / 64];
+bool MainRAMWriteTracking = false;
 
 u8* SharedWRAM;
 u8 WRAMCnt;
@@ -166,7 +176,8 @@ bool RunningGame;
 
 void DivDone(u32 param);
 void SqrtDone(u32 param);
-void RunTimer(u32 tid, s32 cycles);
+void TimerEvent(u32 cpu);
+void ScheduleTimerEvent(u32 cpu);
 void SetWifiWaitCnt(u16 val);
 void SetGBASlotTimings();
 
@@ -458,6 +469,10 @@ void Reset()
     RunningGame = false;
     LastSysClockCycles = 0;
 
+    IdleLoopCycles[0] = 0;
+    IdleLoopCycles[1] = 0;
+    memset(&IdleLoopStat, 0, sizeof(IdleLoopStat));
+
     memset(ARM9BIOS, 0, 0x1000);
     memset(ARM7BIOS, 0, 0x4000);
 
@@ -527,6 +542,7 @@ void Reset()
     InitTimings();
 
     memset(MainRAM, 0, MainRAMMask + 1);
+    memset(MainRAMDirty, 0xFF, sizeof(MainRAMDirty));
     memset(SharedWRAM, 0, 0x8000);
     memset(ARM7WRAM, 0, 0x10000);
 
@@ -616,6 +632,8 @@ void Reset()
     SPU::SetDegrade10Bit(degradeAudio);
 
     AREngine::Reset();
+
+    UpdateAllPages();
 }
 
 void Stop()
@@ -652,10 +670,17 @@ bool DoSavestate_Scheduler(Savestate* file)
         DivDone,
         SqrtDone,
 
+        TimerEvent,
+
         NULL
     };
 
     int len = Event_MAX;
+
+    // timer events were added in 9.1
+    if (!file->Saving && !file->IsAtleastVersion(9, 1))
+        len = Event_Timer9;
+
     if (file->Saving)
     {
         for (int i = 0; i < len; i++)
@@ -729,6 +754,8 @@ bool DoSavestate(Savestate* file)
     // * add IE2/IF2 there
 
     file->VarArray(MainRAM, 0x400000);
+    if (!file->Saving)
+        memset(MainRAMDirty, 0xFF, sizeof(MainRAMDirty));
     file->VarArray(SharedWRAM, 0x8000);
     file->VarArray(ARM7WRAM, ARM7WRAMSize);
 
@@ -811,6 +838,10 @@ bool DoSavestate(Savestate* file)
         u16 tmp = WifiWaitCnt;
         WifiWaitCnt = 0xFFFF;
         SetWifiWaitCnt(tmp); // force timing table update
+
+        // older states don't have the timer events
+        ScheduleTimerEvent(0);
+        ScheduleTimerEvent(1);
     }
 
     for (int i = 0; i < 8; i++)
@@ -830,6 +861,7 @@ bool DoSavestate(Savestate* file)
     if (!file->Saving)
     {
         GPU::SetPowerCnt(PowerControl9);
+        UpdateAllPages();
     }
 
 #ifdef JIT_ENABLED
@@ -1000,7 +1032,6 @@ u32 RunFrame()
                     ARM9->Execute();
             }
 
-            RunTimers(0);
             GPU3D::Run();
 
             target = ARM9Timestamp >> ARM9ClockShift;
@@ -1027,8 +1058,6 @@ u32 RunFrame()
 #endif
                         ARM7->Execute();
                 }
-
-                RunTimers(1);
             }
 
             RunSystem(target);
@@ -1052,6 +1081,12 @@ u32 RunFrame()
         SPU::TransferOutput();
 
         NDSCart::FlushSRAMFile();
+
+        IdleLoopStat.SkippedCycles[0] = IdleLoopCycles[0];
+        IdleLoopStat.SkippedCycles[1] = IdleLoopCycles[1];
+        IdleLoopStat.FrameCycles = SysTimestamp - FrameStartTimestamp;
+        IdleLoopCycles[0] = 0;
+        IdleLoopCycles[1] = 0;
     }
 
     // In the context of TASes, frame count is traditionally the primary measure of emulated time,
@@ -1080,6 +1115,11 @@ u32 RunFrame()
             : RunFrame<false, 0>();
 }
 
+void GetIdleLoopStats(IdleLoopStats* stats)
+{
+    *stats = IdleLoopStat;
+}
+
 void Reschedule(u64 target)
 {
     if (CurCPU == 0)
@@ -1244,6 +1284,92 @@ void MapSharedWRAM(u8 val)
         SWRAM_ARM7.Mask = 0x7FFF;
         break;
     }
+
+    UpdateWRAMPages();
+}
+
+
+static bool PageWritesAllowed()
+{
+#ifdef JIT_ENABLED
+    // writes need to go through the bus handlers so the JIT can invalidate blocks
+    if (Config::JIT_Enable) return false;
+#endif
+    return true;
+}
+
+static void SetPages(u8** pages, u32 start, u32 end, u8* mem, u32 mask)
+{
+    for (u32 addr = start; addr < end; addr += 0x1000)
+        pages[addr >> 12] = mem ? &mem[addr & mask & ~0xFFF] : nullptr;
+}
+
+void UpdateMainRAMPages()
+{
+    u8* wmem = (PageWritesAllowed() && !MainRAMWriteTracking) ? MainRAM : nullptr;
+
+    SetPages(ARM9ReadPages, 0x02000000, 0x03000000, MainRAM, MainRAMMask);
+    SetPages(ARM9WritePages, 0x02000000, 0x03000000, wmem, MainRAMMask);
+    SetPages(ARM7ReadPages, 0x02000000, 0x03000000, MainRAM, MainRAMMask);
+    SetPages(ARM7WritePages, 0x02000000, 0x03000000, wmem, MainRAMMask);
+
+    // region lock bypass hack in DSi::ARM9Read32()
+    if (ConsoleType == 1)
+        ARM9ReadPages[0x02FE71B0 >> 12] = nullptr;
+}
+
+void SetMainRAMWriteTracking(bool enable)
+{
+    MainRAMWriteTracking = enable;
+    UpdateMainRAMPages();
+}
+
+void UpdateWRAMPages()
+{
+    bool writable = PageWritesAllowed();
+
+    SetPages(ARM9ReadPages, 0x03000000, 0x04000000, SWRAM_ARM9.Mem, SWRAM_ARM9.Mask);
+    SetPages(ARM9WritePages, 0x03000000, 0x04000000, writable ? SWRAM_ARM9.Mem : nullptr, SWRAM_ARM9.Mask);
+
+    MemRegion region = SWRAM_ARM7;
+    if (!region.Mem)
+    {
+        region.Mem = ARM7WRAM;
+        region.Mask = ARM7WRAMSize - 1;
+    }
+    SetPages(ARM7ReadPages, 0x03000000, 0x03800000, region.Mem, region.Mask);
+    SetPages(ARM7WritePages, 0x03000000, 0x03800000, writable ? region.Mem : nullptr, region.Mask);
+    SetPages(ARM7ReadPages, 0x03800000, 0x04000000, ARM7WRAM, ARM7WRAMSize - 1);
+    SetPages(ARM7WritePages, 0x03800000, 0x04000000, writable ? ARM7WRAM : nullptr, ARM7WRAMSize - 1);
+
+    // new WRAM takes precedence
+    if (ConsoleType == 1)
+        DSi::UpdateNWRAMPages();
+}
+
+void UpdateVRAMPages()
+{
+    // VRAM writes always go through the bus handlers, for the dirty tracking
+    // VRAM pages are only readable when a single bank is mapped there
+    for (u32 addr = 0x06000000; addr < 0x07000000; addr += 0x1000)
+    {
+        ARM9ReadPages[addr >> 12] = GPU::GetARM9VRAMPage(addr);
+        ARM7ReadPages[addr >> 12] = GPU::GetARM7VRAMPage(addr);
+    }
+}
+
+void UpdateAllPages()
+{
+    // palette/OAM are smaller than a page, and anything not listed here
+    // isn't plain memory. all of those always go through the bus handlers
+    memset(ARM9ReadPages, 0, sizeof(ARM9ReadPages));
+    memset(ARM9WritePages, 0, sizeof(ARM9WritePages));
+    memset(ARM7ReadPages, 0, sizeof(ARM7ReadPages));
+    memset(ARM7WritePages, 0, sizeof(ARM7WritePages));
+
+    UpdateMainRAMPages();
+    UpdateWRAMPages();
+    UpdateVRAMPages();
 }
 
 
@@ -1531,70 +1657,106 @@ void MonitorARM9Jump(u32 addr)
 
 
 
-void HandleTimerOverflow(u32 tid)
+// 'ticks' are in 1/1024 counter units, see Timer::CycleShift
+void AdvanceTimer(u32 tid, u64 ticks)
 {
     Timer* timer = &Timers[tid];
 
-    timer->Counter += (timer->Reload << 10);
+    u64 counter = timer->Counter + ticks;
+    if (!(counter >> 26))
+    {
+        timer->Counter = counter;
+        return;
+    }
+
+    // process all the overflows at once
+    u64 reload = timer->Reload << 10;
+    u64 period = (1 << 26) - reload;
+    u64 numoverflows = 1 + ((counter - (1 << 26)) / period);
+
+    timer->Counter = reload + ((counter - (1 << 26)) % period);
     if (timer->Cnt & (1<<6))
         SetIRQ(tid >> 2, IRQ_Timer0 + (tid & 0x3));
 
     if ((tid & 0x3) == 3)
         return;
 
-    for (;;)
-    {
-        tid++;
-
-        timer = &Timers[tid];
+    if ((Timers[tid+1].Cnt & 0x84) == 0x84)
+        AdvanceTimer(tid+1, numoverflows << 10);
+}
 
-        if ((timer->Cnt & 0x84) != 0x84)
-            break;
+void RunTimers(u32 cpu)
+{
+    u32 timermask = TimerCheckMask[cpu];
+    s64 cycles;
 
-        timer->Counter += (1 << 10);
-        if (!(timer->Counter >> 26))
-            break;
+    if (cpu == 0)
+        cycles = (ARM9Timestamp >> ARM9ClockShift) - TimerTimestamp[0];
+    else
+        cycles = ARM7Timestamp - TimerTimestamp[1];
 
-        timer->Counter = timer->Reload << 10;
-        if (timer->Cnt & (1<<6))
-            SetIRQ(tid >> 2, IRQ_Timer0 + (tid & 0x3));
+    if (cycles <= 0) return;
 
-        if ((tid & 0x3) == 3)
-            break;
+    for (u32 i = 0; i < 4; i++)
+    {
+        if (timermask & (1<<i))
+        {
+            u32 tid = (cpu<<2) + i;
+            AdvanceTimer(tid, (u64)cycles << Timers[tid].CycleShift);
+        }
     }
+
+    TimerTimestamp[cpu] += cycles;
 }
 
-void RunTimer(u32 tid, s32 cycles)
+// the timers are only brought up to date when they're accessed, or when
+// an overflow needs to be caught as it happens: when it raises an IRQ,
+// directly or through count-up timers
+void ScheduleTimerEvent(u32 cpu)
 {
-    Timer* timer = &Timers[tid];
+    CancelEvent(Event_Timer9 + cpu);
 
-    u32 oldcount = timer->Counter;
-    timer->Counter += (cycles << timer->CycleShift);
-    //if (timer->Counter < oldcount)
-    //    HandleTimerOverflow(tid);
-    while (timer->Counter >> 26)
+    u32 delay = 0xFFFFFFFF;
+    for (u32 i = 0; i < 4; i++)
     {
-        timer->Counter -= (1 << 26);
-        HandleTimerOverflow(tid);
+        Timer* timer = &Timers[(cpu<<2)+i];
+        if (!(TimerCheckMask[cpu] & (1<<i)))
+            continue;
+
+        bool irq = false;
+        for (u32 j = i; j < 4; j++)
+        {
+            u16 cnt = Timers[(cpu<<2)+j].Cnt;
+            if (j > i && (cnt & 0x84) != 0x84)
+                break;
+
+            if (cnt & (1<<6))
+            {
+                irq = true;
+                break;
+            }
+        }
+        if (!irq) continue;
+
+        u32 cycles = ((1<<26) - timer->Counter + (1<<timer->CycleShift) - 1) >> timer->CycleShift;
+        if (cycles < delay) delay = cycles;
     }
-}
 
-void RunTimers(u32 cpu)
-{
-    u32 timermask = TimerCheckMask[cpu];
-    s32 cycles;
+    if (delay == 0xFFFFFFFF)
+        return;
 
-    if (cpu == 0)
-        cycles = (ARM9Timestamp >> ARM9ClockShift) - TimerTimestamp[0];
-    else
-        cycles = ARM7Timestamp - TimerTimestamp[1];
+    // the counters are current as of TimerTimestamp, while ScheduleEvent()
+    // counts from the current CPU's timestamp
+    u64 curtime = (CurCPU == 0) ? (ARM9Timestamp >> ARM9ClockShift) : ARM7Timestamp;
+    s64 eventtime = TimerTimestamp[cpu] + delay;
 
-    if (timermask & 0x1) RunTimer((cpu<<2)+0, cycles);
-    if (timermask & 0x2) RunTimer((cpu<<2)+1, cycles);
-    if (timermask & 0x4) RunTimer((cpu<<2)+2, cycles);
-    if (timermask & 0x8) RunTimer((cpu<<2)+3, cycles);
+    ScheduleEvent(Event_Timer9 + cpu, false, (s32)(eventtime - (s64)curtime), TimerEvent, cpu);
+}
 
-    TimerTimestamp[cpu] += cycles;
+void TimerEvent(u32 cpu)
+{
+    RunTimers(cpu);
+    ScheduleTimerEvent(cpu);
 }
 
 
@@ -1696,8 +1858,17 @@ u16 TimerGetCounter(u32 timer)
     return ret >> 10;
 }
 
+void TimerSetReload(u32 id, u16 val)
+{
+    // overflows that already happened still use the old reload value
+    RunTimers(id>>2);
+    Timers[id].Reload = val;
+}
+
 void TimerStart(u32 id, u16 cnt)
 {
+    RunTimers(id>>2);
+
     Timer* timer = &Timers[id];
     u16 curstart = timer->Cnt & (1<<7);
     u16 newstart = cnt & (1<<7);
@@ -1708,14 +1879,6 @@ void TimerStart(u32 id, u16 cnt)
     if ((!curstart) && newstart)
     {
         timer->Counter = timer->Reload << 10;
-
-        /*if ((cnt & 0x84) == 0x80)
-        {
-            u32 delay = (0x10000 - timer->Reload) << TimerPrescaler[cnt & 0x03];
-            printf("timer%d IRQ: start   %d, reload=%04X cnt=%08X\n", id, delay, timer->Reload, timer->Counter);
-            CancelEvent(Event_TimerIRQ_0 + id);
-            ScheduleEvent(Event_TimerIRQ_0 + id, false, delay, HandleTimerOverflow, id);
-        }*/
     }
 
     if ((cnt & 0x84) == 0x80)
@@ -1730,6 +1893,8 @@ void TimerStart(u32 id, u16 cnt)
     }
     else
         TimerCheckMask[id>>2] &= ~(0x11 << (id&0x3));
+
+    ScheduleTimerEvent(id>>2);
 }
 
 
@@ -2100,6 +2265,7 @@ void ARM9Write8(u32 addr, u8 val)
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
+        if (MainRAMWriteTracking) MarkMainRAMDirty(addr);
         return;
 
     case 0x03000000:
@@ -2143,6 +2309,7 @@ void ARM9Write16(u32 addr, u16 val)
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
+        if (MainRAMWriteTracking) MarkMainRAMDirty(addr);
         return;
 
     case 0x03000000:
@@ -2207,6 +2374,7 @@ void ARM9Write32(u32 addr, u32 val)
         ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
+        if (MainRAMWriteTracking) MarkMainRAMDirty(addr);
         return ;
 
     case 0x03000000:
@@ -2501,6 +2669,7 @@ void ARM7Write8(u32 addr, u8 val)
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
         *(u8*)&MainRAM[addr & MainRAMMask] = val;
+        if (MainRAMWriteTracking) MarkMainRAMDirty(addr);
         return;
 
     case 0x03000000:
@@ -2567,6 +2736,7 @@ void ARM7Write16(u32 addr, u16 val)
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
         *(u16*)&MainRAM[addr & MainRAMMask] = val;
+        if (MainRAMWriteTracking) MarkMainRAMDirty(addr);
         return;
 
     case 0x03000000:
@@ -2643,6 +2813,7 @@ void ARM7Write32(u32 addr, u32 val)
         ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(addr);
 #endif
         *(u32*)&MainRAM[addr & MainRAMMask] = val;
+        if (MainRAMWriteTracking) MarkMainRAMDirty(addr);
         return;
 
     case 0x03000000:
@@ -3276,13 +3447,13 @@ void ARM9IOWrite16(u32 addr, u16 val)
     case 0x040000EC: DMA9Fill[3] = (DMA9Fill[3] & 0xFFFF0000) | val; return;
     case 0x040000EE: DMA9Fill[3] = (DMA9Fill[3] & 0x0000FFFF) | (val << 16); return;
 
-    case 0x04000100: Timers[0].Reload = val; return;
+    case 0x04000100: TimerSetReload(0, val); return;
     case 0x04000102: TimerStart(0, val); return;
-    case 0x04000104: Timers[1].Reload = val; return;
+    case 0x04000104: TimerSetReload(1, val); return;
     case 0x04000106: TimerStart(1, val); return;
-    case 0x04000108: Timers[2].Reload = val; return;
+    case 0x04000108: TimerSetReload(2, val); return;
     case 0x0400010A: TimerStart(2, val); return;
-    case 0x0400010C: Timers[3].Reload = val; return;
+    case 0x0400010C: TimerSetReload(3, val); return;
     case 0x0400010E: TimerStart(3, val); return;
 
     case 0x04000132:
@@ -3462,19 +3633,19 @@ void ARM9IOWrite32(u32 addr, u32 val)
     case 0x040000EC: DMA9Fill[3] = val; return;
 
     case 0x04000100:
-        Timers[0].Reload = val & 0xFFFF;
+        TimerSetReload(0, val & 0xFFFF);
         TimerStart(0, val>>16);
         return;
     case 0x04000104:
-        Timers[1].Reload = val & 0xFFFF;
+        TimerSetReload(1, val & 0xFFFF);
         TimerStart(1, val>>16);
         return;
     case 0x04000108:
-        Timers[2].Reload = val & 0xFFFF;
+        TimerSetReload(2, val & 0xFFFF);
         TimerStart(2, val>>16);
         return;
     case 0x0400010C:
-        Timers[3].Reload = val & 0xFFFF;
+        TimerSetReload(3, val & 0xFFFF);
         TimerStart(3, val>>16);
         return;
 
@@ -3981,13 +4152,13 @@ void ARM7IOWrite16(u32 addr, u16 val)
     case 0x040000DC: DMAs[7]->WriteCnt((DMAs[7]->Cnt & 0xFFFF0000) | val); return;
     case 0x040000DE: DMAs[7]->WriteCnt((DMAs[7]->Cnt & 0x0000FFFF) | (val << 16)); return;
 
-    case 0x04000100: Timers[4].Reload = val; return;
+    case 0x04000100: TimerSetReload(4, val); return;
     case 0x04000102: TimerStart(4, val); return;
-    case 0x04000104: Timers[5].Reload = val; return;
+    case 0x04000104: TimerSetReload(5, val); return;
     case 0x04000106: TimerStart(5, val); return;
-    case 0x04000108: Timers[6].Reload = val; return;
+    case 0x04000108: TimerSetReload(6, val); return;
     case 0x0400010A: TimerStart(6, val); return;
-    case 0x0400010C: Timers[7].Reload = val; return;
+    case 0x0400010C: TimerSetReload(7, val); return;
     case 0x0400010E: TimerStart(7, val); return;
 
     case 0x04000132: KeyCnt = val; return;
@@ -4134,19 +4305,19 @@ void ARM7IOWrite32(u32 addr, u32 val)
     case 0x040000DC: DMAs[7]->WriteCnt(val); return;
 
     case 0x04000100:
-        Timers[4].Reload = val & 0xFFFF;
+        TimerSetReload(4, val & 0xFFFF);
         TimerStart(4, val>>16);
         return;
     case 0x04000104:
-        Timers[5].Reload = val & 0xFFFF;
+        TimerSetReload(5, val & 0xFFFF);
         TimerStart(5, val>>16);
         return;
     case 0x04000108:
-        Timers[6].Reload = val & 0xFFFF;
+        TimerSetReload(6, val & 0xFFFF);
         TimerStart(6, val>>16);
         return;
     case 0x0400010C:
-        Timers[7].Reload = val & 0xFFFF;
+        TimerSetReload(7, val & 0xFFFF);
         TimerStart(7, val>>16);
         return;
 
@@ -52,6 +52,9 @@ enum
     Event_DSi_RAMSizeChange,
     Event_DSi_DSP,
 
+    Event_Timer9,
+    Event_Timer7,
+
     Event_MAX
 };
 
@@ -141,14 +144,43 @@ extern int CurCPU;
 extern u8 ARM9MemTimings[0x40000][4];
 extern u8 ARM7MemTimings[0x20000][4];
 
+// host pointers to plain memory (main RAM, WRAM, VRAM), per 4KB page
+// over 00000000-0FFFFFFF, used by the interpreter to bypass the bus handlers
+// a null entry means the access has to go through the bus handlers
+const u32 PageTableSize = 0x10000;
+extern u8* ARM9ReadPages[PageTableSize];
+extern u8* ARM9WritePages[PageTableSize];
+extern u8* ARM7ReadPages[PageTableSize];
+extern u8* ARM7WritePages[PageTableSize];
+
+inline u8* PageLookup(u8** pages, u32 addr)
+{
+    if (addr >= (PageTableSize << 12)) return nullptr;
+    u8* page = pages[addr >> 12];
+    return page ? &page[addr & 0xFFF] : nullptr;
+}
+
 extern u32 NumFrames;
 extern u32 NumLagFrames;
 extern bool LagFrameFlag;
 
 extern u64 ARM9Timestamp, ARM9Target;
 extern u64 ARM7Timestamp, ARM7Target;
+extern u64 SysTimestamp;
+extern SchedEvent SchedList[Event_MAX];
+extern u32 SchedListMask;
 extern u32 ARM9ClockShift;
 
+// system cycles skipped by each CPU over idle loops, during the current frame
+extern u32 IdleLoopCycles[2];
+
+struct IdleLoopStats
+{
+    // for the last frame, in system cycles
+    u32 SkippedCycles[2];
+    u32 FrameCycles;
+};
+
 extern u32 IME[2];
 extern u32 IE[2];
 extern u32 IF[2];
@@ -173,6 +205,18 @@ extern u32 MainRAMMask;
 
 const u32 MainRAMMaxSize = 0x1000000;
 
+// one bit per 4KB page of main RAM, set whenever the page is written to
+// (used for state hashing, see StateHash.h)
+extern u64 MainRAMDirty[MainRAMMaxSize / 0x1000 / 64];
+// only kept up to date while this is set, see SetMainRAMWriteTracking()
+extern bool MainRAMWriteTracking;
+
+inline void MarkMainRAMDirty(u32 addr)
+{
+    u32 page = (addr & MainRAMMask) >> 12;
+    MainRAMDirty[page >> 6] |= (1ULL << (page & 63));
+}
+
 const u32 SharedWRAMSize = 0x8000;
 extern u8* SharedWRAM;
 
@@ -191,6 +235,13 @@ void Stop();
 
 bool DoSavestate(Savestate* file);
 
+// the interpreter writes to main RAM through page tables, which don't mark
+// MainRAMDirty. this makes all writes go through the bus handlers instead
+// this can't cover the JIT with fastmem enabled, whose writes go straight to
+// memory: MainRAMDirty is meaningless then, and main RAM has to be treated
+// as entirely dirty
+void SetMainRAMWriteTracking(bool enable);
+
 void SetARM9RegionTimings(u32 addrstart, u32 addrend, int buswidth, int nonseq, int seq);
 void SetARM7RegionTimings(u32 addrstart, u32 addrend, int buswidth, int nonseq, int seq);
 
@@ -207,6 +258,8 @@ void RelocateSave(const char* path, bool write);
 
 u32 RunFrame();
 
+void GetIdleLoopStats(IdleLoopStats* stats);
+
 void TouchScreen(u16 x, u16 y);
 void ReleaseScreen();
 
@@ -228,6 +281,11 @@ void Halt();
 
 void MapSharedWRAM(u8 val);
 
+void UpdateMainRAMPages();
+void UpdateWRAMPages();
+void UpdateVRAMPages();
+void UpdateAllPages();
+
 void UpdateIRQ(u32 cpu);
 void SetIRQ(u32 cpu, u32 irq);
 void ClearIRQ(u32 cpu, u32 irq);
@@ -18,6 +18,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#if !defined(_WIN32) && !defined(__SWITCH__)
+#define NDSCART_MMAP_ROM
+#include <sys/mman.h>
+#endif
 #include "NDS.h"
 #include "DSi.h"
 #include "NDSCart.h"
@@ -54,6 +58,7 @@ u8 TransferCmd[8];
 bool CartInserted;
 u8* CartROM;
 u32 CartROMSize;
+bool CartROMMapped;
 u32 CartID;
 bool CartIsHomebrew;
 bool CartIsDSi;
@@ -436,6 +441,7 @@ void CartRetail::DoSavestate(Savestate* file)
     if (!file->Saving)
     {
         SRAMFileDirty = false;
+        NDSCart_SRAMManager::MarkDirty(0, SRAMLength);
         NDSCart_SRAMManager::RequestFlush();
     }
 }
@@ -503,6 +509,9 @@ void CartRetail::RelocateSave(const char* path, bool write)
     strncpy(SRAMPath, path, 1023);
     SRAMPath[1023] = '\0';
 
+    // the flush thread must write to the new file from now on
+    NDSCart_SRAMManager::Setup(SRAMPath, SRAM, SRAMLength);
+
     FILE* f = Platform::OpenFile(path, "wb");
     if (!f)
     {
@@ -517,6 +526,12 @@ void CartRetail::RelocateSave(const char* path, bool write)
 int CartRetail::ImportSRAM(const u8* data, u32 length)
 {
     memcpy(SRAM, data, std::min(length, SRAMLength));
+
+    // the secondary buffer still holds the old save, and would otherwise
+    // be written back over the imported one
+    NDSCart_SRAMManager::MarkDirty(0, SRAMLength);
+    NDSCart_SRAMManager::RequestFlush();
+
     FILE* f = Platform::OpenFile(SRAMPath, "wb");
     if (f)
     {
@@ -639,7 +654,9 @@ u8 CartRetail::SRAMWrite_EEPROMTiny(u8 val, u32 pos, bool last)
             // TODO: implement WP bits!
             if (SRAMStatus & (1<<1))
             {
-                SRAM[(SRAMAddr + ((SRAMCmd==0x0A)?0x100:0)) & 0x1FF] = val;
+                u32 addr = (SRAMAddr + ((SRAMCmd==0x0A)?0x100:0)) & 0x1FF;
+                SRAM[addr] = val;
+                NDSCart_SRAMManager::MarkDirty(addr, 1);
                 SRAMFileDirty |= last;
             }
             SRAMAddr++;
@@ -699,6 +716,7 @@ u8 CartRetail::SRAMWrite_EEPROM(u8 val, u32 pos, bool last)
             if (SRAMStatus & (1<<1))
             {
                 SRAM[SRAMAddr & (SRAMLength-1)] = val;
+                NDSCart_SRAMManager::MarkDirty(SRAMAddr & (SRAMLength-1), 1);
                 SRAMFileDirty |= last;
             }
             SRAMAddr++;
@@ -751,6 +769,7 @@ u8 CartRetail::SRAMWrite_FLASH(u8 val, u32 pos, bool last)
             {
                 // CHECKME: should it be &=~val ??
                 SRAM[SRAMAddr & (SRAMLength-1)] = 0;
+                NDSCart_SRAMManager::MarkDirty(SRAMAddr & (SRAMLength-1), 1);
                 SRAMFileDirty |= last;
             }
             SRAMAddr++;
@@ -783,6 +802,7 @@ u8 CartRetail::SRAMWrite_FLASH(u8 val, u32 pos, bool last)
             if (SRAMStatus & (1<<1))
             {
                 SRAM[SRAMAddr & (SRAMLength-1)] = val;
+                NDSCart_SRAMManager::MarkDirty(SRAMAddr & (SRAMLength-1), 1);
                 SRAMFileDirty |= last;
             }
             SRAMAddr++;
@@ -824,6 +844,7 @@ u8 CartRetail::SRAMWrite_FLASH(u8 val, u32 pos, bool last)
             for (u32 i = 0; i < 0x10000; i++)
             {
                 SRAM[SRAMAddr & (SRAMLength-1)] = 0;
+                NDSCart_SRAMManager::MarkDirty(SRAMAddr & (SRAMLength-1), 1);
                 SRAMAddr++;
             }
             SRAMFileDirty = true;
@@ -842,6 +863,7 @@ u8 CartRetail::SRAMWrite_FLASH(u8 val, u32 pos, bool last)
             for (u32 i = 0; i < 0x100; i++)
             {
                 SRAM[SRAMAddr & (SRAMLength-1)] = 0;
+                NDSCart_SRAMManager::MarkDirty(SRAMAddr & (SRAMLength-1), 1);
                 SRAMAddr++;
             }
             SRAMFileDirty = true;
@@ -935,6 +957,7 @@ int CartRetailNAND::ROMCommandStart(u8* cmd, u8* data, u32 len)
             if (SRAMLength && SRAMAddr < (SRAMBase+SRAMLength-0x20000))
             {
                 memcpy(&SRAM[SRAMAddr - SRAMBase], SRAMWriteBuffer, 0x800);
+                NDSCart_SRAMManager::MarkDirty(SRAMAddr - SRAMBase, 0x800);
                 SRAMFileDirty = true;
             }
 
@@ -1404,9 +1427,58 @@ void CartHomebrew::ReadROM_B7(u32 addr, u32 len, u8* data, u32 offset)
 
 
 
+void FreeROM()
+{
+    if (!CartROM) return;
+
+#ifdef NDSCART_MMAP_ROM
+    if (CartROMMapped)
+        munmap(CartROM, CartROMSize);
+    else
+#endif
+        delete[] CartROM;
+
+    CartROM = nullptr;
+    CartROMMapped = false;
+}
+
+// map the ROM file rather than reading it all
+// the mapping is private, so the few places that patch the ROM in memory
+// (secure area reencryption, DLDI) get their own copy of the affected pages
+// without touching the file. the padding up to CartROMSize is anonymous memory,
+// so it is only ever backed by the zero page.
+// this is opt-in (Config::MapROMFiles): the file must not change while it's
+// mapped. pages that weren't read yet would pick up the new contents, and if
+// the file gets shorter, reading past its new end raises SIGBUS.
+bool MapROM(FILE* f, u32 len)
+{
+#ifdef NDSCART_MMAP_ROM
+    if (!Config::MapROMFiles)
+        return false;
+
+    void* base = mmap(nullptr, CartROMSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return false;
+
+    void* map = mmap(base, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fileno(f), 0);
+    if (map == MAP_FAILED)
+    {
+        munmap(base, CartROMSize);
+        return false;
+    }
+
+    CartROM = (u8*)base;
+    CartROMMapped = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool Init()
 {
     CartROM = nullptr;
+    CartROMMapped = false;
     Cart = nullptr;
 
     return true;
@@ -1414,15 +1486,14 @@ bool Init()
 
 void DeInit()
 {
-    if (CartROM) delete[] CartROM;
+    FreeROM();
     if (Cart) delete Cart;
 }
 
 void Reset()
 {
     CartInserted = false;
-    if (CartROM) delete[] CartROM;
-    CartROM = nullptr;
+    FreeROM();
     CartROMSize = 0;
     CartID = 0;
     CartIsHomebrew = false;
@@ -1670,9 +1741,7 @@ bool LoadROMCommon(u32 filelength, const char *sram, bool direct)
 
 bool LoadROM(const char* path, const char* sram, bool direct)
 {
-    // TODO: streaming mode? for really big ROMs or systems with limited RAM
-    // for now we're lazy
-    // also TODO: validate what we're loading!!
+    // TODO: validate what we're loading!!
 
     FILE* f = Platform::OpenFile(path, "rb");
     if (!f)
@@ -1689,10 +1758,13 @@ bool LoadROM(const char* path, const char* sram, bool direct)
     while (CartROMSize < len)
         CartROMSize <<= 1;
 
-    CartROM = new u8[CartROMSize];
-    memset(CartROM, 0, CartROMSize);
-    fseek(f, 0, SEEK_SET);
-    fread(CartROM, 1, len, f);
+    if (len == 0 || !MapROM(f, len))
+    {
+        CartROM = new u8[CartROMSize];
+        memset(CartROM, 0, CartROMSize);
+        fseek(f, 0, SEEK_SET);
+        fread(CartROM, 1, len, f);
+    }
 
     fclose(f);
 
@@ -21,9 +21,30 @@
 #include <unistd.h>
 #include <time.h>
 #include <atomic>
+#include <chrono>
+#include <map>
+#ifdef _WIN32
+#include <io.h>
+#endif
 #include "NDSCart_SRAMManager.h"
 #include "Platform.h"
 
+/*
+    Save flushing
+
+    The save memory writes mark the ranges they modify. When a flush is
+    requested, only those ranges are copied to the secondary buffer, and
+    the flush thread only writes those ranges back to the file.
+
+    When a large part of the save was modified (or the file doesn't match
+    the save size), the whole file is rewritten instead. This is done by
+    writing a temporary file and renaming it over the save file, so that
+    the save file is never left half-written.
+
+    If a flush fails, the modified ranges are kept and the flush is retried
+    later, rewriting the whole file.
+*/
+
 namespace NDSCart_SRAMManager
 {
 
@@ -46,6 +67,22 @@ time_t TimeAtLastFlushRequest;
 u32 PreviousFlushVersion;
 u32 FlushVersion;
 
+// modified ranges of the save buffer, start -> end (exclusive)
+typedef std::map<u32, u32> RangeList;
+
+// ranges modified since the last flush request
+// the last one is kept apart, as writes tend to be sequential
+RangeList PendingRanges;
+u32 PendingStart, PendingEnd;
+
+// ranges copied to the secondary buffer but not yet written to the file
+RangeList FlushRanges;
+
+// set when a flush failed, as the file contents are then unknown
+bool ForceFullWrite;
+
+FlushStats Stats;
+
 void FlushThreadFunc();
 
 bool Init()
@@ -88,6 +125,14 @@ void Setup(const char* path, u8* buffer, u32 length)
 
     SecondaryBuffer = new u8[length];
     SecondaryBufferLength = length;
+    if (length) memcpy(SecondaryBuffer, buffer, length);
+
+    PendingRanges.clear();
+    PendingStart = 0;
+    PendingEnd = 0;
+    FlushRanges.clear();
+    ForceFullWrite = false;
+    memset(&Stats, 0, sizeof(Stats));
 
     FlushVersion = 0;
     PreviousFlushVersion = 0;
@@ -108,11 +153,68 @@ void Setup(const char* path, u8* buffer, u32 length)
     }
 }
 
+void AddRange(RangeList& list, u32 start, u32 end)
+{
+    auto it = list.upper_bound(start);
+    if (it != list.begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->second >= start)
+        {
+            if (prev->second >= end) return;
+            start = prev->first;
+            it = prev;
+        }
+    }
+
+    while (it != list.end() && it->first <= end)
+    {
+        if (it->second > end) end = it->second;
+        it = list.erase(it);
+    }
+
+    list[start] = end;
+}
+
+void MarkDirty(u32 addr, u32 len)
+{
+    if (!len) return;
+    u32 end = addr + len;
+
+    if (PendingEnd > PendingStart && addr <= PendingEnd && end >= PendingStart)
+    {
+        if (addr < PendingStart) PendingStart = addr;
+        if (end > PendingEnd) PendingEnd = end;
+        return;
+    }
+
+    if (PendingEnd > PendingStart)
+        AddRange(PendingRanges, PendingStart, PendingEnd);
+
+    PendingStart = addr;
+    PendingEnd = end;
+}
+
 void RequestFlush()
 {
+    if (PendingEnd > PendingStart)
+        AddRange(PendingRanges, PendingStart, PendingEnd);
+    PendingStart = 0;
+    PendingEnd = 0;
+
+    if (PendingRanges.empty()) return;
+
     Platform::Mutex_Lock(SecondaryBufferLock);
     printf("NDS SRAM: Flush requested\n");
-    memcpy(SecondaryBuffer, Buffer, Length);
+    for (auto& range : PendingRanges)
+    {
+        u32 end = range.second < Length ? range.second : Length;
+        if (range.first >= end) continue;
+
+        memcpy(&SecondaryBuffer[range.first], &Buffer[range.first], end - range.first);
+        AddRange(FlushRanges, range.first, end);
+    }
+    PendingRanges.clear();
     FlushVersion++;
     TimeAtLastFlushRequest = time(NULL);
     Platform::Mutex_Unlock(SecondaryBufferLock);
@@ -136,6 +238,107 @@ void FlushThreadFunc()
     }
 }
 
+bool SyncFile(FILE* f)
+{
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    _commit(_fileno(f));
+#else
+    fsync(fileno(f));
+#endif
+    return true;
+}
+
+// SecondaryBufferLock must be held
+bool WriteWholeFile()
+{
+    char tmppath[1024+8];
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", Path);
+
+    FILE* f = Platform::OpenFile(tmppath, "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(SecondaryBuffer, SecondaryBufferLength, 1, f) == 1 || SecondaryBufferLength == 0;
+    ok = SyncFile(f) && ok;
+    fclose(f);
+
+    if (!ok)
+    {
+        printf("NDS SRAM: failed to write %s\n", tmppath);
+        remove(tmppath);
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename() doesn't replace existing files there
+    remove(Path);
+#endif
+    if (rename(tmppath, Path) != 0)
+    {
+        printf("NDS SRAM: failed to replace %s\n", Path);
+        return false;
+    }
+
+    return true;
+}
+
+// SecondaryBufferLock must be held
+bool WriteRanges(u32* written, bool* full)
+{
+    u32 len = 0;
+    for (auto& range : FlushRanges)
+        len += range.second - range.first;
+
+    // past a point, it's cheaper to just rewrite everything
+    FILE* f = nullptr;
+    if (len < (SecondaryBufferLength >> 1) && !ForceFullWrite)
+    {
+        f = Platform::OpenFile(Path, "r+b", true);
+        if (f)
+        {
+            fseek(f, 0, SEEK_END);
+            if ((u32)ftell(f) != SecondaryBufferLength)
+            {
+                fclose(f);
+                f = nullptr;
+            }
+        }
+    }
+
+    if (!f)
+    {
+        *written = SecondaryBufferLength;
+        *full = true;
+        return WriteWholeFile();
+    }
+
+    bool ok = true;
+    for (auto& range : FlushRanges)
+    {
+        if (fseek(f, range.first, SEEK_SET) != 0 ||
+            fwrite(&SecondaryBuffer[range.first], range.second - range.first, 1, f) != 1)
+        {
+            ok = false;
+            break;
+        }
+    }
+    ok = SyncFile(f) && ok;
+    fclose(f);
+
+    if (!ok)
+    {
+        // the file may be partly written, try rewriting all of it
+        printf("NDS SRAM: failed to write to %s, rewriting it\n", Path);
+        *written = SecondaryBufferLength;
+        *full = true;
+        return WriteWholeFile();
+    }
+
+    *written = len;
+    *full = false;
+    return true;
+}
+
 void FlushSecondaryBuffer(u8* dst, s32 dstLength)
 {
     // When flushing to a file, there's no point in re-writing the exact same data.
@@ -150,12 +353,35 @@ void FlushSecondaryBuffer(u8* dst, s32 dstLength)
     }
     else
     {
-        FILE* f = Platform::OpenFile(Path, "wb");
-        if (f)
+        auto start = std::chrono::steady_clock::now();
+
+        u32 len = 0;
+        bool full = false;
+        if (WriteRanges(&len, &full))
         {
-            printf("NDS SRAM: Written\n");
-            fwrite(SecondaryBuffer, SecondaryBufferLength, 1, f);
-            fclose(f);
+            double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            Stats.NumFlushes++;
+            if (full) Stats.NumFullWrites++;
+            Stats.BytesWritten += len;
+            Stats.LastFlushBytes = len;
+            Stats.LastFlushTime = time;
+            if (time > Stats.MaxFlushTime) Stats.MaxFlushTime = time;
+
+            printf("NDS SRAM: Written %d bytes%s (%.2f ms)\n", len, full ? ", whole file" : "", time);
+
+            FlushRanges.clear();
+            ForceFullWrite = false;
+        }
+        else
+        {
+            // keep the dirty ranges and the version, and retry the next
+            // time around, rewriting the whole file
+            printf("NDS SRAM: flush failed, will retry\n");
+            ForceFullWrite = true;
+            TimeAtLastFlushRequest = time(NULL);
+            Platform::Mutex_Unlock(SecondaryBufferLock);
+            return;
         }
     }
     PreviousFlushVersion = FlushVersion;
@@ -176,9 +402,21 @@ void UpdateBuffer(u8* src, s32 srcLength)
     memcpy(Buffer, src, srcLength);
     Platform::Mutex_Lock(SecondaryBufferLock);
     memcpy(SecondaryBuffer, src, srcLength);
+    FlushRanges.clear();
     Platform::Mutex_Unlock(SecondaryBufferLock);
 
+    PendingRanges.clear();
+    PendingStart = 0;
+    PendingEnd = 0;
+
     PreviousFlushVersion = FlushVersion;
 }
 
+void GetStats(FlushStats* stats)
+{
+    Platform::Mutex_Lock(SecondaryBufferLock);
+    *stats = Stats;
+    Platform::Mutex_Unlock(SecondaryBufferLock);
+}
+
 }
@@ -23,17 +23,33 @@
 
 namespace NDSCart_SRAMManager
 {
+    struct FlushStats
+    {
+        u32 NumFlushes;
+        u32 NumFullWrites;      // flushes that rewrote the whole file
+        u64 BytesWritten;
+        u32 LastFlushBytes;
+        double LastFlushTime;   // in milliseconds
+        double MaxFlushTime;
+    };
+
     extern u32 SecondaryBufferLength;
 
     bool Init();
     void DeInit();
 
     void Setup(const char* path, u8* buffer, u32 length);
+
+    // signal that the given range of the save buffer was modified
+    // only the modified ranges are written back to the file
+    void MarkDirty(u32 addr, u32 len);
     void RequestFlush();
 
     bool NeedsFlush();
     void FlushSecondaryBuffer(u8* dst = NULL, s32 dstLength = 0);
     void UpdateBuffer(u8* src, s32 srcLength);
+
+    void GetStats(FlushStats* stats);
 }
 
 #endif // NDSCART_SRAMMANAGER_H
\ No newline at end of file
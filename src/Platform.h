@@ -91,10 +91,25 @@ bool Mutex_TryLock(Mutex* mutex);
 
 // local multiplayer comm interface
 // packet type: DS-style TX header (12 bytes) + original 802.11 frame
+// packets are tagged with the emulated time they were sent at, in microseconds
+// (timestamp may be null when receiving)
 bool MP_Init();
 void MP_DeInit();
-int MP_SendPacket(u8* data, int len);
-int MP_RecvPacket(u8* data, bool block);
+int MP_SendPacket(u8* data, int len, u64 timestamp);
+int MP_RecvPacket(u8* data, bool block, u64* timestamp);
+
+// lockstep between instances, if the transport supports it
+// * MP_Lockstep(): whether lockstep is in use
+// * MP_SyncTime(): lets the other instances know how far this one has gotten
+//   an MP client that got ahead of its host waits for it there
+//   returns the timestamp at which to call it again (and check for packets)
+// * MP_WaitReplies(): for the MP host: waits until every client has either
+//   sent something or gone past the given time
+// when lockstep is in use, MP_RecvPacket() doesn't return packets that were
+// sent after the last time passed to MP_SyncTime()
+bool MP_Lockstep();
+u64 MP_SyncTime(u64 timestamp, bool host, bool client);
+void MP_WaitReplies(u64 timestamp);
 
 // LAN comm interface
 // packet type: Ethernet (802.3)
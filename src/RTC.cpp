@@ -23,6 +23,7 @@
 #include <string.h>
 #include <time.h>
 #include "RTC.h"
+#include "NDS.h"
 
 
 namespace RTC
@@ -38,6 +39,8 @@ u8 Output[8];
 u32 OutputBit;
 u32 OutputPos;
 
+s64 ClockBase = -1;
+
 u8 CurCmd;
 
 u8 StatusReg1;
@@ -106,6 +109,26 @@ u8 BCD(u8 val)
     return (val % 10) | ((val / 10) << 4);
 }
 
+void SetClockBase(s64 base)
+{
+    ClockBase = base;
+}
+
+void GetTime(struct tm* timedata)
+{
+    if (ClockBase < 0)
+    {
+        time_t timestamp = time(NULL);
+        localtime_r(&timestamp, timedata);
+    }
+    else
+    {
+        // SysTimestamp counts 33MHz cycles since the console was powered on
+        time_t timestamp = ClockBase + (NDS::SysTimestamp / 33513982);
+        gmtime_r(&timestamp, timedata);
+    }
+}
+
 
 void ByteIn(u8 val)
 {
@@ -128,9 +151,8 @@ void ByteIn(u8 val)
 
             case 0x20:
                 {
-                    time_t timestamp = time(NULL);
                     struct tm timedata;
-                    localtime_r(&timestamp, &timedata);
+                    GetTime(&timedata);
 
                     Output[0] = BCD(timedata.tm_year - 100);
                     Output[1] = BCD(timedata.tm_mon + 1);
@@ -144,9 +166,8 @@ void ByteIn(u8 val)
 
             case 0x60:
                 {
-                    time_t timestamp = time(NULL);
                     struct tm timedata;
-                    localtime_r(&timestamp, &timedata);
+                    GetTime(&timedata);
 
                     Output[0] = BCD(timedata.tm_hour);
                     Output[1] = BCD(timedata.tm_min);
@@ -33,6 +33,11 @@ void DoSavestate(Savestate* file);
 u16 Read();
 void Write(u16 val, bool byte);
 
+// make the clock follow emulated time instead of the host's, so that it
+// reads the same when a recording is replayed
+// * base: UTC time (in seconds since the epoch) at power-on, or -1 to use the host clock
+void SetClockBase(s64 base);
+
 }
 
 #endif
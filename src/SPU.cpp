@@ -71,6 +71,7 @@ s16 InterpCubic[0x100][4];
 const u32 OutputBufferSize = 2*2048;
 s16 OutputBackbuffer[2 * OutputBufferSize];
 u32 OutputBackbufferWritePosition;
+u32 OutputLastFrameSize;
 
 s16 OutputFrontBuffer[2 * OutputBufferSize];
 u32 OutputFrontBufferWritePosition;
@@ -161,6 +162,7 @@ void Stop()
     memset(OutputFrontBuffer, 0, 2*OutputBufferSize*2);
 
     OutputBackbufferWritePosition = 0;
+    OutputLastFrameSize = 0;
     OutputFrontBufferReadPosition = 0;
     OutputFrontBufferWritePosition = 0;
     Platform::Mutex_Unlock(AudioLock);
@@ -849,10 +851,18 @@ void TransferOutput()
             OutputFrontBufferReadPosition &= OutputBufferSize*2-1;
         }
     }
+    OutputLastFrameSize = OutputBackbufferWritePosition;
     OutputBackbufferWritePosition = 0;
     Platform::Mutex_Unlock(AudioLock);
 }
 
+int GetFrameOutput(s16** data)
+{
+    // the backbuffer is only written to again once the next frame is run
+    *data = OutputBackbuffer;
+    return OutputLastFrameSize >> 1;
+}
+
 void TrimOutput()
 {
     Platform::Mutex_Lock(AudioLock);
@@ -878,6 +888,7 @@ void InitOutput()
     Platform::Mutex_Lock(AudioLock);
     memset(OutputBackbuffer, 0, 2*OutputBufferSize*2);
     memset(OutputFrontBuffer, 0, 2*OutputBufferSize*2);
+    OutputLastFrameSize = 0;
     OutputFrontBufferReadPosition = 0;
     OutputFrontBufferWritePosition = 0;
     Platform::Mutex_Unlock(AudioLock);
@@ -48,6 +48,9 @@ void Sync(bool wait);
 int ReadOutput(s16* data, int samples);
 void TransferOutput();
 
+// samples (stereo) output during the last frame, valid until the next frame is run
+int GetFrameOutput(s16** data);
+
 u8 Read8(u32 addr);
 u16 Read16(u32 addr);
 u32 Read32(u32 addr);
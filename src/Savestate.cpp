@@ -17,8 +17,10 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "Savestate.h"
 #include "Platform.h"
+#include "LZ4.h"
 
 /*
     Savestate format
@@ -28,7 +30,33 @@
     04 - version major
     06 - version minor
     08 - length
-    0C - reserved (should be game serial later!)
+    0C - table of contents offset (v9+, reserved before)
+
+    version 9+:
+
+    section data and blocks are stored as chunks, located through the table
+    of contents at the end of the file. A chunk is either stored raw (codec 0)
+    or LZ4-compressed (codec 1, raw LZ4 block format).
+
+    each section chunk holds the section's variables in the order they are
+    saved. Arrays of at least BlockThreshold bytes (MainRAM, VRAM, ...) are
+    stored as separate block chunks, and replaced in the section data by the
+    32-bit index of their block. Blocks stored raw are aligned to BlockAlign,
+    so that they could later be mapped directly.
+
+    table of contents:
+    00 - number of sections
+    04 - number of blocks
+    08 - section entries, then block entries
+
+    entry:
+    00 - section magic (for blocks: magic of the section they belong to)
+    04 - chunk offset
+    08 - chunk length
+    0C - decompressed length
+    10 - codec
+
+    version 8 and older:
 
     section header:
     00 - section magic
@@ -36,22 +64,36 @@
     08 - reserved
     0C - reserved
 
+    followed by the section's variables, sections being stored back to back.
+
     Implementation details
 
     version difference:
     * different major means savestate file is incompatible
+      (except that v8 savestates can still be loaded)
     * different minor means adjustments may have to be made
 */
 
+const u32 BlockThreshold = 0x10000;
+const u32 BlockAlign = 0x1000;
+
+// only compress when it's worth it
+const u32 MinCompressLength = 64;
+
+
 Savestate::Savestate(const char* filename, bool save)
 {
-    const char* magic = "MELN";
-
     Error = false;
 
+    buffer = nullptr;
+    bufferSize = 0;
+    bufferPos = 0;
+    bufferLen = 0;
+
+    compress = true;
+
     if (save)
     {
-        Saving = true;
         file = Platform::OpenLocalFile(filename, "wb");
         if (!file)
         {
@@ -60,17 +102,10 @@ Savestate::Savestate(const char* filename, bool save)
             return;
         }
 
-        VersionMajor = SAVESTATE_MAJOR;
-        VersionMinor = SAVESTATE_MINOR;
-
-        fwrite(magic, 4, 1, file);
-        fwrite(&VersionMajor, 2, 1, file);
-        fwrite(&VersionMinor, 2, 1, file);
-        fseek(file, 8, SEEK_CUR); // length to be fixed later
+        Begin(true, 0);
     }
     else
     {
-        Saving = false;
         file = Platform::OpenFile(filename, "rb");
         if (!file)
         {
@@ -84,9 +119,60 @@ Savestate::Savestate(const char* filename, bool save)
         len = (u32)ftell(file);
         fseek(file, 0, SEEK_SET);
 
+        Begin(false, len);
+    }
+}
+
+Savestate::Savestate(u8* buffer, u32 len, bool save)
+{
+    Error = false;
+
+    file = nullptr;
+    this->buffer = buffer;
+    bufferSize = len;
+    bufferPos = 0;
+    bufferLen = save ? 0 : len;
+
+    compress = false;
+
+    Begin(save, len);
+}
+
+Savestate::~Savestate()
+{
+    if (Saving && !Error && !finished)
+        Finish();
+
+    if (file) fclose(file);
+}
+
+void Savestate::Begin(bool save, u32 len)
+{
+    const char* magic = "MELN";
+
+    CurSection = -1;
+    sectionPos = 0;
+    finished = false;
+
+    if (save)
+    {
+        Saving = true;
+
+        VersionMajor = SAVESTATE_MAJOR;
+        VersionMinor = SAVESTATE_MINOR;
+
+        Write(magic, 4);
+        Write(&VersionMajor, 2);
+        Write(&VersionMinor, 2);
+        Skip(8); // length and TOC offset to be fixed later
+    }
+    else
+    {
+        Saving = false;
+
         u32 buf = 0;
 
-        fread(&buf, 4, 1, file);
+        Read(&buf, 4);
         if (buf != ((u32*)magic)[0])
         {
             printf("savestate: invalid magic %08X\n", buf);
@@ -97,16 +183,16 @@ Savestate::Savestate(const char* filename, bool save)
         VersionMajor = 0;
         VersionMinor = 0;
 
-        fread(&VersionMajor, 2, 1, file);
-        if (VersionMajor != SAVESTATE_MAJOR)
+        Read(&VersionMajor, 2);
+        if (VersionMajor < SAVESTATE_MAJOR_COMPAT || VersionMajor > SAVESTATE_MAJOR)
         {
             printf("savestate: bad version major %d, expecting %d\n", VersionMajor, SAVESTATE_MAJOR);
             Error = true;
             return;
         }
 
-        fread(&VersionMinor, 2, 1, file);
-        if (VersionMinor > SAVESTATE_MINOR)
+        Read(&VersionMinor, 2);
+        if (VersionMajor == SAVESTATE_MAJOR && VersionMinor > SAVESTATE_MINOR)
         {
             printf("savestate: state from the future, %d > %d\n", VersionMinor, SAVESTATE_MINOR);
             Error = true;
@@ -114,7 +200,7 @@ Savestate::Savestate(const char* filename, bool save)
         }
 
         buf = 0;
-        fread(&buf, 4, 1, file);
+        Read(&buf, 4);
         if (buf != len)
         {
             printf("savestate: bad length %d\n", buf);
@@ -122,70 +208,284 @@ Savestate::Savestate(const char* filename, bool save)
             return;
         }
 
-        fseek(file, 4, SEEK_CUR);
+        if (VersionMajor < 9)
+        {
+            Skip(4);
+            return;
+        }
+
+        u32 tocoffset = 0;
+        Read(&tocoffset, 4);
+
+        u32 numsections = 0, numblocks = 0;
+        Seek(tocoffset);
+        Read(&numsections, 4);
+        Read(&numblocks, 4);
+
+        if (tocoffset > len || ((u64)numsections + numblocks) * sizeof(TOCEntry) > (len - tocoffset))
+        {
+            printf("savestate: bad table of contents\n");
+            Error = true;
+            return;
+        }
+
+        sections.resize(numsections);
+        blocks.resize(numblocks);
+        for (TOCEntry& entry : sections) Read(&entry, sizeof(TOCEntry));
+        for (TOCEntry& entry : blocks) Read(&entry, sizeof(TOCEntry));
     }
+}
 
+u32 Savestate::Length()
+{
+    if (Saving && !Error && !finished)
+        Finish();
+
+    return bufferLen;
+}
+
+void Savestate::Finish()
+{
+    finished = true;
+
+    FinishSection();
     CurSection = -1;
+
+    u32 tocoffset = Tell();
+    u32 num = sections.size();
+    Write(&num, 4);
+    num = blocks.size();
+    Write(&num, 4);
+    for (TOCEntry& entry : sections) Write(&entry, sizeof(TOCEntry));
+    for (TOCEntry& entry : blocks) Write(&entry, sizeof(TOCEntry));
+
+    u32 len = bufferLen;
+    if (file)
+    {
+        fseek(file, 0, SEEK_END);
+        len = (u32)ftell(file);
+    }
+    Seek(8);
+    Write(&len, 4);
+    Write(&tocoffset, 4);
 }
 
-Savestate::~Savestate()
+void Savestate::Write(const void* data, u32 len)
 {
-    if (Error) return;
+    if (file)
+    {
+        fwrite(data, len, 1, file);
+        return;
+    }
+
+    if (bufferPos + len > bufferSize)
+    {
+        printf("savestate: buffer overflow (%d bytes)\n", bufferSize);
+        Error = true;
+        return;
+    }
+
+    memcpy(&buffer[bufferPos], data, len);
+    bufferPos += len;
+    if (bufferPos > bufferLen) bufferLen = bufferPos;
+}
+
+void Savestate::Read(void* data, u32 len)
+{
+    if (file)
+    {
+        fread(data, len, 1, file);
+        return;
+    }
+
+    // like fread(), reads past the end leave the destination untouched
+    if ((u64)bufferPos + len > bufferLen)
+    {
+        bufferPos = bufferLen;
+        return;
+    }
+
+    memcpy(data, &buffer[bufferPos], len);
+    bufferPos += len;
+}
+
+void Savestate::Seek(u32 pos)
+{
+    if (file)
+        fseek(file, pos, SEEK_SET);
+    else
+        bufferPos = pos;
+}
+
+void Savestate::Skip(u32 len)
+{
+    if (file)
+    {
+        fseek(file, len, SEEK_CUR);
+        return;
+    }
 
     if (Saving)
     {
-        if (CurSection != 0xFFFFFFFF)
+        // gaps in a savestate buffer must not contain stale data
+        u32 end = bufferPos + len;
+        if (end > bufferSize)
         {
-            u32 pos = (u32)ftell(file);
-            fseek(file, CurSection+4, SEEK_SET);
+            printf("savestate: buffer overflow (%d bytes)\n", bufferSize);
+            Error = true;
+            return;
+        }
+        if (end > bufferLen)
+        {
+            memset(&buffer[bufferLen], 0, end - bufferLen);
+            bufferLen = end;
+        }
+    }
 
-            u32 len = pos - CurSection;
-            fwrite(&len, 4, 1, file);
+    bufferPos += len;
+}
 
-            fseek(file, pos, SEEK_SET);
+u32 Savestate::Tell()
+{
+    if (file)
+        return (u32)ftell(file);
+    else
+        return bufferPos;
+}
+
+u32 Savestate::WriteChunk(const u8* data, u32 len, TOCEntry* entry, bool align)
+{
+    const u8* out = data;
+    u32 outlen = len;
+    u32 codec = 0;
+
+    std::vector<u8> packed;
+    if (compress && len >= MinCompressLength)
+    {
+        packed.resize(LZ4::CompressBound(len));
+        u32 packedlen = LZ4::Compress(data, len, packed.data(), packed.size());
+        if (packedlen && packedlen < (len - (len >> 4)))
+        {
+            out = packed.data();
+            outlen = packedlen;
+            codec = 1;
         }
+    }
 
-        fseek(file, 0, SEEK_END);
-        u32 len = (u32)ftell(file);
-        fseek(file, 8, SEEK_SET);
-        fwrite(&len, 4, 1, file);
+    if (codec == 0 && align)
+    {
+        u32 pos = Tell();
+        if (pos & (BlockAlign-1))
+            Skip(BlockAlign - (pos & (BlockAlign-1)));
     }
 
-    if (file) fclose(file);
+    entry->Offset = Tell();
+    entry->Length = outlen;
+    entry->RawLength = len;
+    entry->Codec = codec;
+
+    Write(out, outlen);
+    return outlen;
+}
+
+bool Savestate::ReadChunk(const TOCEntry* entry, u8* data)
+{
+    Seek(entry->Offset);
+
+    if (entry->Codec == 0)
+    {
+        Read(data, entry->RawLength);
+        return true;
+    }
+
+    std::vector<u8> packed(entry->Length);
+    Read(packed.data(), entry->Length);
+    if (entry->Codec != 1 || !LZ4::Decompress(packed.data(), entry->Length, data, entry->RawLength))
+    {
+        printf("savestate: corrupted chunk at %08X\n", entry->Offset);
+        Error = true;
+        return false;
+    }
+
+    return true;
+}
+
+void Savestate::FinishSection()
+{
+    if (CurSection == 0xFFFFFFFF) return;
+
+    WriteChunk(sectionData.data(), sectionData.size(), &sections[CurSection], false);
+    sectionData.clear();
+}
+
+void Savestate::Put(const void* data, u32 len)
+{
+    const u8* ptr = (const u8*)data;
+    sectionData.insert(sectionData.end(), ptr, ptr + len);
+}
+
+void Savestate::Get(void* data, u32 len)
+{
+    if (VersionMajor < 9)
+    {
+        Read(data, len);
+        return;
+    }
+
+    // reads past the end of the section leave the destination untouched
+    if ((u64)sectionPos + len > sectionData.size())
+    {
+        sectionPos = sectionData.size();
+        return;
+    }
+
+    memcpy(data, &sectionData[sectionPos], len);
+    sectionPos += len;
 }
 
 void Savestate::Section(const char* magic)
 {
     if (Error) return;
 
+    u32 magicval;
+    memcpy(&magicval, magic, 4);
+
     if (Saving)
     {
-        if (CurSection != 0xFFFFFFFF)
-        {
-            u32 pos = (u32)ftell(file);
-            fseek(file, CurSection+4, SEEK_SET);
+        FinishSection();
 
-            u32 len = pos - CurSection;
-            fwrite(&len, 4, 1, file);
+        TOCEntry entry = {0};
+        entry.Magic = magicval;
+        sections.push_back(entry);
+        CurSection = sections.size() - 1;
+    }
+    else if (VersionMajor >= 9)
+    {
+        sectionData.clear();
+        sectionPos = 0;
 
-            fseek(file, pos, SEEK_SET);
-        }
+        for (u32 i = 0; i < sections.size(); i++)
+        {
+            if (sections[i].Magic != magicval) continue;
 
-        CurSection = (u32)ftell(file);
+            CurSection = i;
+            sectionData.resize(sections[i].RawLength);
+            ReadChunk(&sections[i], sectionData.data());
+            return;
+        }
 
-        fwrite(magic, 4, 1, file);
-        fseek(file, 12, SEEK_CUR);
+        printf("savestate: section %s not found. blarg\n", magic);
     }
     else
     {
-        fseek(file, 0x10, SEEK_SET);
+        Seek(0x10);
 
         for (;;)
         {
             u32 buf = 0;
 
-            fread(&buf, 4, 1, file);
-            if (buf != ((u32*)magic)[0])
+            Read(&buf, 4);
+            if (buf != magicval)
             {
                 if (buf == 0)
                 {
@@ -194,12 +494,12 @@ void Savestate::Section(const char* magic)
                 }
 
                 buf = 0;
-                fread(&buf, 4, 1, file);
-                fseek(file, buf-8, SEEK_CUR);
+                Read(&buf, 4);
+                Skip(buf-8);
                 continue;
             }
 
-            fseek(file, 12, SEEK_CUR);
+            Skip(12);
             break;
         }
     }
@@ -211,11 +511,11 @@ void Savestate::Var8(u8* var)
 
     if (Saving)
     {
-        fwrite(var, 1, 1, file);
+        Put(var, 1);
     }
     else
     {
-        fread(var, 1, 1, file);
+        Get(var, 1);
     }
 }
 
@@ -225,11 +525,11 @@ void Savestate::Var16(u16* var)
 
     if (Saving)
     {
-        fwrite(var, 2, 1, file);
+        Put(var, 2);
     }
     else
     {
-        fread(var, 2, 1, file);
+        Get(var, 2);
     }
 }
 
@@ -239,11 +539,11 @@ void Savestate::Var32(u32* var)
 
     if (Saving)
     {
-        fwrite(var, 4, 1, file);
+        Put(var, 4);
     }
     else
     {
-        fread(var, 4, 1, file);
+        Get(var, 4);
     }
 }
 
@@ -253,11 +553,11 @@ void Savestate::Var64(u64* var)
 
     if (Saving)
     {
-        fwrite(var, 8, 1, file);
+        Put(var, 8);
     }
     else
     {
-        fread(var, 8, 1, file);
+        Get(var, 8);
     }
 }
 
@@ -281,12 +581,40 @@ void Savestate::VarArray(void* data, u32 len)
 {
     if (Error) return;
 
+    if (len < BlockThreshold || (!Saving && VersionMajor < 9))
+    {
+        if (Saving)
+            Put(data, len);
+        else
+            Get(data, len);
+        return;
+    }
+
+    // large arrays get their own chunk
     if (Saving)
     {
-        fwrite(data, len, 1, file);
+        if (CurSection == 0xFFFFFFFF) return;
+
+        TOCEntry entry;
+        entry.Magic = sections[CurSection].Magic;
+        WriteChunk((const u8*)data, len, &entry, true);
+
+        u32 index = blocks.size();
+        blocks.push_back(entry);
+        Put(&index, 4);
     }
     else
     {
-        fread(data, len, 1, file);
+        u32 index = 0xFFFFFFFF;
+        Get(&index, 4);
+
+        if (index >= blocks.size() || blocks[index].RawLength != len)
+        {
+            printf("savestate: bad block %d\n", index);
+            return;
+        }
+
+        // the block is read from its own location, the section data isn't affected
+        ReadChunk(&blocks[index], (u8*)data);
     }
 }
@@ -20,15 +20,24 @@
 #define SAVESTATE_H
 
 #include <stdio.h>
+#include <vector>
 #include "types.h"
 
-#define SAVESTATE_MAJOR 8
-#define SAVESTATE_MINOR 0
+#define SAVESTATE_MAJOR 9
+#define SAVESTATE_MINOR 3
+
+// oldest major version we can still load
+#define SAVESTATE_MAJOR_COMPAT 8
 
 class Savestate
 {
 public:
+    // file savestates are compressed
     Savestate(const char* filename, bool save);
+    // memory-backed savestate, never compressed
+    // when saving, 'len' is the capacity of 'buffer' and Error is raised if it is exceeded
+    // when loading, 'len' is the length of the savestate data in 'buffer'
+    Savestate(u8* buffer, u32 len, bool save);
     ~Savestate();
 
     bool Error;
@@ -57,8 +66,50 @@ public:
         return false;
     }
 
+    // length of the savestate data (memory-backed savestates only)
+    // when saving, this completes the savestate, nothing can be added to it afterwards
+    u32 Length();
+
 private:
+    // table of contents entry, for both sections and blocks
+    struct TOCEntry
+    {
+        u32 Magic;      // section magic (for blocks: magic of the section they belong to)
+        u32 Offset;
+        u32 Length;     // stored length
+        u32 RawLength;  // length once decompressed
+        u32 Codec;
+    };
+
     FILE* file;
+    bool compress;
+    bool finished;
+
+    std::vector<TOCEntry> sections;
+    std::vector<TOCEntry> blocks;
+    std::vector<u8> sectionData;
+    u32 sectionPos;
+
+    u8* buffer;
+    u32 bufferSize;
+    u32 bufferPos;
+    u32 bufferLen;
+
+    void Write(const void* data, u32 len);
+    void Read(void* data, u32 len);
+    void Seek(u32 pos);
+    void Skip(u32 len);
+    u32 Tell();
+
+    void Begin(bool save, u32 len);
+    void FinishSection();
+    void Finish();
+
+    void Put(const void* data, u32 len);
+    void Get(void* data, u32 len);
+
+    u32 WriteChunk(const u8* data, u32 len, TOCEntry* entry, bool align);
+    bool ReadChunk(const TOCEntry* entry, u8* data);
 };
 
 #endif // SAVESTATE_H
@@ -0,0 +1,217 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+
+#include "StateHash.h"
+#include "NDS.h"
+#include "ARM.h"
+#include "GPU.h"
+#include "Config.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+
+namespace StateHash
+{
+
+const char* RegionNames[Region_MAX] =
+{
+    "mainram",
+    "wram",
+    "vram",
+    "2d",
+    "3d",
+    "cpu",
+    "sched",
+};
+
+const u32 PageShift = 12;
+const u32 PageSize = 1 << PageShift;
+
+bool Enabled = false;
+u64 PageHash[NDS::MainRAMMaxSize >> PageShift];
+
+
+void SetEnabled(bool enable)
+{
+    Enabled = enable;
+    NDS::SetMainRAMWriteTracking(enable);
+
+    // pages written to while tracking was off are unknown
+    memset(NDS::MainRAMDirty, 0xFF, sizeof(NDS::MainRAMDirty));
+}
+
+u64 HashMainRAM(bool full)
+{
+    u32 numpages = (NDS::MainRAMMask + 1) >> PageShift;
+
+#ifdef JIT_ENABLED
+    // fastmem writes go straight to memory
+    if (Config::JIT_Enable && Config::JIT_FastMemory)
+        full = true;
+#endif
+    if (!Enabled)
+        full = true;
+
+    for (u32 i = 0; i < numpages; i += 64)
+    {
+        u64 dirty = full ? ~0ULL : NDS::MainRAMDirty[i >> 6];
+        NDS::MainRAMDirty[i >> 6] = 0;
+
+        while (dirty)
+        {
+            u32 page = i + __builtin_ctzll(dirty);
+            dirty &= dirty - 1;
+            if (page >= numpages) break;
+
+            PageHash[page] = XXH3_64bits(&NDS::MainRAM[page << PageShift], PageSize);
+        }
+    }
+
+    return XXH3_64bits(PageHash, numpages * sizeof(u64));
+}
+
+u64 HashWRAM()
+{
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+
+    XXH3_64bits_update(&state, NDS::SharedWRAM, NDS::SharedWRAMSize);
+    XXH3_64bits_update(&state, NDS::ARM7WRAM, NDS::ARM7WRAMSize);
+    XXH3_64bits_update(&state, NDS::ARM9->ITCM, ITCMPhysicalSize);
+    XXH3_64bits_update(&state, NDS::ARM9->DTCM, DTCMPhysicalSize);
+
+    return XXH3_64bits_digest(&state);
+}
+
+u64 HashVRAM()
+{
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+
+    XXH3_64bits_update(&state, GPU::VRAM_A, sizeof(GPU::VRAM_A));
+    XXH3_64bits_update(&state, GPU::VRAM_B, sizeof(GPU::VRAM_B));
+    XXH3_64bits_update(&state, GPU::VRAM_C, sizeof(GPU::VRAM_C));
+    XXH3_64bits_update(&state, GPU::VRAM_D, sizeof(GPU::VRAM_D));
+    XXH3_64bits_update(&state, GPU::VRAM_E, sizeof(GPU::VRAM_E));
+    XXH3_64bits_update(&state, GPU::VRAM_F, sizeof(GPU::VRAM_F));
+    XXH3_64bits_update(&state, GPU::VRAM_G, sizeof(GPU::VRAM_G));
+    XXH3_64bits_update(&state, GPU::VRAM_H, sizeof(GPU::VRAM_H));
+    XXH3_64bits_update(&state, GPU::VRAM_I, sizeof(GPU::VRAM_I));
+    XXH3_64bits_update(&state, GPU::Palette, sizeof(GPU::Palette));
+    XXH3_64bits_update(&state, GPU::OAM, sizeof(GPU::OAM));
+
+    return XXH3_64bits_digest(&state);
+}
+
+u64 Hash2D()
+{
+    size_t fbsize;
+    if (GPU3D::CurrentRenderer->Accelerated)
+        fbsize = (256*3 + 1) * 192;
+    else
+        fbsize = 256 * 192;
+
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+
+    int fb = GPU::FrontBuffer;
+    XXH3_64bits_update(&state, GPU::Framebuffer[fb][0], fbsize * 4);
+    XXH3_64bits_update(&state, GPU::Framebuffer[fb][1], fbsize * 4);
+
+    return XXH3_64bits_digest(&state);
+}
+
+u64 Hash3D()
+{
+    int stride;
+    u32* frame = GPU3D::CurrentRenderer->GetFrame(&stride);
+    if (!frame) return 0;
+
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+
+    for (int y = 0; y < 192; y++)
+        XXH3_64bits_update(&state, &frame[y * stride], 256 * 4);
+
+    return XXH3_64bits_digest(&state);
+}
+
+void HashCPU(XXH3_state_t* state, ARM* cpu)
+{
+    XXH3_64bits_update(state, cpu->R, sizeof(cpu->R));
+    XXH3_64bits_update(state, &cpu->CPSR, sizeof(cpu->CPSR));
+    XXH3_64bits_update(state, cpu->R_FIQ, sizeof(cpu->R_FIQ));
+    XXH3_64bits_update(state, cpu->R_SVC, sizeof(cpu->R_SVC));
+    XXH3_64bits_update(state, cpu->R_ABT, sizeof(cpu->R_ABT));
+    XXH3_64bits_update(state, cpu->R_IRQ, sizeof(cpu->R_IRQ));
+    XXH3_64bits_update(state, cpu->R_UND, sizeof(cpu->R_UND));
+    XXH3_64bits_update(state, &cpu->Halted, sizeof(cpu->Halted));
+}
+
+u64 HashCPUs()
+{
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+
+    HashCPU(&state, NDS::ARM9);
+    HashCPU(&state, NDS::ARM7);
+
+    return XXH3_64bits_digest(&state);
+}
+
+u64 HashScheduler()
+{
+    XXH3_state_t state;
+    XXH3_64bits_reset(&state);
+
+    XXH3_64bits_update(&state, &NDS::SysTimestamp, sizeof(u64));
+    XXH3_64bits_update(&state, &NDS::ARM9Timestamp, sizeof(u64));
+    XXH3_64bits_update(&state, &NDS::ARM7Timestamp, sizeof(u64));
+    XXH3_64bits_update(&state, &NDS::SchedListMask, sizeof(u32));
+
+    // only the pending events, the others hold stale values
+    for (int i = 0; i < NDS::Event_MAX; i++)
+    {
+        if (!(NDS::SchedListMask & (1<<i)))
+            continue;
+
+        NDS::SchedEvent* evt = &NDS::SchedList[i];
+        XXH3_64bits_update(&state, &evt->Timestamp, sizeof(u64));
+        XXH3_64bits_update(&state, &evt->Param, sizeof(u32));
+    }
+
+    return XXH3_64bits_digest(&state);
+}
+
+void Compute(Result* res, bool full)
+{
+    res->Region[Region_MainRAM] = HashMainRAM(full);
+    res->Region[Region_WRAM] = HashWRAM();
+    res->Region[Region_VRAM] = HashVRAM();
+    res->Region[Region_2D] = Hash2D();
+    res->Region[Region_3D] = Hash3D();
+    res->Region[Region_CPU] = HashCPUs();
+    res->Region[Region_Scheduler] = HashScheduler();
+
+    res->Combined = XXH3_64bits(res->Region, sizeof(res->Region));
+}
+
+}
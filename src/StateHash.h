@@ -0,0 +1,61 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include "types.h"
+
+// hashes of the emulated state, split per subsystem, meant to be taken
+// between frames to check that two runs (or two builds) behave the same
+
+namespace StateHash
+{
+
+enum
+{
+    Region_MainRAM = 0,
+    Region_WRAM,        // shared WRAM, ARM7 WRAM, ITCM, DTCM
+    Region_VRAM,        // VRAM banks, palette, OAM
+    Region_2D,          // final framebuffers
+    Region_3D,          // 3D renderer output for the next frame (0 if not available)
+    Region_CPU,         // ARM9/ARM7 registers
+    Region_Scheduler,   // timestamps and pending events
+
+    Region_MAX
+};
+
+extern const char* RegionNames[Region_MAX];
+
+struct Result
+{
+    u64 Region[Region_MAX];
+    u64 Combined;
+};
+
+// main RAM is hashed per 4KB page, and only pages written to since the
+// previous call are rehashed. this requires routing all main RAM writes
+// through the bus handlers, which is what enabling does
+void SetEnabled(bool enable);
+
+// full: rehash everything regardless of dirty tracking (for checking it)
+void Compute(Result* res, bool full = false);
+
+}
+
+#endif // STATEHASH_H
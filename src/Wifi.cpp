@@ -38,6 +38,7 @@ u16 IO[0x1000>>1];
 
 u16 Random;
 
+u64 USTimestamp; // emulated time since power-on, unaffected by the guest
 u64 USCounter;
 u64 USCompare;
 bool BlockBeaconIRQ14;
@@ -80,6 +81,11 @@ u32 RXCounter;
 int MPReplyTimer;
 int MPNumReplies;
 
+bool MPLockstep;
+u64 MPLastCmdTime;
+u64 MPNextSync; // lockstep: when to sync with the other instances and check for packets next
+bool MPRXDue;
+
 bool MPInited;
 bool LANInited;
 
@@ -125,6 +131,7 @@ bool Init()
 {
     MPInited = false;
     LANInited = false;
+    MPLockstep = false;
 
     WifiAP::Init();
 
@@ -198,6 +205,7 @@ void Reset()
     memset(&IOPORT(0x018), 0xFF, 6);
     memset(&IOPORT(0x020), 0xFF, 6);
 
+    USTimestamp = 0;
     USCounter = 0;
     USCompare = 0;
     BlockBeaconIRQ14 = false;
@@ -208,6 +216,9 @@ void Reset()
 
     MPReplyTimer = 0;
     MPNumReplies = 0;
+    MPLastCmdTime = 0;
+    MPNextSync = 0;
+    MPRXDue = false;
 
     CmdCounter = 0;
 
@@ -246,6 +257,14 @@ void DoSavestate(Savestate* file)
     file->Var32((u32*)&MPNumReplies);
 
     file->Var32(&CmdCounter);
+
+    if (file->IsAtleastVersion(9, 3))
+        file->Var64(&USTimestamp);
+    else
+        USTimestamp = 0;
+
+    if (!file->Saving)
+        MPNextSync = 0;
 }
 
 
@@ -500,7 +519,8 @@ void SendMPDefaultReply()
 	*(u16*)&reply[0xC + 0x16] = IOPORT(W_TXSeqNo) << 4;
 	*(u32*)&reply[0xC + 0x18] = 0;
 
-	int txlen = Platform::MP_SendPacket(reply, 12+28);
+	int txlen = Platform::MP_SendPacket(reply, 12+28, USTimestamp);
+	MPNextSync = 0;
 	WIFI_LOG("wifi: sent %d/40 bytes of MP default reply\n", txlen);
 }
 
@@ -530,7 +550,8 @@ void SendMPAck()
 	*(u16*)&ack[0xC + 0x1A] = 0;
 	*(u32*)&ack[0xC + 0x1C] = 0;
 
-	int txlen = Platform::MP_SendPacket(ack, 12+32);
+	int txlen = Platform::MP_SendPacket(ack, 12+32, USTimestamp);
+	MPNextSync = 0;
 	WIFI_LOG("wifi: sent %d/44 bytes of MP ack, %d %d\n", txlen, ComStatus, RXTime);
 }
 
@@ -561,7 +582,12 @@ bool ProcessTX(TXSlot* slot, int num)
             MPReplyTimer--;
             if (MPReplyTimer == 0 && MPNumReplies > 0)
             {
-                if (CheckRX(true))
+                // in lockstep, whether a reply made it in time depends on
+                // emulated time and not on how fast the clients are running
+                if (MPLockstep)
+                    Platform::MP_WaitReplies(USTimestamp);
+
+                if (CheckRX(!MPLockstep))
                 {
                     ComStatus |= 0x1;
                 }
@@ -655,7 +681,9 @@ bool ProcessTX(TXSlot* slot, int num)
             IOPORT(W_RXTXAddr) = slot->Addr >> 1;
 
             // send
-            int txlen = Platform::MP_SendPacket(&RAM[slot->Addr], 12 + slot->Length);
+            if (num == 1) MPLastCmdTime = USTimestamp;
+            int txlen = Platform::MP_SendPacket(&RAM[slot->Addr], 12 + slot->Length, USTimestamp);
+            MPNextSync = 0; // peers react to what we send, check on them right away
             WIFI_LOG("wifi: sent %d/%d bytes of slot%d packet, addr=%04X, framectl=%04X, %04X %04X\n",
                      txlen, slot->Length+12, num, slot->Addr, *(u16*)&RAM[slot->Addr + 0xC],
                      *(u16*)&RAM[slot->Addr + 0x24], *(u16*)&RAM[slot->Addr + 0x26]);
@@ -818,7 +846,7 @@ bool CheckRX(bool block)
 
     for (;;)
     {
-        int rxlen = Platform::MP_RecvPacket(RXBuffer, block);
+        int rxlen = Platform::MP_RecvPacket(RXBuffer, block, nullptr);
         if (rxlen == 0) rxlen = WifiAP::RecvPacket(RXBuffer);
         if (rxlen == 0) return false;
         if (rxlen < 12+24) continue;
@@ -962,6 +990,19 @@ void MSTimer()
 
 void USTimer(u32 param)
 {
+    USTimestamp++;
+
+    // in lockstep, the instances don't need to sync up every microsecond:
+    // MP_SyncTime() tells when packets are due or peers need to see us again
+    if (MPLockstep && USTimestamp >= MPNextSync)
+    {
+        // we're the MP host if we've been sending MP frames lately
+        bool host = MPLastCmdTime && ((USTimestamp - MPLastCmdTime) < 1000000);
+        bool client = IOPORT(W_AIDLow) != 0;
+        MPNextSync = Platform::MP_SyncTime(USTimestamp, host, client);
+        MPRXDue = true;
+    }
+
     WifiAP::USTimer();
 
     if (IOPORT(W_USCountCnt))
@@ -1004,10 +1045,14 @@ void USTimer(u32 param)
         }
         else
         {
-            if ((!(RXCounter & 0x1FF)))
+            // in lockstep, packets are checked for whenever the instances sync
+            // up, which is when they're due. after receiving one, there may be more
+            if (MPLockstep ? MPRXDue : !(RXCounter & 0x1FF))
             {
                 if (CheckRX(false))
                     ComStatus = 0x1;
+                else
+                    MPRXDue = false;
             }
 
             RXCounter++;
@@ -1350,6 +1395,7 @@ void Write(u32 addr, u16 val)
             if (!MPInited)
             {
                 Platform::MP_Init();
+                MPLockstep = Platform::MP_Lockstep();
                 MPInited = true;
             }
             if (!LANInited)
@@ -105,9 +105,45 @@ bool LoadState(const char* filename);
 // save the current emulator state to the given file
 bool SaveState(const char* filename);
 
+// save the current emulator state to memory, starting at the beginning of
+// the given buffer, which is enlarged if needed
+// returns the length of the savestate
+u32 SaveStateToMemory(std::vector<u8>& buf);
+
 // undo the latest savestate load
 void UndoStateLoad();
 
+// rewind buffer statistics
+struct RewindStats
+{
+    int NumStates;          // amount of captures currently held
+    u64 MemoryUsage;        // total size of the encoded captures, in bytes
+    u32 LastStateSize;      // size of the last capture before encoding
+    u32 LastEncodedSize;    // size of the last capture after encoding
+    double LastCaptureTime; // time taken by the last capture, in milliseconds
+    double LastRestoreTime; // time taken by the last restore, in milliseconds
+};
+
+// setup the rewind buffer
+// * depth: maximum amount of captures kept
+// * interval: amount of frames between two captures
+// * keyinterval: amount of captures between two full (non-delta) captures
+// * maxmemory: maximum memory used by the captures, in megabytes
+// this also clears the rewind history
+void Rewind_Init(bool enable, int depth, int interval, int keyinterval, int maxmemory);
+
+// clear the rewind history (when the emulated system is reset or a savestate is loaded)
+void Rewind_Reset();
+
+// to be called after every emulated frame, captures the emulator state if needed
+void Rewind_Capture();
+
+// restore the latest capture and drop it from the history
+// returns false if there is no history left
+bool Rewind_Step();
+
+void Rewind_GetStats(RewindStats* stats);
+
 // imports savedata from an external file. Returns the difference between the filesize and the SRAM size
 int ImportSRAM(const char* filename);
 
@@ -182,6 +218,111 @@ void Mic_FeedNoise();
 void Mic_FeedExternalBuffer();
 void Mic_SetExternalBuffer(s16* buffer, u32 len);
 
+
+enum
+{
+    FramePacing_Video = 0, // run at the emulated frame rate
+    FramePacing_Audio,     // adjust the frame rate to the audio output's consumption
+};
+
+const int FramePacer_HistogramSize = 128;
+const double FramePacer_BucketSize = 0.25; // in milliseconds
+
+// frame pacer statistics, times in milliseconds
+struct FramePacerStats
+{
+    u32 NumFrames;
+    u32 NumLate;        // frames for which the deadline had already passed
+    double MeanTime;
+    double StdDev;
+    double MaxTime;
+    double BucketSize;
+    u32 Histogram[FramePacer_HistogramSize]; // frame times, the last bucket also counts all longer frames
+};
+
+// initialize the frame pacer
+void FramePacer_Init(int mode);
+
+void FramePacer_SetMode(int mode);
+
+// make the frame rate follow the display's when they are close enough
+// (refreshrate = 0 to disable)
+// * interval: amount of display refreshes per emulated frame
+void FramePacer_SetDisplayRate(double refreshrate, int interval);
+
+// restart the frame timeline (after emulation was paused)
+void FramePacer_Reset();
+
+void FramePacer_ResetStats();
+
+// to be called after every emulated frame, waits until the next frame should start
+// * frametime: duration of the frame in seconds
+// * audiofill: amount of samples in the core audio output (SPU::GetOutputSize()),
+//   or -1 if there is no audio output
+void FramePacer_Wait(double frametime, int audiofill);
+
+void FramePacer_GetStats(FramePacerStats* stats);
+
+// video capture statistics
+struct CaptureStats
+{
+    u32 NumFrames;      // frames handed to the encoder
+    u32 NumDropped;     // frames dropped because the encoder was behind
+    u32 NumStalls;      // times the emulator had to wait for the encoder (nodrop mode)
+    double StallTime;   // total time spent waiting for the encoder, in milliseconds
+    int QueueDepth;     // frames currently waiting to be encoded
+    int MaxQueueDepth;
+    u64 BytesWritten;
+};
+
+// start capturing video and audio to <basepath>.y4m and <basepath>.wav
+// * nodrop: wait for the encoder instead of dropping frames when it falls behind
+// the software renderer must be in use
+bool Capture_Start(const char* basepath, bool nodrop);
+
+// finish writing the queued frames and close the capture files
+void Capture_Stop();
+
+bool Capture_IsActive();
+
+// to be called after every emulated frame
+void Capture_Frame();
+
+void Capture_GetStats(CaptureStats* stats);
+
+// console input
+// input goes through these instead of the NDS functions, so that it can be
+// recorded and replayed. it only reaches the console when Input_Apply() is
+// called, so that every frame sees the same input from start to end
+void Input_SetKeyMask(u32 mask);
+void Input_TouchScreen(u16 x, u16 y); // can be called from any thread
+void Input_ReleaseScreen();           // can be called from any thread
+void Input_SetLidClosed(bool closed);
+void Input_MicFrame(s16* data, int samples);
+
+// to be called before every emulated frame
+// hands the latched input (or the movie's, during playback) to the console
+void Input_Apply();
+
+// start recording input to a movie file
+// * fromsavestate: the movie starts with a savestate of the current state,
+//   otherwise it starts from power-on and the console should have just been booted
+bool Movie_StartRecording(const char* path, bool fromsavestate);
+
+// start replaying a movie, loading its savestate if it has one
+// movies starting from power-on should be started right after booting
+// input from the frontend is ignored until the end of the movie
+bool Movie_StartPlayback(const char* path);
+
+void Movie_Stop();
+
+bool Movie_IsRecording();
+bool Movie_IsPlaying();
+
+// amount of frames in the movie (recorded so far, when recording)
+u32 Movie_GetNumFrames();
+u32 Movie_GetCurFrame();
+
 }
 
 #endif // FRONTENDUTIL_H
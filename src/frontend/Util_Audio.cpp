@@ -84,7 +84,7 @@ void AudioOut_Resample(s16* inbuf, int inlen, s16* outbuf, int outlen, int volum
 void Mic_FeedSilence()
 {
     MicBufferReadPos = 0;
-    NDS::MicInputFrame(NULL, 0);
+    Input_MicFrame(NULL, 0);
 }
 
 void Mic_FeedNoise()
@@ -101,7 +101,7 @@ void Mic_FeedNoise()
         if (sample_pos >= sample_len) sample_pos = 0;
     }
 
-    NDS::MicInputFrame(tmp, 735);
+    Input_MicFrame(tmp, 735);
 }
 
 void Mic_FeedExternalBuffer()
@@ -115,12 +115,12 @@ void Mic_FeedExternalBuffer()
         memcpy(&tmp[0], &MicBuffer[MicBufferReadPos], len1*sizeof(s16));
         memcpy(&tmp[len1], &MicBuffer[0], (735 - len1)*sizeof(s16));
 
-        NDS::MicInputFrame(tmp, 735);
+        Input_MicFrame(tmp, 735);
         MicBufferReadPos = 735 - len1;
     }
     else
     {
-        NDS::MicInputFrame(&MicBuffer[MicBufferReadPos], 735);
+        Input_MicFrame(&MicBuffer[MicBufferReadPos], 735);
         MicBufferReadPos += 735;
     }
 }
@@ -0,0 +1,333 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "FrontendUtil.h"
+
+#include "Platform.h"
+#include "GPU.h"
+#include "SPU.h"
+
+
+/*
+    Video capture
+
+    Every emulated frame, the emulator thread copies the finished framebuffers
+    and the audio output of that frame into a free slot of a small ring, and
+    hands it over to an encoder thread. The copy is the only work done on the
+    emulator thread: the GPU reuses its buffers, so they can't be handed over
+    as-is. Color conversion and file I/O are done by the encoder thread.
+
+    Output is two files:
+    * <base>.y4m: uncompressed YUV 4:4:4 video, both screens stacked (256x384)
+    * <base>.wav: 16-bit stereo PCM
+
+    If the encoder can't keep up and the ring is full, the frame is either
+    dropped, or the emulator thread waits for a slot to free up (nodrop mode,
+    used when the capture has to be complete, for example in batch runs).
+*/
+
+namespace Frontend
+{
+
+const int kCaptureQueueSize = 8;
+
+// the SPU mixes one sample every 1024 system clock cycles
+const u32 kCaptureAudioRate = 33513982 / 1024;
+
+struct CaptureSlot
+{
+    u32 Video[256*192*2];
+    s16 Audio[2*2048];
+    int NumSamples;
+};
+
+bool CaptureActive = false;
+bool CaptureNoDrop;
+
+FILE* CaptureVideoFile;
+FILE* CaptureAudioFile;
+u32 CaptureAudioBytes;
+
+CaptureSlot* CaptureSlots = nullptr;
+std::atomic<u32> CaptureReadPos;
+std::atomic<u32> CaptureWritePos;
+std::atomic<bool> CaptureStopping;
+
+Platform::Thread* CaptureThread;
+Platform::Semaphore* CaptureFilledSema;
+Platform::Semaphore* CaptureFreeSema;
+
+u8* CapturePlanes;
+
+CaptureStats CaptureStat;
+std::atomic<u64> CaptureBytesWritten;
+
+
+static void WriteLE32(u8* dst, u32 val)
+{
+    dst[0] = val & 0xFF;
+    dst[1] = (val >> 8) & 0xFF;
+    dst[2] = (val >> 16) & 0xFF;
+    dst[3] = val >> 24;
+}
+
+static void WriteLE16(u8* dst, u16 val)
+{
+    dst[0] = val & 0xFF;
+    dst[1] = val >> 8;
+}
+
+static void WriteWAVHeader(FILE* f, u32 datalen)
+{
+    u8 header[44];
+
+    memcpy(&header[0], "RIFF", 4);
+    WriteLE32(&header[4], 36 + datalen);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    WriteLE32(&header[16], 16);
+    WriteLE16(&header[20], 1); // PCM
+    WriteLE16(&header[22], 2); // stereo
+    WriteLE32(&header[24], kCaptureAudioRate);
+    WriteLE32(&header[28], kCaptureAudioRate * 4);
+    WriteLE16(&header[32], 4);
+    WriteLE16(&header[34], 16);
+    memcpy(&header[36], "data", 4);
+    WriteLE32(&header[40], datalen);
+
+    fseek(f, 0, SEEK_SET);
+    fwrite(header, sizeof(header), 1, f);
+}
+
+static inline u8 ClampU8(int val)
+{
+    if (val < 0) return 0;
+    if (val > 255) return 255;
+    return val;
+}
+
+// BGRA to full range BT.601 YUV, one plane after the other
+static void ConvertFrame(const u32* src, u8* dst)
+{
+    const int numpixels = 256*192*2;
+    u8* dsty = &dst[0];
+    u8* dstu = &dst[numpixels];
+    u8* dstv = &dst[numpixels*2];
+
+    for (int i = 0; i < numpixels; i++)
+    {
+        u32 pixel = src[i];
+        int r = (pixel >> 16) & 0xFF;
+        int g = (pixel >> 8) & 0xFF;
+        int b = pixel & 0xFF;
+
+        // 16.16 fixed point, +0x8000 for rounding
+        // U and V reach 256 for pure blue and red, hence the clamping
+        int y = (19595*r + 38470*g + 7471*b + 0x8000) >> 16;
+        int u = ((-11059*r - 21709*g + 32768*b + 0x8000) >> 16) + 128;
+        int v = ((32768*r - 27439*g - 5329*b + 0x8000) >> 16) + 128;
+
+        dsty[i] = ClampU8(y);
+        dstu[i] = ClampU8(u);
+        dstv[i] = ClampU8(v);
+    }
+}
+
+static void EncodeSlot(CaptureSlot* slot)
+{
+    ConvertFrame(slot->Video, CapturePlanes);
+
+    const int framelen = 256*192*2*3;
+    fwrite("FRAME\n", 6, 1, CaptureVideoFile);
+    fwrite(CapturePlanes, framelen, 1, CaptureVideoFile);
+
+    int audiolen = slot->NumSamples * 4;
+    if (audiolen > 0)
+        fwrite(slot->Audio, audiolen, 1, CaptureAudioFile);
+    CaptureAudioBytes += audiolen;
+
+    CaptureBytesWritten += 6 + framelen + audiolen;
+}
+
+static void CaptureThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(CaptureFilledSema);
+
+        while (CaptureReadPos != CaptureWritePos)
+        {
+            u32 pos = CaptureReadPos;
+            EncodeSlot(&CaptureSlots[pos % kCaptureQueueSize]);
+
+            CaptureReadPos = pos + 1;
+            Platform::Semaphore_Post(CaptureFreeSema);
+        }
+
+        // frames queued right before stopping must still be written out
+        if (CaptureStopping && CaptureReadPos == CaptureWritePos) break;
+    }
+}
+
+bool Capture_Start(const char* basepath, bool nodrop)
+{
+    if (CaptureActive) Capture_Stop();
+
+    int len = strlen(basepath) + 5;
+    char* path = new char[len];
+
+    snprintf(path, len, "%s.y4m", basepath);
+    CaptureVideoFile = Platform::OpenFile(path, "wb");
+    snprintf(path, len, "%s.wav", basepath);
+    CaptureAudioFile = Platform::OpenFile(path, "wb");
+
+    delete[] path;
+
+    if (!CaptureVideoFile || !CaptureAudioFile)
+    {
+        printf("capture: failed to open the output files for %s\n", basepath);
+        if (CaptureVideoFile) fclose(CaptureVideoFile);
+        if (CaptureAudioFile) fclose(CaptureAudioFile);
+        CaptureVideoFile = nullptr;
+        CaptureAudioFile = nullptr;
+        return false;
+    }
+
+    // frame rate: 33513982 Hz / (263 lines * 355 dots * 6 cycles)
+    fprintf(CaptureVideoFile, "YUV4MPEG2 W256 H384 F33513982:560190 Ip A1:1 C444 XCOLORRANGE=FULL\n");
+
+    CaptureAudioBytes = 0;
+    WriteWAVHeader(CaptureAudioFile, 0);
+
+    CaptureSlots = new CaptureSlot[kCaptureQueueSize];
+    CapturePlanes = new u8[256*192*2*3];
+    CaptureReadPos = 0;
+    CaptureWritePos = 0;
+    CaptureStopping = false;
+    CaptureNoDrop = nodrop;
+
+    memset(&CaptureStat, 0, sizeof(CaptureStat));
+    CaptureBytesWritten = 0;
+
+    CaptureFilledSema = Platform::Semaphore_Create();
+    CaptureFreeSema = Platform::Semaphore_Create();
+    CaptureThread = Platform::Thread_Create(CaptureThreadFunc);
+
+    CaptureActive = true;
+    return true;
+}
+
+void Capture_Stop()
+{
+    if (!CaptureActive) return;
+
+    // the encoder finishes writing out the queued frames before exiting
+    CaptureStopping = true;
+    Platform::Semaphore_Post(CaptureFilledSema);
+    Platform::Thread_Wait(CaptureThread);
+    Platform::Thread_Free(CaptureThread);
+
+    Platform::Semaphore_Free(CaptureFilledSema);
+    Platform::Semaphore_Free(CaptureFreeSema);
+
+    fclose(CaptureVideoFile);
+    WriteWAVHeader(CaptureAudioFile, CaptureAudioBytes);
+    fclose(CaptureAudioFile);
+    CaptureVideoFile = nullptr;
+    CaptureAudioFile = nullptr;
+
+    delete[] CaptureSlots;
+    delete[] CapturePlanes;
+    CaptureSlots = nullptr;
+    CapturePlanes = nullptr;
+
+    CaptureActive = false;
+
+    printf("capture: %u frames, %u dropped, %u stalls (%.1f ms), max queue depth %d/%d\n",
+           CaptureStat.NumFrames, CaptureStat.NumDropped, CaptureStat.NumStalls,
+           CaptureStat.StallTime, CaptureStat.MaxQueueDepth, kCaptureQueueSize);
+}
+
+bool Capture_IsActive()
+{
+    return CaptureActive;
+}
+
+void Capture_Frame()
+{
+    if (!CaptureActive) return;
+
+    u32 writepos = CaptureWritePos;
+    if ((writepos - CaptureReadPos) >= (u32)kCaptureQueueSize)
+    {
+        if (!CaptureNoDrop)
+        {
+            CaptureStat.NumDropped++;
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        // the encoder posts the semaphore for every slot it frees
+        for (;;)
+        {
+            Platform::Semaphore_Reset(CaptureFreeSema);
+            if ((writepos - CaptureReadPos) < (u32)kCaptureQueueSize) break;
+            Platform::Semaphore_Wait(CaptureFreeSema);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        CaptureStat.NumStalls++;
+        CaptureStat.StallTime += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+    }
+
+    CaptureSlot* slot = &CaptureSlots[writepos % kCaptureQueueSize];
+
+    int fb = GPU::FrontBuffer;
+    memcpy(&slot->Video[0], GPU::Framebuffer[fb][0], 256*192*4);
+    memcpy(&slot->Video[256*192], GPU::Framebuffer[fb][1], 256*192*4);
+
+    s16* audio;
+    int numsamples = SPU::GetFrameOutput(&audio);
+    if (numsamples > 2048) numsamples = 2048;
+    memcpy(slot->Audio, audio, numsamples * 4);
+    slot->NumSamples = numsamples;
+
+    CaptureWritePos = writepos + 1;
+    Platform::Semaphore_Post(CaptureFilledSema);
+
+    CaptureStat.NumFrames++;
+
+    int depth = writepos + 1 - CaptureReadPos;
+    if (depth > CaptureStat.MaxQueueDepth)
+        CaptureStat.MaxQueueDepth = depth;
+}
+
+void Capture_GetStats(CaptureStats* stats)
+{
+    memcpy(stats, &CaptureStat, sizeof(CaptureStats));
+    stats->QueueDepth = CaptureActive ? (CaptureWritePos - CaptureReadPos) : 0;
+    stats->BytesWritten = CaptureBytesWritten;
+}
+
+}
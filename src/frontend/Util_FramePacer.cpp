@@ -0,0 +1,220 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+#include <thread>
+
+#include "FrontendUtil.h"
+
+
+/*
+    Frame pacer
+
+    Frames are scheduled on an absolute timeline: every frame's deadline is
+    the previous one plus the frame period, so rounding errors don't add up
+    over time. If emulation falls behind by more than a few frames, the
+    timeline is restarted from the current time instead of trying to catch up.
+
+    Waiting is done in two steps: the thread sleeps until shortly before the
+    deadline, then spins for the remaining time. The spin margin adapts to how
+    late the OS wakes the thread up.
+
+    In audio mode, the frame period is scaled slightly depending on how full
+    the core's audio output buffer is, so that emulation follows the audio
+    device's clock without ever blocking on it.
+*/
+
+namespace Frontend
+{
+
+typedef std::chrono::steady_clock PacerClock;
+
+const s64 kMinSpinMargin = 200000;   // 0.2ms
+const s64 kMaxSpinMargin = 4000000;  // 4ms
+const int kMaxFramesBehind = 4;
+
+// audio mode: fill level of the core audio output we try to stay around,
+// how strongly the speed reacts to deviations from it, and the maximum
+// speed adjustment
+const double kAudioTargetFill = 1024;
+const double kAudioGain = 0.05;
+const double kAudioMaxAdjust = 0.05;
+
+int PacerMode;
+double DisplayPeriod;
+
+s64 NextDeadline;
+s64 LastFrameStart;
+s64 SpinMargin;
+double AudioFill;
+bool AudioFillValid;
+
+FramePacerStats PacerStats;
+double PacerTimeSum, PacerTimeSqSum;
+
+
+s64 PacerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        PacerClock::now().time_since_epoch()).count();
+}
+
+void FramePacer_Init(int mode)
+{
+    PacerMode = mode;
+    DisplayPeriod = 0;
+    SpinMargin = 1000000;
+
+    FramePacer_Reset();
+    FramePacer_ResetStats();
+}
+
+void FramePacer_SetMode(int mode)
+{
+    if (mode == PacerMode) return;
+
+    PacerMode = mode;
+    AudioFillValid = false;
+}
+
+void FramePacer_SetDisplayRate(double refreshrate, int interval)
+{
+    if (refreshrate > 0 && interval > 0)
+        DisplayPeriod = interval / refreshrate;
+    else
+        DisplayPeriod = 0;
+}
+
+void FramePacer_Reset()
+{
+    NextDeadline = PacerNow();
+    LastFrameStart = 0;
+    AudioFillValid = false;
+}
+
+void FramePacer_ResetStats()
+{
+    memset(&PacerStats, 0, sizeof(PacerStats));
+    PacerStats.BucketSize = FramePacer_BucketSize;
+    PacerTimeSum = 0;
+    PacerTimeSqSum = 0;
+}
+
+void RecordFrameTime(s64 frametime)
+{
+    double ms = frametime / 1000000.0;
+
+    int bucket = (int)(ms / FramePacer_BucketSize);
+    if (bucket >= FramePacer_HistogramSize)
+        bucket = FramePacer_HistogramSize - 1;
+    PacerStats.Histogram[bucket]++;
+
+    PacerStats.NumFrames++;
+    PacerTimeSum += ms;
+    PacerTimeSqSum += ms * ms;
+    if (ms > PacerStats.MaxTime) PacerStats.MaxTime = ms;
+}
+
+double GetFramePeriod(double frametime, int audiofill)
+{
+    double period = frametime;
+
+    // when the display runs at nearly the same rate, follow it exactly
+    // so that every emulated frame is shown for the same amount of refreshes
+    if (DisplayPeriod > 0 && fabs(DisplayPeriod - period) < (period * 0.015))
+        period = DisplayPeriod;
+
+    if (PacerMode == FramePacing_Audio && audiofill >= 0)
+    {
+        if (!AudioFillValid)
+        {
+            AudioFill = audiofill;
+            AudioFillValid = true;
+        }
+        else
+            AudioFill += (audiofill - AudioFill) * 0.1;
+
+        // more audio buffered than needed means emulation is running ahead
+        // of the audio device: slow down a bit, and vice versa
+        double adjust = ((AudioFill - kAudioTargetFill) / kAudioTargetFill) * kAudioGain;
+        if (adjust < -kAudioMaxAdjust) adjust = -kAudioMaxAdjust;
+        if (adjust > kAudioMaxAdjust) adjust = kAudioMaxAdjust;
+
+        period *= (1.0 + adjust);
+    }
+
+    return period;
+}
+
+void FramePacer_Wait(double frametime, int audiofill)
+{
+    s64 period = (s64)(GetFramePeriod(frametime, audiofill) * 1000000000.0);
+
+    s64 now = PacerNow();
+
+    NextDeadline += period;
+    if (now > NextDeadline)
+    {
+        PacerStats.NumLate++;
+
+        if ((now - NextDeadline) > (period * kMaxFramesBehind))
+            NextDeadline = now;
+    }
+
+    s64 sleeptime = NextDeadline - now - SpinMargin;
+    if (sleeptime > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(sleeptime));
+
+        // adjust the margin to how late the OS tends to wake us up
+        s64 oversleep = PacerNow() - (now + sleeptime);
+        if (oversleep > SpinMargin)
+            SpinMargin = (oversleep * 5) / 4;
+        else
+            SpinMargin -= (SpinMargin - oversleep) / 64;
+
+        if (SpinMargin < kMinSpinMargin) SpinMargin = kMinSpinMargin;
+        if (SpinMargin > kMaxSpinMargin) SpinMargin = kMaxSpinMargin;
+    }
+
+    while ((now = PacerNow()) < NextDeadline)
+        std::this_thread::yield();
+
+    if (LastFrameStart)
+        RecordFrameTime(now - LastFrameStart);
+    LastFrameStart = now;
+}
+
+void FramePacer_GetStats(FramePacerStats* stats)
+{
+    memcpy(stats, &PacerStats, sizeof(FramePacerStats));
+
+    if (PacerStats.NumFrames > 0)
+    {
+        double mean = PacerTimeSum / PacerStats.NumFrames;
+        double var = (PacerTimeSqSum / PacerStats.NumFrames) - (mean * mean);
+        stats->MeanTime = mean;
+        stats->StdDev = (var > 0) ? sqrt(var) : 0;
+    }
+}
+
+}
@@ -0,0 +1,471 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "FrontendUtil.h"
+
+#include "Platform.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "RTC.h"
+#include "Savestate.h"
+
+
+/*
+    Input movies
+
+    Console input from the frontend is latched, and only handed to the
+    console at the start of a frame (Input_Apply()). This way, every frame sees
+    one set of input from start to end, which can be recorded and replayed
+    exactly.
+
+    Movie file format (little endian):
+    * header
+      8 bytes: "MELNMOVI"
+      u32: version (1)
+      u32: flags (bit 0: starts from a savestate instead of power-on)
+      u32: console type
+      u32: number of frames
+      4 bytes: game code of the ROM
+      u16: ROM header CRC16
+      u16: reserved
+      u64: RTC time at power-on (see RTC::SetClockBase())
+      u32: length of the savestate, followed by the uncompressed savestate
+    * then for every frame:
+      u16: bit 0-11: key mask (as for NDS::SetKeyMask())
+           bit 12: touching the screen
+           bit 13: lid closed
+           bit 14: microphone input follows
+      u8, u8: touch X/Y
+      if bit 14: u16 number of samples, then the samples (s16)
+
+    The RTC is made to follow emulated time while a movie is active, as the
+    host clock would otherwise make replays diverge.
+*/
+
+namespace Frontend
+{
+
+enum
+{
+    MovieFlag_FromSavestate = (1<<0),
+};
+
+enum
+{
+    MovieInput_Touch = (1<<12),
+    MovieInput_LidClosed = (1<<13),
+    MovieInput_Mic = (1<<14),
+};
+
+const u32 kMovieVersion = 1;
+const int kMovieHeaderSize = 40;
+const int kMaxMicSamples = 1024;
+
+// latched input
+u32 InputKeyMask = 0xFFF;
+std::atomic<u32> InputTouch {0}; // bit 31: touching, bit 0-15: X, bit 16-30: Y
+bool InputTouchApplied = false;
+bool InputLidPending = false;
+bool InputLidClosed;
+s16 InputMic[kMaxMicSamples];
+int InputMicSamples = 0;
+
+// movie
+bool MovieRecording = false;
+bool MoviePlaying = false;
+FILE* MovieFile = nullptr;
+u32 MovieNumFrames;
+u32 MovieCurFrame;
+
+std::vector<u8> MovieData;
+u32 MovieDataPos;
+
+
+static void PutLE16(std::vector<u8>& buf, u16 val)
+{
+    buf.push_back(val & 0xFF);
+    buf.push_back(val >> 8);
+}
+
+static void PutLE32(std::vector<u8>& buf, u32 val)
+{
+    PutLE16(buf, val & 0xFFFF);
+    PutLE16(buf, val >> 16);
+}
+
+static u16 GetLE16(const u8* data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static u32 GetLE32(const u8* data)
+{
+    return GetLE16(&data[0]) | (GetLE16(&data[2]) << 16);
+}
+
+
+void Input_SetKeyMask(u32 mask)
+{
+    InputKeyMask = mask & 0xFFF;
+}
+
+void Input_TouchScreen(u16 x, u16 y)
+{
+    InputTouch = (1U<<31) | (x & 0xFFFF) | ((y & 0x7FFF) << 16);
+}
+
+void Input_ReleaseScreen()
+{
+    InputTouch = 0;
+}
+
+void Input_SetLidClosed(bool closed)
+{
+    InputLidPending = true;
+    InputLidClosed = closed;
+}
+
+void Input_MicFrame(s16* data, int samples)
+{
+    if (!data) samples = 0;
+    if (samples > kMaxMicSamples) samples = kMaxMicSamples;
+
+    if (samples > 0)
+        memcpy(InputMic, data, samples * sizeof(s16));
+    InputMicSamples = samples;
+}
+
+static bool ReadMovieFrame()
+{
+    if (MovieCurFrame >= MovieNumFrames) return false;
+    if ((MovieDataPos + 4) > MovieData.size()) return false;
+
+    const u8* data = &MovieData[MovieDataPos];
+    u16 input = GetLE16(&data[0]);
+
+    InputKeyMask = input & 0xFFF;
+    if (input & MovieInput_Touch)
+        InputTouch = (1U<<31) | data[2] | (data[3] << 16);
+    else
+        InputTouch = 0;
+
+    InputLidPending = true;
+    InputLidClosed = (input & MovieInput_LidClosed) != 0;
+
+    MovieDataPos += 4;
+
+    InputMicSamples = 0;
+    if (input & MovieInput_Mic)
+    {
+        if ((MovieDataPos + 2) > MovieData.size()) return false;
+        int samples = GetLE16(&MovieData[MovieDataPos]);
+        MovieDataPos += 2;
+
+        if (samples > kMaxMicSamples) return false;
+        if ((MovieDataPos + samples*2) > MovieData.size()) return false;
+
+        for (int i = 0; i < samples; i++)
+            InputMic[i] = (s16)GetLE16(&MovieData[MovieDataPos + i*2]);
+        MovieDataPos += samples * 2;
+        InputMicSamples = samples;
+    }
+
+    return true;
+}
+
+static void WriteMovieFrame()
+{
+    u32 touch = InputTouch;
+
+    u16 input = InputKeyMask;
+    if (touch & (1U<<31)) input |= MovieInput_Touch;
+    if (NDS::IsLidClosed()) input |= MovieInput_LidClosed;
+    if (InputMicSamples > 0) input |= MovieInput_Mic;
+
+    u8 frame[4];
+    frame[0] = input & 0xFF;
+    frame[1] = input >> 8;
+    frame[2] = touch & 0xFF;
+    frame[3] = (touch >> 16) & 0xFF;
+    fwrite(frame, 4, 1, MovieFile);
+
+    if (InputMicSamples > 0)
+    {
+        u8 len[2] = {(u8)(InputMicSamples & 0xFF), (u8)(InputMicSamples >> 8)};
+        fwrite(len, 2, 1, MovieFile);
+
+        // samples are written one by one to keep them little endian
+        for (int i = 0; i < InputMicSamples; i++)
+        {
+            u16 sample = InputMic[i];
+            u8 bytes[2] = {(u8)(sample & 0xFF), (u8)(sample >> 8)};
+            fwrite(bytes, 2, 1, MovieFile);
+        }
+    }
+
+    MovieNumFrames++;
+}
+
+void Input_Apply()
+{
+    if (MoviePlaying)
+    {
+        if (!ReadMovieFrame())
+        {
+            printf("movie: playback finished after %u frames\n", MovieCurFrame);
+            Movie_Stop();
+        }
+    }
+
+    NDS::SetKeyMask(InputKeyMask);
+
+    u32 touch = InputTouch;
+    if (touch & (1U<<31))
+    {
+        NDS::TouchScreen(touch & 0xFFFF, (touch >> 16) & 0x7FFF);
+        InputTouchApplied = true;
+    }
+    else if (InputTouchApplied)
+    {
+        NDS::ReleaseScreen();
+        InputTouchApplied = false;
+    }
+
+    // opening the lid raises an IRQ, so only act on actual changes
+    if (InputLidPending)
+    {
+        if (InputLidClosed != NDS::IsLidClosed())
+            NDS::SetLidClosed(InputLidClosed);
+        InputLidPending = false;
+    }
+
+    NDS::MicInputFrame(InputMicSamples > 0 ? InputMic : nullptr, InputMicSamples);
+
+    if (MovieRecording)
+        WriteMovieFrame();
+
+    if (MovieRecording || MoviePlaying)
+        MovieCurFrame++;
+}
+
+
+static u32 SaveMovieState(std::vector<u8>& buf)
+{
+    std::vector<u8> state;
+    u32 len = SaveStateToMemory(state);
+
+    buf.insert(buf.end(), state.begin(), state.begin() + len);
+    return len;
+}
+
+bool Movie_StartRecording(const char* path, bool fromsavestate)
+{
+    Movie_Stop();
+
+    MovieFile = Platform::OpenFile(path, "wb");
+    if (!MovieFile)
+    {
+        printf("movie: failed to create %s\n", path);
+        return false;
+    }
+
+    // keep the clock running from where it is now
+    s64 clockbase = (s64)time(NULL) - (s64)(NDS::SysTimestamp / 33513982);
+    RTC::SetClockBase(clockbase);
+
+    std::vector<u8> header;
+    header.insert(header.end(), (const u8*)"MELNMOVI", (const u8*)"MELNMOVI" + 8);
+    PutLE32(header, kMovieVersion);
+    PutLE32(header, fromsavestate ? MovieFlag_FromSavestate : 0);
+    PutLE32(header, NDS::ConsoleType);
+    PutLE32(header, 0); // number of frames, filled in when done
+    header.insert(header.end(), (const u8*)NDSCart::Header.GameCode, (const u8*)NDSCart::Header.GameCode + 4);
+    PutLE16(header, NDSCart::Header.HeaderCRC16);
+    PutLE16(header, 0);
+    PutLE32(header, (u32)clockbase);
+    PutLE32(header, (u32)(clockbase >> 32));
+
+    u32 statelen = 0;
+    std::vector<u8> state;
+    if (fromsavestate) statelen = SaveMovieState(state);
+
+    PutLE32(header, statelen);
+    fwrite(header.data(), header.size(), 1, MovieFile);
+    if (statelen) fwrite(state.data(), statelen, 1, MovieFile);
+
+    // make sure the first frame without touch input releases the screen,
+    // whatever the state was before
+    InputTouchApplied = true;
+
+    MovieNumFrames = 0;
+    MovieCurFrame = 0;
+    MovieRecording = true;
+    return true;
+}
+
+bool Movie_StartPlayback(const char* path)
+{
+    Movie_Stop();
+
+    FILE* f = Platform::OpenFile(path, "rb", true);
+    if (!f)
+    {
+        printf("movie: failed to open %s\n", path);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    u32 len = (u32)ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    MovieData.resize(len);
+    bool ok = (len >= kMovieHeaderSize) && (fread(MovieData.data(), len, 1, f) == 1);
+    fclose(f);
+
+    const u8* header = MovieData.data();
+    if (!ok || memcmp(header, "MELNMOVI", 8))
+    {
+        printf("movie: %s is not a movie file\n", path);
+        MovieData.clear();
+        return false;
+    }
+
+    u32 version = GetLE32(&header[8]);
+    if (version != kMovieVersion)
+    {
+        printf("movie: unsupported version %u\n", version);
+        MovieData.clear();
+        return false;
+    }
+
+    u32 flags = GetLE32(&header[12]);
+    u32 consoletype = GetLE32(&header[16]);
+    MovieNumFrames = GetLE32(&header[20]);
+    u16 headercrc = GetLE16(&header[28]);
+    s64 clockbase = (s64)((u64)GetLE32(&header[32]) | ((u64)GetLE32(&header[36]) << 32));
+
+    if ((int)consoletype != NDS::ConsoleType)
+    {
+        printf("movie: recorded in %s mode\n", consoletype ? "DSi" : "DS");
+        MovieData.clear();
+        return false;
+    }
+
+    if (memcmp(&header[24], NDSCart::Header.GameCode, 4) || headercrc != NDSCart::Header.HeaderCRC16)
+        printf("movie: recorded with another ROM (%.4s), replay will likely desync\n", (const char*)&header[24]);
+
+    MovieDataPos = kMovieHeaderSize;
+    if ((MovieDataPos + 4) > len)
+    {
+        printf("movie: truncated header\n");
+        MovieData.clear();
+        return false;
+    }
+
+    u32 statelen = GetLE32(&header[MovieDataPos]);
+    MovieDataPos += 4;
+
+    if (flags & MovieFlag_FromSavestate)
+    {
+        if (statelen == 0 || (MovieDataPos + statelen) > len)
+        {
+            printf("movie: truncated savestate\n");
+            MovieData.clear();
+            return false;
+        }
+
+        Savestate* state = new Savestate(&MovieData[MovieDataPos], statelen, false);
+        NDS::DoSavestate(state);
+        bool error = state->Error;
+        delete state;
+
+        if (error)
+        {
+            printf("movie: failed to load the savestate\n");
+            MovieData.clear();
+            return false;
+        }
+    }
+    MovieDataPos += statelen;
+
+    RTC::SetClockBase(clockbase);
+
+    // start from the same touch state as when recording
+    InputTouchApplied = true;
+
+    MovieCurFrame = 0;
+    MoviePlaying = true;
+    return true;
+}
+
+void Movie_Stop()
+{
+    if (MovieRecording)
+    {
+        // fill in the number of frames
+        u8 numframes[4];
+        numframes[0] = MovieNumFrames & 0xFF;
+        numframes[1] = (MovieNumFrames >> 8) & 0xFF;
+        numframes[2] = (MovieNumFrames >> 16) & 0xFF;
+        numframes[3] = MovieNumFrames >> 24;
+        fseek(MovieFile, 20, SEEK_SET);
+        fwrite(numframes, 4, 1, MovieFile);
+
+        fclose(MovieFile);
+        MovieFile = nullptr;
+
+        printf("movie: recorded %u frames\n", MovieNumFrames);
+    }
+
+    if (MovieRecording || MoviePlaying)
+        RTC::SetClockBase(-1);
+
+    MovieRecording = false;
+    MoviePlaying = false;
+    MovieData.clear();
+    MovieData.shrink_to_fit();
+}
+
+bool Movie_IsRecording()
+{
+    return MovieRecording;
+}
+
+bool Movie_IsPlaying()
+{
+    return MoviePlaying;
+}
+
+u32 Movie_GetNumFrames()
+{
+    return MovieNumFrames;
+}
+
+u32 Movie_GetCurFrame()
+{
+    return MovieCurFrame;
+}
+
+}
@@ -296,6 +296,8 @@ int LoadBIOS()
     NDS::LoadBIOS();
 
     SavestateLoaded = false;
+    Rewind_Reset();
+    Movie_Stop();
 
     LoadCheats();
 
@@ -355,6 +357,8 @@ int LoadROM(const u8 *romdata, u32 romlength, const char *archivefilename, const
     if (slot == ROMSlot_NDS && NDS::LoadROM(romdata, romlength, SRAMPath[slot], directboot))
     {
         SavestateLoaded = false;
+        Rewind_Reset();
+        Movie_Stop();
 
         LoadCheats();
 
@@ -368,6 +372,8 @@ int LoadROM(const u8 *romdata, u32 romlength, const char *archivefilename, const
     else if (slot == ROMSlot_GBA && NDS::LoadGBAROM(romdata, romlength, romfilename, SRAMPath[slot]))
     {
         SavestateLoaded = false; // checkme??
+        Rewind_Reset();
+        Movie_Stop();
 
         strncpy(PrevSRAMPath[slot], SRAMPath[slot], 1024); // safety
         return Load_OK;
@@ -438,6 +444,8 @@ int LoadROM(const char* file, int slot)
     if (slot == ROMSlot_NDS && NDS::LoadROM(ROMPath[slot], SRAMPath[slot], directboot))
     {
         SavestateLoaded = false;
+        Rewind_Reset();
+        Movie_Stop();
 
         LoadCheats();
 
@@ -451,6 +459,8 @@ int LoadROM(const char* file, int slot)
     else if (slot == ROMSlot_GBA && NDS::LoadGBAROM(ROMPath[slot], SRAMPath[slot]))
     {
         SavestateLoaded = false; // checkme??
+        Rewind_Reset();
+        Movie_Stop();
 
         strncpy(PrevSRAMPath[slot], SRAMPath[slot], 1024); // safety
         return Load_OK;
@@ -582,6 +592,8 @@ int Reset()
     }
 
     SavestateLoaded = false;
+    Rewind_Reset();
+    Movie_Stop();
 
     NDS::SetConsoleType(Config::ConsoleType);
 
@@ -776,6 +788,8 @@ bool LoadState(const char* filename)
         OSD::AddMessage(0, msg);*/
 
         SavestateLoaded = true;
+        Rewind_Reset();
+        Movie_Stop();
     }
 
     return !failed;
@@ -819,6 +833,9 @@ void UndoStateLoad()
     NDS::DoSavestate(backup);
     delete backup;
 
+    Rewind_Reset();
+    Movie_Stop();
+
     if (ROMPath[ROMSlot_NDS][0]!='\0')
     {
         strncpy(SRAMPath[ROMSlot_NDS], PrevSRAMPath[ROMSlot_NDS], 1024);
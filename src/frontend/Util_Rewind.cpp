@@ -0,0 +1,329 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "FrontendUtil.h"
+
+#include "NDS.h"
+#include "Savestate.h"
+
+
+/*
+    Rewind buffer
+
+    Every RewindInterval frames, the emulator state is captured into a
+    memory-backed savestate. Every RewindKeyInterval-th capture is a keyframe,
+    the other captures are stored as the XOR difference against the keyframe
+    preceding them. Since most of the state doesn't change from one frame to
+    the next, the difference is mostly zeroes, which is then packed with a
+    simple zero-run encoding:
+
+    * the state is processed as 64-bit words
+    * repeated: varint zero word count, varint literal word count, literal words
+    * the last len%8 bytes are stored as-is (XORed)
+
+    Restoring any capture only requires decoding its keyframe (which is cached)
+    and one delta, so stepping backwards is cheap regardless of the history depth.
+*/
+
+namespace Frontend
+{
+
+struct RewindEntry
+{
+    std::vector<u8> Data;
+    u32 Length;     // length of the decoded savestate
+    u32 KeyframeID;
+    u32 KeyframeDist; // number of captures since the keyframe, 0 for keyframes
+};
+
+bool RewindEnabled = false;
+int RewindDepth;
+int RewindInterval;
+int RewindKeyInterval;
+u64 RewindMaxMemory;
+
+std::deque<RewindEntry> RewindEntries;
+u64 RewindMemory;
+int RewindFrameCount;
+u32 RewindNextKeyframeID;
+
+std::vector<u8> RewindScratch;
+std::vector<u8> RewindKeyframe;
+u32 RewindKeyframeID;
+std::vector<u8> RewindZero; // reference for keyframes, only ever holds zeroes
+
+RewindStats RewindStat;
+
+
+static inline u64 LoadWord(const u8* ptr)
+{
+    u64 ret;
+    memcpy(&ret, ptr, 8);
+    return ret;
+}
+
+static inline void PutVarint(std::vector<u8>& out, u32 val)
+{
+    while (val >= 0x80)
+    {
+        out.push_back((val & 0x7F) | 0x80);
+        val >>= 7;
+    }
+    out.push_back(val);
+}
+
+static inline u32 GetVarint(const u8*& in)
+{
+    u32 ret = 0;
+    int shift = 0;
+    for (;;)
+    {
+        u8 b = *in++;
+        ret |= (b & 0x7F) << shift;
+        if (!(b & 0x80)) return ret;
+        shift += 7;
+    }
+}
+
+// 'ref' must be at least 'len' bytes long
+static void EncodeState(const u8* src, const u8* ref, u32 len, std::vector<u8>& out)
+{
+    out.clear();
+
+    u32 nwords = len >> 3;
+    u32 i = 0;
+    while (i < nwords)
+    {
+        u32 zstart = i;
+        while (i < nwords && LoadWord(&src[i<<3]) == LoadWord(&ref[i<<3])) i++;
+
+        u32 lstart = i;
+        while (i < nwords && LoadWord(&src[i<<3]) != LoadWord(&ref[i<<3])) i++;
+
+        PutVarint(out, lstart - zstart);
+        PutVarint(out, i - lstart);
+
+        u32 pos = out.size();
+        out.resize(pos + ((i - lstart) << 3));
+        for (u32 j = lstart; j < i; j++)
+        {
+            u64 val = LoadWord(&src[j<<3]) ^ LoadWord(&ref[j<<3]);
+            memcpy(&out[pos], &val, 8);
+            pos += 8;
+        }
+    }
+
+    for (u32 j = nwords << 3; j < len; j++)
+        out.push_back(src[j] ^ ref[j]);
+
+    out.shrink_to_fit();
+}
+
+static void DecodeState(const std::vector<u8>& in, const u8* ref, u32 len, u8* dst)
+{
+    const u8* ptr = in.data();
+
+    u32 nwords = len >> 3;
+    u32 i = 0;
+    while (i < nwords)
+    {
+        u32 zlen = GetVarint(ptr);
+        u32 llen = GetVarint(ptr);
+
+        memcpy(&dst[i<<3], &ref[i<<3], zlen << 3);
+        i += zlen;
+
+        for (u32 j = 0; j < llen; j++, i++)
+        {
+            u64 val = LoadWord(ptr) ^ LoadWord(&ref[i<<3]);
+            memcpy(&dst[i<<3], &val, 8);
+            ptr += 8;
+        }
+    }
+
+    for (u32 j = nwords << 3; j < len; j++)
+        dst[j] = *ptr++ ^ ref[j];
+}
+
+static double TimeSince(std::chrono::steady_clock::time_point start)
+{
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+void Rewind_Init(bool enable, int depth, int interval, int keyinterval, int maxmemory)
+{
+    RewindEnabled = enable;
+    RewindDepth = depth > 1 ? depth : 1;
+    RewindInterval = interval > 1 ? interval : 1;
+    RewindKeyInterval = keyinterval > 1 ? keyinterval : 1;
+    // the history is trimmed a keyframe at a time
+    if (RewindKeyInterval > RewindDepth) RewindKeyInterval = RewindDepth;
+    RewindMaxMemory = (u64)(maxmemory > 1 ? maxmemory : 1) << 20;
+
+    Rewind_Reset();
+
+    if (!RewindEnabled)
+    {
+        std::vector<u8>().swap(RewindScratch);
+        std::vector<u8>().swap(RewindKeyframe);
+        std::vector<u8>().swap(RewindZero);
+    }
+}
+
+void Rewind_Reset()
+{
+    RewindEntries.clear();
+    RewindMemory = 0;
+    RewindFrameCount = 0;
+    RewindKeyframeID = -1;
+
+    memset(&RewindStat, 0, sizeof(RewindStat));
+}
+
+static const u8* GetZeroState(u32 len)
+{
+    if (RewindZero.size() < len) RewindZero.resize(len, 0);
+    return RewindZero.data();
+}
+
+// make sure the keyframe the given entry depends on is the one held in RewindKeyframe
+static void CacheKeyframe(u32 index)
+{
+    RewindEntry& entry = RewindEntries[index];
+    if (RewindKeyframeID == entry.KeyframeID) return;
+
+    RewindEntry& keyframe = RewindEntries[index - entry.KeyframeDist];
+
+    RewindKeyframe.resize(keyframe.Length);
+    DecodeState(keyframe.Data, GetZeroState(keyframe.Length), keyframe.Length, RewindKeyframe.data());
+    RewindKeyframeID = keyframe.KeyframeID;
+}
+
+void Rewind_Capture()
+{
+    if (!RewindEnabled) return;
+
+    RewindFrameCount++;
+    if (RewindFrameCount < RewindInterval) return;
+    RewindFrameCount = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    u32 len = SaveStateToMemory(RewindScratch);
+
+    RewindEntry entry;
+    entry.Length = len;
+
+    if (RewindEntries.empty() || (RewindEntries.back().KeyframeDist+1) >= (u32)RewindKeyInterval)
+    {
+        entry.KeyframeID = RewindNextKeyframeID++;
+        entry.KeyframeDist = 0;
+
+        RewindKeyframe.assign(RewindScratch.begin(), RewindScratch.begin() + len);
+        RewindKeyframeID = entry.KeyframeID;
+
+        EncodeState(RewindScratch.data(), GetZeroState(len), len, entry.Data);
+    }
+    else
+    {
+        entry.KeyframeID = RewindEntries.back().KeyframeID;
+        entry.KeyframeDist = RewindEntries.back().KeyframeDist + 1;
+
+        CacheKeyframe(RewindEntries.size() - 1);
+        if (RewindKeyframe.size() < len) RewindKeyframe.resize(len, 0);
+        EncodeState(RewindScratch.data(), RewindKeyframe.data(), len, entry.Data);
+    }
+
+    RewindMemory += entry.Data.size();
+    RewindStat.LastStateSize = len;
+    RewindStat.LastEncodedSize = entry.Data.size();
+    RewindEntries.push_back(std::move(entry));
+
+    // drop the oldest history, along with deltas that no longer have a keyframe
+    // the newest keyframe is always kept, as everything after it depends on it
+    while (RewindEntries.front().KeyframeID != RewindEntries.back().KeyframeID &&
+           (RewindEntries.size() > (u32)RewindDepth || RewindMemory > RewindMaxMemory))
+    {
+        do
+        {
+            RewindMemory -= RewindEntries.front().Data.size();
+            RewindEntries.pop_front();
+        }
+        while (!RewindEntries.empty() && RewindEntries.front().KeyframeDist != 0);
+    }
+
+    RewindStat.NumStates = RewindEntries.size();
+    RewindStat.MemoryUsage = RewindMemory;
+    RewindStat.LastCaptureTime = TimeSince(start);
+}
+
+bool Rewind_Step()
+{
+    if (!RewindEnabled) return false;
+    if (RewindEntries.empty()) return false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    RewindEntry& entry = RewindEntries.back();
+    u32 len = entry.Length;
+
+    CacheKeyframe(RewindEntries.size() - 1);
+    if (RewindKeyframe.size() < len) RewindKeyframe.resize(len, 0);
+
+    u8* data;
+    if (entry.KeyframeDist == 0)
+    {
+        data = RewindKeyframe.data();
+    }
+    else
+    {
+        if (RewindScratch.size() < len) RewindScratch.resize(len);
+        DecodeState(entry.Data, RewindKeyframe.data(), len, RewindScratch.data());
+        data = RewindScratch.data();
+    }
+
+    Savestate* state = new Savestate(data, len, false);
+    NDS::DoSavestate(state);
+    delete state;
+
+    RewindMemory -= entry.Data.size();
+    RewindEntries.pop_back();
+    RewindFrameCount = 0;
+
+    RewindStat.NumStates = RewindEntries.size();
+    RewindStat.MemoryUsage = RewindMemory;
+    RewindStat.LastRestoreTime = TimeSince(start);
+
+    return true;
+}
+
+void Rewind_GetStats(RewindStats* stats)
+{
+    *stats = RewindStat;
+}
+
+}
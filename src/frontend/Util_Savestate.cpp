@@ -0,0 +1,49 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "FrontendUtil.h"
+
+#include "NDS.h"
+#include "Savestate.h"
+
+
+namespace Frontend
+{
+
+u32 SaveStateToMemory(std::vector<u8>& buf)
+{
+    if (buf.size() < 0x800000)
+        buf.resize(0x800000);
+
+    for (;;)
+    {
+        Savestate* state = new Savestate(buf.data(), buf.size(), true);
+        NDS::DoSavestate(state);
+
+        // Length() finishes the savestate, which may run out of space too
+        u32 len = state->Length();
+        bool overflow = state->Error;
+        delete state;
+
+        if (!overflow) return len;
+
+        buf.resize(buf.size() * 2);
+    }
+}
+
+}
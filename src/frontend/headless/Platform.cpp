@@ -0,0 +1,266 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "Platform.h"
+
+
+char* EmuDirectory;
+
+void emuStop();
+
+
+namespace Platform
+{
+
+void Init(int argc, char** argv)
+{
+    // the headless runner behaves like a portable build: files are looked up
+    // in the current directory first, then next to the executable
+    if (argc > 0 && strlen(argv[0]) > 0)
+    {
+        int len = strlen(argv[0]);
+        while (len > 0)
+        {
+            if (argv[0][len] == '/') break;
+            len--;
+        }
+        if (len > 0)
+        {
+            EmuDirectory = new char[len+1];
+            strncpy(EmuDirectory, argv[0], len);
+            EmuDirectory[len] = '\0';
+            return;
+        }
+    }
+
+    EmuDirectory = new char[2];
+    strcpy(EmuDirectory, ".");
+}
+
+void DeInit()
+{
+    delete[] EmuDirectory;
+}
+
+
+void StopEmu()
+{
+    emuStop();
+}
+
+
+FILE* OpenFile(const char* path, const char* mode, bool mustexist)
+{
+    if (mustexist && access(path, F_OK) != 0)
+        return nullptr;
+
+    return fopen(path, mode);
+}
+
+FILE* OpenLocalFile(const char* path, const char* mode)
+{
+    if (path[0] == '/')
+        return OpenFile(path, mode, mode[0] != 'w');
+
+    FILE* f = OpenFile(path, mode, true);
+    if (f) return f;
+
+    int len = strlen(EmuDirectory) + 1 + strlen(path) + 1;
+    char* fullpath = new char[len];
+    snprintf(fullpath, len, "%s/%s", EmuDirectory, path);
+    f = OpenFile(fullpath, mode, mode[0] != 'w');
+    delete[] fullpath;
+
+    return f;
+}
+
+FILE* OpenDataFile(const char* path)
+{
+    return OpenLocalFile(path, "rb");
+}
+
+
+struct Thread
+{
+    std::thread Handle;
+};
+
+Thread* Thread_Create(std::function<void()> func)
+{
+    Thread* t = new Thread;
+    t->Handle = std::thread(func);
+    return t;
+}
+
+void Thread_Free(Thread* thread)
+{
+    if (thread->Handle.joinable())
+        thread->Handle.detach();
+    delete thread;
+}
+
+void Thread_Wait(Thread* thread)
+{
+    if (thread->Handle.joinable())
+        thread->Handle.join();
+}
+
+
+struct Semaphore
+{
+    std::mutex Lock;
+    std::condition_variable Cond;
+    int Count;
+};
+
+Semaphore* Semaphore_Create()
+{
+    Semaphore* sema = new Semaphore;
+    sema->Count = 0;
+    return sema;
+}
+
+void Semaphore_Free(Semaphore* sema)
+{
+    delete sema;
+}
+
+void Semaphore_Reset(Semaphore* sema)
+{
+    std::lock_guard<std::mutex> lock(sema->Lock);
+    sema->Count = 0;
+}
+
+void Semaphore_Wait(Semaphore* sema)
+{
+    std::unique_lock<std::mutex> lock(sema->Lock);
+    sema->Cond.wait(lock, [sema] { return sema->Count > 0; });
+    sema->Count--;
+}
+
+void Semaphore_Post(Semaphore* sema, int count)
+{
+    std::lock_guard<std::mutex> lock(sema->Lock);
+    sema->Count += count;
+    sema->Cond.notify_all();
+}
+
+
+struct Mutex
+{
+    std::mutex Lock;
+};
+
+Mutex* Mutex_Create()
+{
+    return new Mutex;
+}
+
+void Mutex_Free(Mutex* mutex)
+{
+    delete mutex;
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+    mutex->Lock.lock();
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+    mutex->Lock.unlock();
+}
+
+bool Mutex_TryLock(Mutex* mutex)
+{
+    return mutex->Lock.try_lock();
+}
+
+
+// instances run in isolation: there is no wifi or network connectivity
+
+bool MP_Init()
+{
+    return false;
+}
+
+void MP_DeInit()
+{
+}
+
+int MP_SendPacket(u8* data, int len, u64 timestamp)
+{
+    return len;
+}
+
+int MP_RecvPacket(u8* data, bool block, u64* timestamp)
+{
+    return 0;
+}
+
+bool MP_Lockstep()
+{
+    return false;
+}
+
+u64 MP_SyncTime(u64 timestamp, bool host, bool client)
+{
+    return UINT64_MAX;
+}
+
+void MP_WaitReplies(u64 timestamp)
+{
+}
+
+
+bool LAN_Init()
+{
+    return false;
+}
+
+void LAN_DeInit()
+{
+}
+
+int LAN_SendPacket(u8* data, int len)
+{
+    return len;
+}
+
+int LAN_RecvPacket(u8* data)
+{
+    return 0;
+}
+
+
+void Sleep(u64 usecs)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+}
+
+}
@@ -0,0 +1,547 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// headless batch runner
+//
+// runs several independent consoles side by side, without any video/audio/input,
+// and reports a hash of the final frame of each along with timing.
+// optionally, the video and audio output can be recorded (see Util_Capture.cpp),
+// input can be replayed from a movie (see Util_Movie.cpp), and the video and
+// audio output of every frame can be hashed to check that two runs are identical.
+// the emulated state can also be hashed every frame (see StateHash.h), and
+// compared against hashes written by another build, to find out at which frame
+// and in which subsystem two builds start behaving differently.
+//
+// the core keeps its state in namespace globals, so one process can only
+// host one console. running several consoles on threads of one process
+// would need all of that state moved into a console object, including the
+// JIT, which bakes the addresses of CPU state and memory into generated
+// code. that isn't done. instead, each instance is a forked child process:
+// * the parent only parses the config, so there is no emulator state to
+//   inherit (the JIT fastmem arena is a shared mapping and must not be
+//   created before forking)
+// * each child calls NDS::Init and loads the BIOS and firmware itself, so
+//   every instance has its own copy of those and its own JIT arena
+// * ROM images are mapped privately from the file (see NDSCart::MapROM), so
+//   the ROM data is the only thing the instances share, through the page cache
+// * results come back to the parent over a pipe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <chrono>
+
+#include "Platform.h"
+#include "PlatformConfig.h"
+#include "FrontendUtil.h"
+
+#include "NDS.h"
+#include "GPU.h"
+#include "SPU.h"
+#include "StateHash.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+
+struct InstanceResult
+{
+    int Num;
+    int Status; // 0 = OK
+    u32 Frames;
+    u64 Hash;
+    u64 RunHash; // hash of all the per-frame hashes, if enabled
+    s32 DivergedFrame; // first frame whose state differs from the reference, -1 if none
+    u32 DivergedRegions; // which parts of the state differed, see StateHash.h
+    u64 IdleCycles[2]; // system cycles skipped over idle loops by the interpreter, per CPU
+    u64 EmuCycles;
+    u64 TimeUS;
+};
+
+const char* ROMPath = nullptr;
+const char* CapturePath = nullptr;
+const char* MoviePath = nullptr;
+const char* HashPath = nullptr;
+const char* StateHashPath = nullptr;
+const char* RefHashPath = nullptr;
+bool FullStateHash = false;
+int NumInstances = 1;
+int NumFrames = 0;
+bool Verbose = false;
+
+bool StopRequested = false;
+
+
+void emuStop()
+{
+    StopRequested = true;
+}
+
+
+void WriteStateHash(FILE* f, u32 frame, StateHash::Result* hash)
+{
+    fprintf(f, "%u %016llX", frame, (unsigned long long)hash->Combined);
+    for (int i = 0; i < StateHash::Region_MAX; i++)
+        fprintf(f, " %016llX", (unsigned long long)hash->Region[i]);
+    fprintf(f, "\n");
+}
+
+// returns false at the end of the file
+bool ReadStateHash(FILE* f, u32* frame, StateHash::Result* hash)
+{
+    char line[512];
+    for (;;)
+    {
+        if (!fgets(line, sizeof(line), f))
+            return false;
+        if (line[0] != '#')
+            break;
+    }
+
+    char* ptr = line;
+    char* end;
+    *frame = strtoul(ptr, &end, 10);
+    if (end == ptr) return false;
+    ptr = end;
+
+    hash->Combined = strtoull(ptr, &end, 16);
+    if (end == ptr) return false;
+    ptr = end;
+
+    for (int i = 0; i < StateHash::Region_MAX; i++)
+    {
+        hash->Region[i] = strtoull(ptr, &end, 16);
+        if (end == ptr) return false;
+        ptr = end;
+    }
+
+    return true;
+}
+
+void PrintRegions(u32 regions)
+{
+    bool first = true;
+    for (int i = 0; i < StateHash::Region_MAX; i++)
+    {
+        if (!(regions & (1<<i))) continue;
+
+        printf("%s%s", first ? "" : ", ", StateHash::RegionNames[i]);
+        first = false;
+    }
+}
+
+
+int RunInstance(int num, InstanceResult* res)
+{
+    memset(res, 0, sizeof(InstanceResult));
+    res->Num = num;
+    res->DivergedFrame = -1;
+
+    // DSi mode needs the NAND to be set up, which is the Qt frontend's job
+    NDS::SetConsoleType(0);
+
+    if (!NDS::Init())
+        return 1;
+
+    GPU::RenderSettings settings;
+    settings.Soft_Threaded = Config::Threaded3D != 0;
+    settings.GL_ScaleFactor = 1;
+    settings.GL_BetterPolygons = false;
+
+    GPU::InitRenderer(0);
+    GPU::SetRenderSettings(0, settings);
+
+    if (ROMPath)
+    {
+        // no save file: all the instances would be fighting over it
+        if (!NDS::LoadROM(ROMPath, "", Config::DirectBoot != 0))
+            return 2;
+    }
+    else
+    {
+        NDS::LoadBIOS();
+    }
+
+    u32 numframes = NumFrames;
+    if (MoviePath)
+    {
+        if (!Frontend::Movie_StartPlayback(MoviePath))
+            return 4;
+
+        if (numframes == 0)
+            numframes = Frontend::Movie_GetNumFrames();
+    }
+    if (numframes == 0)
+        numframes = 600;
+
+    char path[1024];
+
+    if (CapturePath)
+    {
+        // every instance gets its own files
+        if (NumInstances > 1)
+            snprintf(path, sizeof(path), "%s_%d", CapturePath, num);
+        else
+            snprintf(path, sizeof(path), "%s", CapturePath);
+
+        // batch captures are evidence, so they must not have missing frames
+        if (!Frontend::Capture_Start(path, true))
+            return 3;
+    }
+
+    FILE* hashfile = nullptr;
+    if (HashPath)
+    {
+        if (NumInstances > 1)
+            snprintf(path, sizeof(path), "%s_%d", HashPath, num);
+        else
+            snprintf(path, sizeof(path), "%s", HashPath);
+
+        hashfile = Platform::OpenFile(path, "w");
+        if (!hashfile)
+            return 3;
+    }
+
+    FILE* statefile = nullptr;
+    if (StateHashPath)
+    {
+        if (NumInstances > 1)
+            snprintf(path, sizeof(path), "%s_%d", StateHashPath, num);
+        else
+            snprintf(path, sizeof(path), "%s", StateHashPath);
+
+        statefile = Platform::OpenFile(path, "w");
+        if (!statefile)
+            return 3;
+
+        fprintf(statefile, "# frame combined");
+        for (int i = 0; i < StateHash::Region_MAX; i++)
+            fprintf(statefile, " %s", StateHash::RegionNames[i]);
+        fprintf(statefile, "\n");
+    }
+
+    // every instance compares against the same reference
+    FILE* reffile = nullptr;
+    if (RefHashPath)
+    {
+        reffile = Platform::OpenFile(RefHashPath, "r");
+        if (!reffile)
+            return 5;
+    }
+
+    if (statefile || reffile)
+        StateHash::SetEnabled(true);
+
+    XXH3_state_t* runhash = XXH3_createState();
+    XXH3_64bits_reset(runhash);
+
+    auto start = std::chrono::steady_clock::now();
+
+    u32 frame;
+    for (frame = 0; frame < numframes && !StopRequested; frame++)
+    {
+        Frontend::Input_Apply();
+
+        NDS::RunFrame();
+
+        NDS::IdleLoopStats idlestats;
+        NDS::GetIdleLoopStats(&idlestats);
+        res->IdleCycles[0] += idlestats.SkippedCycles[0];
+        res->IdleCycles[1] += idlestats.SkippedCycles[1];
+        res->EmuCycles += idlestats.FrameCycles;
+
+        Frontend::Capture_Frame();
+
+        if (statefile || reffile)
+        {
+            StateHash::Result hash;
+            StateHash::Compute(&hash, FullStateHash);
+
+            if (statefile)
+                WriteStateHash(statefile, frame, &hash);
+
+            // only the first divergence is interesting, everything after
+            // it is likely to differ too
+            if (reffile && res->DivergedFrame < 0)
+            {
+                u32 refframe;
+                StateHash::Result ref;
+                if (!ReadStateHash(reffile, &refframe, &ref))
+                {
+                    fclose(reffile);
+                    reffile = nullptr;
+                }
+                else if (refframe != frame || ref.Combined != hash.Combined)
+                {
+                    res->DivergedFrame = frame;
+                    for (int i = 0; i < StateHash::Region_MAX; i++)
+                    {
+                        if (ref.Region[i] != hash.Region[i])
+                            res->DivergedRegions |= (1<<i);
+                    }
+                }
+            }
+        }
+
+        if (hashfile)
+        {
+            int fb = GPU::FrontBuffer;
+            u64 videohash = XXH3_64bits(GPU::Framebuffer[fb][0], 256*192*4);
+            videohash = XXH3_64bits_withSeed(GPU::Framebuffer[fb][1], 256*192*4, videohash);
+
+            s16* audio;
+            int numsamples = SPU::GetFrameOutput(&audio);
+            u64 audiohash = XXH3_64bits(audio, numsamples * 4);
+
+            fprintf(hashfile, "%u %016llX %016llX\n", frame,
+                    (unsigned long long)videohash, (unsigned long long)audiohash);
+
+            XXH3_64bits_update(runhash, &videohash, sizeof(videohash));
+            XXH3_64bits_update(runhash, &audiohash, sizeof(audiohash));
+        }
+
+        // nobody is listening, but the buffer must not fill up
+        SPU::DrainOutput();
+    }
+
+    Frontend::Capture_Stop();
+
+    auto end = std::chrono::steady_clock::now();
+
+    Frontend::Movie_Stop();
+
+    if (hashfile)
+    {
+        fclose(hashfile);
+        res->RunHash = XXH3_64bits_digest(runhash);
+    }
+    XXH3_freeState(runhash);
+
+    if (statefile) fclose(statefile);
+    if (reffile) fclose(reffile);
+    StateHash::SetEnabled(false);
+
+    // the top screen's hash seeds the bottom screen's
+    int fb = GPU::FrontBuffer;
+    u64 hash = XXH3_64bits(GPU::Framebuffer[fb][0], 256*192*4);
+    res->Hash = XXH3_64bits_withSeed(GPU::Framebuffer[fb][1], 256*192*4, hash);
+
+    res->Frames = frame;
+    res->TimeUS = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    GPU::DeInitRenderer();
+    NDS::DeInit();
+
+    return 0;
+}
+
+
+void PrintUsage(const char* name)
+{
+    printf("usage: %s [-n instances] [-f frames] [-m movie] [-H hashes] [-S statehashes] [-C reference] [-F] [-c capture] [-v] [rom.nds]\n", name);
+    printf("  -n  number of consoles to run at once, one process each (default: 1)\n");
+    printf("  -f  number of frames to run each console for (default: 600, or the movie's length)\n");
+    printf("  -m  replay input from a movie file\n");
+    printf("  -H  write the hashes of every frame's video and audio output to a file (hashes_N with several instances)\n");
+    printf("  -S  write the hashes of every frame's emulated state to a file (statehashes_N with several instances)\n");
+    printf("  -C  compare the state of every frame against a file written with -S, and report the first difference\n");
+    printf("  -F  rehash all of main RAM every frame instead of only the pages written to (slower, checks -S/-C)\n");
+    printf("  -c  record video and audio to capture.y4m/.wav (capture_N.* with several instances)\n");
+    printf("  -v  show the emulator's output for every instance\n");
+    printf("if no ROM is given, the consoles boot the firmware\n");
+}
+
+int main(int argc, char** argv)
+{
+    printf("melonDS " MELONDS_VERSION " headless\n");
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:c:m:H:S:C:Fvh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': NumInstances = atoi(optarg); break;
+        case 'f': NumFrames = atoi(optarg); break;
+        case 'c': CapturePath = optarg; break;
+        case 'm': MoviePath = optarg; break;
+        case 'H': HashPath = optarg; break;
+        case 'S': StateHashPath = optarg; break;
+        case 'C': RefHashPath = optarg; break;
+        case 'F': FullStateHash = true; break;
+        case 'v': Verbose = true; break;
+        default:
+            PrintUsage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind < argc)
+        ROMPath = argv[optind];
+
+    if (NumInstances < 1 || NumFrames < 0)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Platform::Init(argc, argv);
+    Config::Load();
+
+    // the ROM files don't change during a batch run, so they can be mapped
+    Config::MapROMFiles = 1;
+
+    int pipefd[2];
+    if (pipe(pipefd) != 0)
+    {
+        printf("failed to create the result pipe\n");
+        return 1;
+    }
+
+    fflush(stdout);
+
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t* pids = new pid_t[NumInstances];
+    int numstarted = 0;
+
+    for (int i = 0; i < NumInstances; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            printf("failed to start instance %d\n", i);
+            break;
+        }
+
+        if (pid == 0)
+        {
+            close(pipefd[0]);
+
+            if (!Verbose)
+            {
+                int devnull = open("/dev/null", O_WRONLY);
+                dup2(devnull, STDOUT_FILENO);
+                close(devnull);
+            }
+
+            InstanceResult res;
+            res.Status = RunInstance(i, &res);
+
+            // results are small enough for the write to be atomic
+            write(pipefd[1], &res, sizeof(res));
+            close(pipefd[1]);
+            fflush(stdout);
+            _exit(0);
+        }
+
+        pids[numstarted++] = pid;
+    }
+
+    close(pipefd[1]);
+
+    InstanceResult* results = new InstanceResult[NumInstances];
+    bool* done = new bool[NumInstances];
+    memset(done, 0, NumInstances * sizeof(bool));
+
+    InstanceResult res;
+    while (read(pipefd[0], &res, sizeof(res)) == sizeof(res))
+    {
+        if (res.Num < 0 || res.Num >= NumInstances) continue;
+        results[res.Num] = res;
+        done[res.Num] = true;
+    }
+    close(pipefd[0]);
+
+    for (int i = 0; i < numstarted; i++)
+        waitpid(pids[i], nullptr, 0);
+
+    auto end = std::chrono::steady_clock::now();
+    double walltime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000000.0;
+
+    int numfailed = 0;
+    int numdiverged = 0;
+    u64 totalframes = 0;
+    u64 refhash = 0;
+    bool hasref = false;
+
+    for (int i = 0; i < NumInstances; i++)
+    {
+        if (!done[i])
+        {
+            printf("instance %2d: crashed or not started\n", i);
+            numfailed++;
+            continue;
+        }
+
+        InstanceResult& r = results[i];
+        if (r.Status != 0)
+        {
+            printf("instance %2d: failed to start (error %d)\n", i, r.Status);
+            numfailed++;
+            continue;
+        }
+
+        double time = r.TimeUS / 1000000.0;
+        printf("instance %2d: %u frames in %.3fs (%.1f FPS), hash %016llX\n",
+               i, r.Frames, time, time > 0 ? r.Frames / time : 0.0,
+               (unsigned long long)r.Hash);
+        if (HashPath)
+            printf("             run hash %016llX\n", (unsigned long long)r.RunHash);
+        if ((r.IdleCycles[0] || r.IdleCycles[1]) && r.EmuCycles)
+            printf("             idle loops skipped: ARM9 %.1f%%, ARM7 %.1f%% of the time\n",
+                   r.IdleCycles[0] * 100.0 / r.EmuCycles, r.IdleCycles[1] * 100.0 / r.EmuCycles);
+        if (r.DivergedFrame >= 0)
+        {
+            printf("             diverged from the reference at frame %d (", r.DivergedFrame);
+            PrintRegions(r.DivergedRegions);
+            printf(")\n");
+            numdiverged++;
+        }
+
+        totalframes += r.Frames;
+
+        // all the instances run the same thing and should end up in the same place
+        if (!hasref)
+        {
+            refhash = r.Hash ^ r.RunHash;
+            hasref = true;
+        }
+        else if ((r.Hash ^ r.RunHash) != refhash && r.DivergedFrame < 0)
+            numdiverged++;
+    }
+
+    printf("%d instances, %llu frames in %.3fs (%.1f FPS total)\n",
+           NumInstances, (unsigned long long)totalframes, walltime,
+           walltime > 0 ? totalframes / walltime : 0.0);
+    if (numfailed)
+        printf("%d instance(s) failed\n", numfailed);
+    if (numdiverged)
+        printf("%d instance(s) ended up with a different hash or state\n", numdiverged);
+
+    delete[] done;
+    delete[] results;
+    delete[] pids;
+
+    Platform::DeInit();
+
+    return (numfailed || numdiverged) ? 1 : 0;
+}
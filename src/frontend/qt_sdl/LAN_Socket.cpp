@@ -21,10 +21,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include "Wifi.h"
 #include "LAN_Socket.h"
 #include "Config.h"
-#include "FIFO.h"
+#include "Platform.h"
 
 #include <slirp/libslirp.h>
 
@@ -32,9 +33,14 @@
 	#include <ws2tcpip.h>
 #else
 	#include <sys/socket.h>
+	#include <netinet/in.h>
 	#include <netdb.h>
 	#include <poll.h>
 	#include <time.h>
+	#include <unistd.h>
+	#ifdef __linux__
+		#include <sys/eventfd.h>
+	#endif
 #endif
 
 
@@ -48,12 +54,85 @@ const u32 kClientIP = kSubnet | 0x10;
 
 const u8 kServerMAC[6] = {0x00, 0xAB, 0x33, 0x28, 0x99, 0x44};
 
-FIFO<u32, (0x8000 >> 2)> RXBuffer;
+const int kMaxPacketLen = 2048;
+
+// slirp runs on its own thread, so that the emulator thread never has to
+// poll sockets. packets are handed between the two threads through a pair of
+// single-producer single-consumer queues:
+// * TXQueue: emulator -> slirp
+// * RXQueue: slirp (and the DNS handler) -> emulator
+
+template<int NumSlots>
+struct PacketQueue
+{
+    struct Slot
+    {
+        int Len;
+        u8 Data[kMaxPacketLen];
+    };
+
+    Slot Slots[NumSlots];
+    std::atomic<u32> ReadPos;
+    std::atomic<u32> WritePos;
+
+    void Clear()
+    {
+        ReadPos = 0;
+        WritePos = 0;
+    }
+
+    bool IsEmpty()
+    {
+        return ReadPos.load(std::memory_order_relaxed) == WritePos.load();
+    }
+
+    // returns a free slot to fill, or nullptr if the queue is full
+    Slot* BeginWrite()
+    {
+        u32 wpos = WritePos.load(std::memory_order_relaxed);
+        if ((wpos - ReadPos.load(std::memory_order_acquire)) >= NumSlots)
+            return nullptr;
+
+        return &Slots[wpos % NumSlots];
+    }
+
+    void EndWrite()
+    {
+        WritePos.store(WritePos.load(std::memory_order_relaxed) + 1);
+    }
+
+    // returns the oldest pending slot, or nullptr if the queue is empty
+    Slot* BeginRead()
+    {
+        u32 rpos = ReadPos.load(std::memory_order_relaxed);
+        if (rpos == WritePos.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &Slots[rpos % NumSlots];
+    }
+
+    void EndRead()
+    {
+        ReadPos.store(ReadPos.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+PacketQueue<64> RXQueue;
+PacketQueue<32> TXQueue;
+
+u32 RXDropped, TXDropped;
 
 u32 IPv4ID;
 
 Slirp* Ctx = nullptr;
 
+Platform::Thread* IOThread = nullptr;
+std::atomic<bool> IOThreadRunning;
+
+// set while the I/O thread is (about to be) blocked in poll()
+// the emulator thread only needs to wake it up then
+std::atomic<bool> IOThreadSleeping;
+
 /*const int FDListMax = 64;
 struct pollfd FDList[FDListMax];
 int FDListSize;*/
@@ -81,33 +160,133 @@ int clock_gettime(int, struct timespec *spec)
 #endif // __WIN32__
 
 
-void RXEnqueue(const void* buf, int len)
+// wakeup channel for the I/O thread
+// eventfd where available, otherwise a loopback UDP socket connected to itself
+// (which also works with WSAPoll)
+
+#ifdef __linux__
+
+int WakeFD = -1;
+
+bool WakeInit()
 {
-    int alignedlen = (len + 3) & ~3;
-    int totallen = alignedlen + 4;
+    WakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return WakeFD >= 0;
+}
 
-    if (!RXBuffer.CanFit(totallen >> 2))
+void WakeDeInit()
+{
+    if (WakeFD >= 0) close(WakeFD);
+    WakeFD = -1;
+}
+
+void WakeSignal()
+{
+    u64 val = 1;
+    write(WakeFD, &val, sizeof(val));
+}
+
+void WakeDrain()
+{
+    u64 val;
+    read(WakeFD, &val, sizeof(val));
+}
+
+#else
+
+#ifdef __WIN32__
+typedef SOCKET wakefd_t;
+#define WAKEFD_INVALID INVALID_SOCKET
+#else
+typedef int wakefd_t;
+#define WAKEFD_INVALID -1
+#define closesocket close
+#endif
+
+wakefd_t WakeFD = WAKEFD_INVALID;
+
+bool WakeInit()
+{
+    WakeFD = socket(AF_INET, SOCK_DGRAM, 0);
+    if (WakeFD == WAKEFD_INVALID)
+        return false;
+
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (bind(WakeFD, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        getsockname(WakeFD, (struct sockaddr*)&addr, &addrlen) != 0 ||
+        connect(WakeFD, (struct sockaddr*)&addr, sizeof(addr)) != 0)
     {
-        printf("slirp: !! NOT ENOUGH SPACE IN RX BUFFER\n");
-        return;
+        closesocket(WakeFD);
+        WakeFD = WAKEFD_INVALID;
+        return false;
     }
 
-    u32 header = (alignedlen & 0xFFFF) | (len << 16);
-    RXBuffer.Write(header);
-    for (int i = 0; i < alignedlen; i += 4)
-        RXBuffer.Write(((u32*)buf)[i>>2]);
+    return true;
 }
 
-ssize_t SlirpCbSendPacket(const void* buf, size_t len, void* opaque)
+void WakeDeInit()
+{
+    if (WakeFD != WAKEFD_INVALID) closesocket(WakeFD);
+    WakeFD = WAKEFD_INVALID;
+}
+
+void WakeSignal()
+{
+    char val = 1;
+    send(WakeFD, &val, 1, 0);
+}
+
+void WakeDrain()
 {
-    if (len > 2048)
+    char buf[64];
+    struct pollfd pfd;
+    pfd.fd = WakeFD;
+    pfd.events = POLLIN;
+
+    while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
     {
-        printf("slirp: packet too big (%zu)\n", len);
-        return 0;
+        if (recv(WakeFD, buf, sizeof(buf), 0) <= 0)
+            break;
+    }
+}
+
+#endif
+
+
+// called from the I/O thread only
+void RXEnqueue(const void* buf, size_t len)
+{
+    if (len > (size_t)kMaxPacketLen)
+    {
+        printf("slirp: !! RX PACKET TOO BIG (%zu)\n", len);
+        RXDropped++;
+        return;
     }
 
+    auto slot = RXQueue.BeginWrite();
+    if (!slot)
+    {
+        printf("slirp: !! NOT ENOUGH SPACE IN RX BUFFER\n");
+        RXDropped++;
+        return;
+    }
+
+    memcpy(slot->Data, buf, len);
+    slot->Len = len;
+    RXQueue.EndWrite();
+}
+
+ssize_t SlirpCbSendPacket(const void* buf, size_t len, void* opaque)
+{
     printf("slirp: response packet of %zu bytes, type %04X\n", len, ntohs(((u16*)buf)[6]));
 
+    // oversized packets are dropped by RXEnqueue(), and counted
     RXEnqueue(buf, len);
 
     return len;
@@ -195,10 +374,17 @@ SlirpCb cb =
     .notify = SlirpCbNotify
 };
 
+void IOThreadFunc();
+
 bool Init()
 {
     IPv4ID = 0;
 
+    RXQueue.Clear();
+    TXQueue.Clear();
+    RXDropped = 0;
+    TXDropped = 0;
+
     //FDListSize = 0;
     //memset(FDList, 0, sizeof(FDList));
 
@@ -215,12 +401,41 @@ bool Init()
     *(u32*)&cfg.vnameserver = htonl(kDNSIP);
 
     Ctx = slirp_new(&cfg, &cb, nullptr);
+    if (!Ctx)
+        return false;
+
+    if (!WakeInit())
+    {
+        printf("slirp: failed to create the I/O thread wakeup channel\n");
+        slirp_cleanup(Ctx);
+        Ctx = nullptr;
+        return false;
+    }
+
+    IOThreadRunning = true;
+    IOThreadSleeping = false;
+    IOThread = Platform::Thread_Create(IOThreadFunc);
 
     return true;
 }
 
 void DeInit()
 {
+    if (IOThread)
+    {
+        IOThreadRunning = false;
+        WakeSignal();
+
+        Platform::Thread_Wait(IOThread);
+        Platform::Thread_Free(IOThread);
+        IOThread = nullptr;
+
+        if (RXDropped || TXDropped)
+            printf("slirp: dropped %u RX and %u TX packets\n", RXDropped, TXDropped);
+    }
+
+    WakeDeInit();
+
     if (Ctx)
     {
         slirp_cleanup(Ctx);
@@ -424,33 +639,67 @@ void HandleDNSFrame(u8* data, int len)
     RXEnqueue(resp, framelen);
 }
 
+// called from the I/O thread only
+void ProcessTX()
+{
+    for (;;)
+    {
+        auto slot = TXQueue.BeginRead();
+        if (!slot) break;
+
+        u8* data = slot->Data;
+        int len = slot->Len;
+        bool handled = false;
+
+        u16 ethertype = ntohs(*(u16*)&data[0xC]);
+
+        if (ethertype == 0x800)
+        {
+            u8 protocol = data[0x17];
+            if (protocol == 0x11) // UDP
+            {
+                u16 dstport = ntohs(*(u16*)&data[0x24]);
+                if (dstport == 53 && htonl(*(u32*)&data[0x1E]) == kDNSIP) // DNS
+                {
+                    HandleDNSFrame(data, len);
+                    handled = true;
+                }
+            }
+        }
+
+        if (!handled)
+            slirp_input(Ctx, data, len);
+
+        TXQueue.EndRead();
+    }
+}
+
 int SendPacket(u8* data, int len)
 {
     if (!Ctx) return 0;
 
-    if (len > 2048)
+    if (len > kMaxPacketLen)
     {
         printf("LAN_SendPacket: error: packet too long (%d)\n", len);
         return 0;
     }
 
-    u16 ethertype = ntohs(*(u16*)&data[0xC]);
-
-    if (ethertype == 0x800)
+    auto slot = TXQueue.BeginWrite();
+    if (!slot)
     {
-        u8 protocol = data[0x17];
-        if (protocol == 0x11) // UDP
-        {
-            u16 dstport = ntohs(*(u16*)&data[0x24]);
-            if (dstport == 53 && htonl(*(u32*)&data[0x1E]) == kDNSIP) // DNS
-            {
-                HandleDNSFrame(data, len);
-                return len;
-            }
-        }
+        printf("LAN_SendPacket: error: TX queue full\n");
+        TXDropped++;
+        return 0;
     }
 
-    slirp_input(Ctx, data, len);
+    memcpy(slot->Data, data, len);
+    slot->Len = len;
+    TXQueue.EndWrite();
+
+    // the I/O thread only needs a syscall to wake it up if it is asleep
+    if (IOThreadSleeping.exchange(false))
+        WakeSignal();
+
     return len;
 }
 
@@ -460,7 +709,8 @@ int PollListSize;
 
 int SlirpCbAddPoll(int fd, int events, void* opaque)
 {
-    if (PollListSize >= PollListMax)
+    // the last entry is kept for the wakeup channel
+    if (PollListSize >= PollListMax-1)
     {
         printf("slirp: POLL LIST FULL\n");
         return -1;
@@ -507,31 +757,48 @@ int SlirpCbGetREvents(int idx, void* opaque)
     return ret;
 }
 
-int RecvPacket(u8* data)
+void IOThreadFunc()
 {
-    if (!Ctx) return 0;
-
-    int ret = 0;
-
-    //if (PollListSize > 0)
+    while (IOThreadRunning)
     {
-        u32 timeout = 0;
+        ProcessTX();
+
+        // upper bound, slirp lowers it if its timers need it
+        u32 timeout = 1000;
         PollListSize = 0;
         slirp_pollfds_fill(Ctx, &timeout, SlirpCbAddPoll, nullptr);
+
+        int wakeidx = PollListSize++;
+        PollList[wakeidx].fd = WakeFD;
+        PollList[wakeidx].events = POLLIN;
+        PollList[wakeidx].revents = 0;
+
+        // announce that we're going to sleep, then check for packets that
+        // may have been queued in the meantime
+        IOThreadSleeping = true;
+        if (!TXQueue.IsEmpty() || !IOThreadRunning)
+            timeout = 0;
+
         int res = poll(PollList, PollListSize, timeout);
+        IOThreadSleeping = false;
+
+        if (res > 0 && (PollList[wakeidx].revents & POLLIN))
+            WakeDrain();
+
         slirp_pollfds_poll(Ctx, res<0, SlirpCbGetREvents, nullptr);
     }
+}
 
-    if (!RXBuffer.IsEmpty())
-    {
-        u32 header = RXBuffer.Read();
-        u32 len = header & 0xFFFF;
+int RecvPacket(u8* data)
+{
+    if (!Ctx) return 0;
 
-        for (int i = 0; i < len; i += 4)
-            ((u32*)data)[i>>2] = RXBuffer.Read();
+    auto slot = RXQueue.BeginRead();
+    if (!slot) return 0;
 
-        ret = header >> 16;
-    }
+    int ret = slot->Len;
+    memcpy(data, slot->Data, ret);
+    RXQueue.EndRead();
 
     return ret;
 }
@@ -0,0 +1,774 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef __WIN32__
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <errno.h>
+    #include <time.h>
+    #include <semaphore.h>
+    #include <signal.h>
+    #include <unistd.h>
+#endif
+
+#include <QSharedMemory>
+
+#include "LocalMP.h"
+
+
+namespace LocalMP
+{
+
+// layout of the shared memory:
+// * MPQueueHeader
+// * one MPInstanceState per instance
+// * the packet queue, a ring buffer every instance writes its packets to
+//
+// writers take a spinlock, readers don't lock anything: each instance keeps
+// its own read position and checks that the data it just read wasn't
+// overwritten in the meantime (which means it fell too far behind)
+//
+// the shared memory outlives instances that crash or get killed, so the
+// lock and the instance slots hold the ID of the process that owns them,
+// and are taken back when that process is gone
+//
+// for lockstep, instances publish how far they have gotten in emulated time.
+// those times are on a timeline shared by all instances: an instance joins
+// it where the furthest one is, and keeps an offset to its own timestamps.
+// packets are timestamped on the shared timeline too. packets that come in
+// before they're due are set aside until then, and the emulator is told
+// when to sync next so that it doesn't have to do it every microsecond.
+//
+// everything is zero-initialized when the shared memory is created, which is
+// a valid state for all the fields
+
+const int kMaxInstances = 16;
+const u32 kMaxPacketLen = 2048;
+const u32 kPacketQueueSize = 0x10000;
+const u32 kRecvTimeout = 5000; // in microseconds
+const u32 kStallTimeout = 50000; // in microseconds
+const u32 kLockTimeout = 100000; // in microseconds
+const u64 kSyncInterval = 16; // in emulated microseconds
+const u32 kMaxEarlyPackets = 16;
+const u32 kPacketMagic = 0x4946494E; // NIFI
+
+struct MPQueueHeader
+{
+    std::atomic<u32> WriteLock; // process ID of the holder, 0 if free
+    std::atomic<u32> InstanceBitmask;
+    std::atomic<u32> PacketWriteCount; // total amount of bytes written to the queue
+    u32 Pad[13];
+};
+
+// updated very often, hence one cache line each
+struct MPInstanceState
+{
+    std::atomic<u64> Time;
+    std::atomic<u32> Flags;
+    std::atomic<u32> PID; // process owning the slot, 0 while it's being set up or released
+    u32 Pad[12];
+};
+
+enum
+{
+    InstanceFlag_TimeValid = (1<<0),
+    InstanceFlag_Host = (1<<1),
+    InstanceFlag_Client = (1<<2),
+};
+
+struct MPPacketHeader
+{
+    u32 Magic;
+    u32 SenderID;
+    u32 SeqNum;
+    u32 Length;
+    u64 Timestamp;
+};
+
+// how far a reader can fall behind: there must be room for a packet being
+// written that isn't reflected in PacketWriteCount yet
+const u32 kMaxEntryLen = (sizeof(MPPacketHeader) + kMaxPacketLen + 7) & ~7;
+const u32 kMaxReadBehind = kPacketQueueSize - kMaxEntryLen;
+
+QSharedMemory* MPQueue = nullptr;
+MPQueueHeader* QueueHeader;
+MPInstanceState* InstanceState;
+u8* PacketQueue;
+
+int InstanceID;
+u32 PacketReadCount;
+u32 SeqNum;
+
+struct EarlyPacket
+{
+    u64 Timestamp;
+    u32 SenderID;
+    u32 Length;
+    u8 Data[kMaxPacketLen];
+};
+
+// packets read from the queue before they were due, in the order they came in
+std::vector<EarlyPacket> EarlyPackets;
+
+u32 LastSeqNum[kMaxInstances];
+bool SeqNumValid[kMaxInstances];
+
+u32 NumSent, NumReceived, NumLost;
+
+bool TimeSynced;
+u64 TimeOffset;
+u64 CurTime;
+u64 StalledTime[kMaxInstances];
+
+#ifdef __WIN32__
+HANDLE SemPool[kMaxInstances];
+#else
+sem_t* SemPool[kMaxInstances];
+#endif
+
+
+u32 GetProcessID()
+{
+#ifdef __WIN32__
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+bool ProcessAlive(u32 pid)
+{
+#ifdef __WIN32__
+    HANDLE proc = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (!proc) return GetLastError() == ERROR_ACCESS_DENIED;
+
+    bool alive = WaitForSingleObject(proc, 0) == WAIT_TIMEOUT;
+    CloseHandle(proc);
+    return alive;
+#else
+    return kill(pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+
+bool SemInit(int num)
+{
+    char name[32];
+#ifdef __WIN32__
+    sprintf(name, "Local\\melonNIFI_Sem%02d", num);
+    SemPool[num] = CreateSemaphoreA(nullptr, 0, 0x7FFFFFFF, name);
+    return SemPool[num] != nullptr;
+#else
+    sprintf(name, "/melonNIFI_Sem%02d", num);
+    SemPool[num] = sem_open(name, O_CREAT, 0600, 0);
+    return SemPool[num] != SEM_FAILED;
+#endif
+}
+
+void SemDeInit(int num)
+{
+#ifdef __WIN32__
+    if (SemPool[num]) CloseHandle(SemPool[num]);
+    SemPool[num] = nullptr;
+#else
+    if (SemPool[num] != SEM_FAILED) sem_close(SemPool[num]);
+    SemPool[num] = SEM_FAILED;
+#endif
+}
+
+void SemUnlink(int num)
+{
+#ifndef __WIN32__
+    // named semaphores persist until unlinked (on Windows, they go away
+    // with the last handle)
+    char name[32];
+    sprintf(name, "/melonNIFI_Sem%02d", num);
+    sem_unlink(name);
+#endif
+}
+
+void SemPost(int num)
+{
+#ifdef __WIN32__
+    ReleaseSemaphore(SemPool[num], 1, nullptr);
+#else
+    sem_post(SemPool[num]);
+#endif
+}
+
+bool SemTryWait(int num)
+{
+#ifdef __WIN32__
+    return WaitForSingleObject(SemPool[num], 0) == WAIT_OBJECT_0;
+#else
+    return sem_trywait(SemPool[num]) == 0;
+#endif
+}
+
+void SemWait(int num, u32 timeout)
+{
+#if defined(__WIN32__)
+    WaitForSingleObject(SemPool[num], (timeout + 999) / 1000);
+#elif defined(__APPLE__)
+    // no sem_timedwait() there
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout);
+    while (sem_trywait(SemPool[num]) != 0)
+    {
+        if (std::chrono::steady_clock::now() >= end) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += timeout * 1000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+    while (sem_timedwait(SemPool[num], &ts) != 0 && errno == EINTR);
+#endif
+}
+
+
+void QueueWrite(u32 offset, const void* data, u32 len)
+{
+    offset &= (kPacketQueueSize - 1);
+    u32 part = std::min(len, kPacketQueueSize - offset);
+
+    memcpy(&PacketQueue[offset], data, part);
+    if (part < len)
+        memcpy(&PacketQueue[0], &((const u8*)data)[part], len - part);
+}
+
+void QueueRead(u32 offset, void* data, u32 len)
+{
+    offset &= (kPacketQueueSize - 1);
+    u32 part = std::min(len, kPacketQueueSize - offset);
+
+    memcpy(data, &PacketQueue[offset], part);
+    if (part < len)
+        memcpy(&((u8*)data)[part], &PacketQueue[0], len - part);
+}
+
+bool QueueOverrun()
+{
+    // make sure whatever was read from the queue is checked against the latest write position
+    std::atomic_thread_fence(std::memory_order_acquire);
+    u32 writecount = QueueHeader->PacketWriteCount.load(std::memory_order_relaxed);
+    return (writecount - PacketReadCount) > kMaxReadBehind;
+}
+
+
+// instances that crashed or were killed never give their slot back
+void ReclaimDeadInstances()
+{
+    u32 mask = QueueHeader->InstanceBitmask.load();
+    for (int i = 0; i < kMaxInstances; i++)
+    {
+        if (!(mask & (1<<i))) continue;
+
+        u32 pid = InstanceState[i].PID.load();
+        if (pid == 0 || ProcessAlive(pid)) continue;
+
+        // only one instance gets to free the slot
+        if (!InstanceState[i].PID.compare_exchange_strong(pid, 0)) continue;
+
+        printf("LocalMP: instance %d (process %u) is gone, freeing its slot\n", i, pid);
+        InstanceState[i].Flags.store(0);
+        QueueHeader->InstanceBitmask.fetch_and(~(1<<i));
+    }
+}
+
+bool LockQueue()
+{
+    u32 self = GetProcessID();
+    auto start = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        u32 owner = 0;
+        if (QueueHeader->WriteLock.compare_exchange_weak(owner, self, std::memory_order_acquire))
+            return true;
+
+        // the lock is only ever held for a memcpy, so the holder is gone or stuck
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() > kLockTimeout)
+        {
+            if (owner == 0 || ProcessAlive(owner))
+                return false;
+
+            if (QueueHeader->WriteLock.compare_exchange_strong(owner, self, std::memory_order_acquire))
+            {
+                printf("LocalMP: process %u died holding the queue lock, taking it over\n", owner);
+                return true;
+            }
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+void UnlockQueue()
+{
+    QueueHeader->WriteLock.store(0, std::memory_order_release);
+}
+
+
+bool Init()
+{
+    MPQueue = new QSharedMemory("melonNIFI");
+
+    if (!MPQueue->attach())
+    {
+        if (!MPQueue->create(sizeof(MPQueueHeader) + kMaxInstances*sizeof(MPInstanceState) + kPacketQueueSize))
+        {
+            if (MPQueue->error() != QSharedMemory::AlreadyExists || !MPQueue->attach())
+            {
+                printf("LocalMP: failed to open shared memory\n");
+                delete MPQueue;
+                MPQueue = nullptr;
+                return false;
+            }
+        }
+    }
+
+    QueueHeader = (MPQueueHeader*)MPQueue->data();
+    InstanceState = (MPInstanceState*)&QueueHeader[1];
+    PacketQueue = (u8*)&InstanceState[kMaxInstances];
+
+    ReclaimDeadInstances();
+
+    u32 mask = QueueHeader->InstanceBitmask.load();
+    do
+    {
+        InstanceID = -1;
+        for (int i = 0; i < kMaxInstances; i++)
+        {
+            if (!(mask & (1<<i)))
+            {
+                InstanceID = i;
+                break;
+            }
+        }
+
+        if (InstanceID < 0)
+        {
+            printf("LocalMP: too many instances\n");
+            MPQueue->detach();
+            delete MPQueue;
+            MPQueue = nullptr;
+            return false;
+        }
+    }
+    while (!QueueHeader->InstanceBitmask.compare_exchange_weak(mask, mask | (1<<InstanceID)));
+
+    InstanceState[InstanceID].PID.store(GetProcessID());
+
+    for (int i = 0; i < kMaxInstances; i++)
+    {
+        if (!SemInit(i))
+        {
+            printf("LocalMP: failed to create semaphore %d\n", i);
+            for (int j = 0; j < i; j++) SemDeInit(j);
+
+            InstanceState[InstanceID].PID.store(0);
+            QueueHeader->InstanceBitmask.fetch_and(~(1<<InstanceID));
+            MPQueue->detach();
+            delete MPQueue;
+            MPQueue = nullptr;
+            return false;
+        }
+    }
+
+    // wakeups meant for a previous instance with the same ID
+    while (SemTryWait(InstanceID));
+
+    InstanceState[InstanceID].Flags.store(0);
+    TimeSynced = false;
+    TimeOffset = 0;
+    CurTime = 0;
+    for (int i = 0; i < kMaxInstances; i++)
+        StalledTime[i] = UINT64_MAX;
+
+    PacketReadCount = QueueHeader->PacketWriteCount.load(std::memory_order_acquire);
+    EarlyPackets.clear();
+    SeqNum = 0;
+    memset(SeqNumValid, 0, sizeof(SeqNumValid));
+
+    NumSent = 0;
+    NumReceived = 0;
+    NumLost = 0;
+
+    printf("LocalMP: started as instance %d\n", InstanceID);
+    return true;
+}
+
+void DeInit()
+{
+    if (!MPQueue) return;
+
+    printf("LocalMP: instance %d: %u packets sent, %u received, %u lost\n",
+           InstanceID, NumSent, NumReceived, NumLost);
+
+    InstanceState[InstanceID].Flags.store(0);
+    InstanceState[InstanceID].PID.store(0);
+    u32 mask = QueueHeader->InstanceBitmask.fetch_and(~(1<<InstanceID));
+
+    for (int i = 0; i < kMaxInstances; i++)
+        SemDeInit(i);
+
+    // the last instance out removes the semaphores, instead of leaving them
+    // around with whatever count they had for the next session
+    if (!(mask & ~(1<<InstanceID)))
+    {
+        for (int i = 0; i < kMaxInstances; i++)
+            SemUnlink(i);
+    }
+
+    MPQueue->detach();
+    delete MPQueue;
+    MPQueue = nullptr;
+}
+
+
+int SendPacket(u8* data, int len, u64 timestamp)
+{
+    if (!MPQueue)
+        return 0;
+
+    if (len > (int)kMaxPacketLen)
+    {
+        printf("LocalMP: error: packet too long (%d)\n", len);
+        return 0;
+    }
+
+    MPPacketHeader pkt;
+    pkt.Magic = kPacketMagic;
+    pkt.SenderID = InstanceID;
+    pkt.SeqNum = SeqNum++;
+    pkt.Length = len;
+    pkt.Timestamp = timestamp + TimeOffset;
+
+    u32 entrylen = (sizeof(MPPacketHeader) + len + 7) & ~7;
+
+    if (!LockQueue())
+    {
+        printf("LocalMP: queue lock held for too long, dropping packet\n");
+        return 0;
+    }
+
+    u32 writecount = QueueHeader->PacketWriteCount.load(std::memory_order_relaxed);
+    QueueWrite(writecount, &pkt, sizeof(MPPacketHeader));
+    QueueWrite(writecount + sizeof(MPPacketHeader), data, len);
+    QueueHeader->PacketWriteCount.store(writecount + entrylen, std::memory_order_release);
+
+    UnlockQueue();
+
+    u32 mask = QueueHeader->InstanceBitmask.load(std::memory_order_relaxed);
+    for (int i = 0; i < kMaxInstances; i++)
+    {
+        if (i == InstanceID) continue;
+        if (mask & (1<<i)) SemPost(i);
+    }
+
+    NumSent++;
+    return len;
+}
+
+int RecvPacket(u8* data, bool block, u64* timestamp)
+{
+    if (!MPQueue)
+        return 0;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(kRecvTimeout);
+
+    for (;;)
+    {
+        // packets that were set aside, once they're due
+        int early = -1;
+        for (int i = 0; i < (int)EarlyPackets.size(); i++)
+        {
+            if (EarlyPackets[i].Timestamp > CurTime) continue;
+            if (early < 0 || EarlyPackets[i].Timestamp < EarlyPackets[early].Timestamp)
+                early = i;
+        }
+        if (early >= 0)
+        {
+            EarlyPacket& pkt = EarlyPackets[early];
+            u32 len = pkt.Length;
+            memcpy(data, pkt.Data, len);
+            if (timestamp) *timestamp = pkt.Timestamp - TimeOffset;
+            EarlyPackets.erase(EarlyPackets.begin() + early);
+
+            NumReceived++;
+            return len;
+        }
+
+        u32 writecount = QueueHeader->PacketWriteCount.load(std::memory_order_acquire);
+
+        while (PacketReadCount != writecount)
+        {
+            if ((writecount - PacketReadCount) > kMaxReadBehind)
+            {
+                // we fell behind and the packets we haven't read are gone
+                printf("LocalMP: packet queue overrun\n");
+                PacketReadCount = writecount;
+                NumLost++;
+                break;
+            }
+
+            MPPacketHeader pkt;
+            QueueRead(PacketReadCount, &pkt, sizeof(MPPacketHeader));
+
+            bool valid = (pkt.Magic == kPacketMagic) &&
+                         (pkt.SenderID < (u32)kMaxInstances) &&
+                         (pkt.Length <= kMaxPacketLen);
+
+            if (valid && pkt.SenderID != (u32)InstanceID)
+                QueueRead(PacketReadCount + sizeof(MPPacketHeader), data, pkt.Length);
+
+            if (!valid || QueueOverrun())
+            {
+                writecount = QueueHeader->PacketWriteCount.load(std::memory_order_acquire);
+                PacketReadCount = writecount;
+                NumLost++;
+                break;
+            }
+
+            PacketReadCount += (sizeof(MPPacketHeader) + pkt.Length + 7) & ~7;
+
+            if (pkt.SenderID == (u32)InstanceID)
+                continue;
+
+            // sequence numbers restart when an instance comes back with the
+            // same ID, only count actual gaps
+            if (SeqNumValid[pkt.SenderID])
+            {
+                s32 gap = (s32)(pkt.SeqNum - (LastSeqNum[pkt.SenderID] + 1));
+                if (gap > 0) NumLost += gap;
+            }
+            LastSeqNum[pkt.SenderID] = pkt.SeqNum;
+            SeqNumValid[pkt.SenderID] = true;
+
+            // in lockstep, packets from the future are set aside until they're
+            // due, without holding up the ones queued after them
+            if (TimeSynced && pkt.Timestamp > CurTime)
+            {
+                if (EarlyPackets.size() >= kMaxEarlyPackets)
+                {
+                    printf("LocalMP: too many packets ahead of time, dropping one\n");
+                    NumLost++;
+                    continue;
+                }
+
+                EarlyPacket early;
+                early.Timestamp = pkt.Timestamp;
+                early.SenderID = pkt.SenderID;
+                early.Length = pkt.Length;
+                memcpy(early.Data, data, pkt.Length);
+                EarlyPackets.push_back(early);
+                continue;
+            }
+
+            if (timestamp) *timestamp = pkt.Timestamp - TimeOffset;
+
+            NumReceived++;
+            return pkt.Length;
+        }
+
+        if (!block)
+            return 0;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            return 0;
+
+        // woken up as soon as another instance sends something
+        SemWait(InstanceID, std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count());
+    }
+}
+
+
+
+bool PacketPending(u64 time)
+{
+    for (EarlyPacket& pkt : EarlyPackets)
+    {
+        if (pkt.Timestamp <= time)
+            return true;
+    }
+
+    u32 readcount = PacketReadCount;
+    u32 writecount = QueueHeader->PacketWriteCount.load(std::memory_order_acquire);
+
+    while (readcount != writecount)
+    {
+        // let RecvPacket() deal with overruns
+        if ((writecount - readcount) > kMaxReadBehind)
+            return true;
+
+        MPPacketHeader pkt;
+        QueueRead(readcount, &pkt, sizeof(MPPacketHeader));
+        if (pkt.Magic != kPacketMagic || pkt.Length > kMaxPacketLen)
+            return true;
+
+        if (pkt.SenderID != (u32)InstanceID && pkt.Timestamp <= time)
+            return true;
+
+        readcount += (sizeof(MPPacketHeader) + pkt.Length + 7) & ~7;
+    }
+
+    return false;
+}
+
+// returns how far the peers we could have waited for have gotten, ie. until
+// when there's no need to check on them again
+u64 WaitForPeers(u32 role, u64 time, bool stoponpacket)
+{
+    auto start = std::chrono::steady_clock::now();
+    int spins = 0;
+
+    for (;;)
+    {
+        u32 mask = QueueHeader->InstanceBitmask.load(std::memory_order_relaxed);
+        u32 waitmask = 0;
+        u64 mintime = UINT64_MAX;
+
+        for (int i = 0; i < kMaxInstances; i++)
+        {
+            if (i == InstanceID) continue;
+            if (!(mask & (1<<i))) continue;
+
+            u32 flags = InstanceState[i].Flags.load(std::memory_order_relaxed);
+            if (!(flags & InstanceFlag_TimeValid)) continue;
+            if (!(flags & role)) continue;
+
+            u64 peertime = InstanceState[i].Time.load(std::memory_order_acquire);
+
+            // don't keep waiting for an instance that isn't moving
+            if (peertime == StalledTime[i]) continue;
+
+            if (peertime >= time)
+            {
+                mintime = std::min(mintime, peertime);
+                continue;
+            }
+
+            waitmask |= (1<<i);
+        }
+
+        if (!waitmask)
+            return mintime;
+
+        if (stoponpacket && PacketPending(time))
+            return time;
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() > kStallTimeout)
+        {
+            // the instances we were waiting for are probably paused, or gone
+            ReclaimDeadInstances();
+            for (int i = 0; i < kMaxInstances; i++)
+            {
+                if (!(waitmask & (1<<i))) continue;
+
+                printf("LocalMP: instance %d stalled, not waiting for it\n", i);
+                StalledTime[i] = InstanceState[i].Time.load(std::memory_order_relaxed);
+            }
+            return time;
+        }
+
+        // the others usually aren't far behind
+        if (spins < 64)
+        {
+            spins++;
+            std::this_thread::yield();
+        }
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+}
+
+u64 SyncTime(u64 timestamp, bool host, bool client)
+{
+    if (!MPQueue)
+        return UINT64_MAX;
+
+    if (!TimeSynced)
+    {
+        // join the shared timeline where the furthest instance is
+        u64 maxtime = 0;
+        u32 mask = QueueHeader->InstanceBitmask.load(std::memory_order_relaxed);
+        for (int i = 0; i < kMaxInstances; i++)
+        {
+            if (i == InstanceID) continue;
+            if (!(mask & (1<<i))) continue;
+            if (!(InstanceState[i].Flags.load(std::memory_order_relaxed) & InstanceFlag_TimeValid)) continue;
+
+            maxtime = std::max(maxtime, (u64)InstanceState[i].Time.load(std::memory_order_relaxed));
+        }
+
+        TimeOffset = maxtime - timestamp;
+        TimeSynced = true;
+    }
+
+    CurTime = timestamp + TimeOffset;
+
+    u32 flags = InstanceFlag_TimeValid;
+    if (host) flags |= InstanceFlag_Host;
+    if (client) flags |= InstanceFlag_Client;
+
+    InstanceState[InstanceID].Time.store(CurTime, std::memory_order_release);
+    InstanceState[InstanceID].Flags.store(flags, std::memory_order_relaxed);
+
+    // the others only need to see our time every so often, as anyone
+    // waiting on us publishes its own time first
+    u64 next = CurTime + kSyncInterval;
+
+    // a client getting ahead of its host would miss the host's packets
+    // it can run up to where the host is without checking again
+    if (client && !host)
+        next = std::min(next, WaitForPeers(InstanceFlag_Host, CurTime, false));
+
+    for (EarlyPacket& pkt : EarlyPackets)
+        next = std::min(next, pkt.Timestamp);
+
+    return std::max(next, CurTime + 1) - TimeOffset;
+}
+
+void WaitReplies(u64 timestamp)
+{
+    if (!MPQueue || !TimeSynced)
+        return;
+
+    // clients may be waiting on us
+    CurTime = timestamp + TimeOffset;
+    InstanceState[InstanceID].Time.store(CurTime, std::memory_order_release);
+
+    WaitForPeers(InstanceFlag_Client, CurTime, true);
+}
+
+}
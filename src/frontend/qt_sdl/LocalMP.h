@@ -0,0 +1,43 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef LOCALMP_H
+#define LOCALMP_H
+
+#include "../types.h"
+
+// local multiplayer between melonDS instances running on the same machine
+// packets go through a ring buffer in shared memory, and each instance has
+// a named semaphore it sleeps on when waiting for packets
+
+namespace LocalMP
+{
+
+bool Init();
+void DeInit();
+
+int SendPacket(u8* data, int len, u64 timestamp);
+int RecvPacket(u8* data, bool block, u64* timestamp);
+
+// lockstep: see Platform.h
+u64 SyncTime(u64 timestamp, bool host, bool client);
+void WaitReplies(u64 timestamp);
+
+}
+
+#endif // LOCALMP_H
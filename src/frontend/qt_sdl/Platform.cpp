@@ -51,6 +51,7 @@
 
 #include "Platform.h"
 #include "PlatformConfig.h"
+#include "LocalMP.h"
 #include "LAN_Socket.h"
 #include "LAN_PCap.h"
 #include <string>
@@ -68,11 +69,12 @@ void emuStop();
 namespace Platform
 {
 
+bool MPLocal;
 socket_t MPSocket;
 sockaddr_t MPSendAddr;
 u8 PacketBuffer[2048];
 
-#define NIFI_VER 1
+#define NIFI_VER 2
 
 
 void Init(int argc, char** argv)
@@ -264,6 +266,21 @@ bool MP_Init()
     int opt_true = 1;
     int res;
 
+    // instances on the same machine talk through shared memory
+    // UDP is only needed when playing with other machines
+    MPLocal = false;
+    MPSocket = INVALID_SOCKET;
+    if (!Config::SocketBindAnyAddr)
+    {
+        if (LocalMP::Init())
+        {
+            MPLocal = true;
+            return true;
+        }
+
+        printf("MP: falling back to UDP\n");
+    }
+
 #ifdef __WIN32__
     WSADATA wsadata;
     if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
@@ -315,6 +332,12 @@ bool MP_Init()
 
 void MP_DeInit()
 {
+    if (MPLocal)
+    {
+        LocalMP::DeInit();
+        return;
+    }
+
     if (MPSocket >= 0)
         closesocket(MPSocket);
 
@@ -323,12 +346,15 @@ void MP_DeInit()
 #endif // __WIN32__
 }
 
-int MP_SendPacket(u8* data, int len)
+int MP_SendPacket(u8* data, int len, u64 timestamp)
 {
+    if (MPLocal)
+        return LocalMP::SendPacket(data, len, timestamp);
+
     if (MPSocket < 0)
         return 0;
 
-    if (len > 2048-8)
+    if (len > 2048-16)
     {
         printf("MP_SendPacket: error: packet too long (%d)\n", len);
         return 0;
@@ -338,15 +364,20 @@ int MP_SendPacket(u8* data, int len)
     PacketBuffer[4] = NIFI_VER;
     PacketBuffer[5] = 0;
     *(u16*)&PacketBuffer[6] = htons(len);
-    memcpy(&PacketBuffer[8], data, len);
+    *(u32*)&PacketBuffer[8] = htonl((u32)(timestamp >> 32));
+    *(u32*)&PacketBuffer[12] = htonl((u32)timestamp);
+    memcpy(&PacketBuffer[16], data, len);
 
-    int slen = sendto(MPSocket, (const char*)PacketBuffer, len+8, 0, &MPSendAddr, sizeof(sockaddr_t));
-    if (slen < 8) return 0;
-    return slen - 8;
+    int slen = sendto(MPSocket, (const char*)PacketBuffer, len+16, 0, &MPSendAddr, sizeof(sockaddr_t));
+    if (slen < 16) return 0;
+    return slen - 16;
 }
 
-int MP_RecvPacket(u8* data, bool block)
+int MP_RecvPacket(u8* data, bool block, u64* timestamp)
 {
+    if (MPLocal)
+        return LocalMP::RecvPacket(data, block, timestamp);
+
     if (MPSocket < 0)
         return 0;
 
@@ -366,11 +397,11 @@ int MP_RecvPacket(u8* data, bool block)
     sockaddr_t fromAddr;
     socklen_t fromLen = sizeof(sockaddr_t);
     int rlen = recvfrom(MPSocket, (char*)PacketBuffer, 2048, 0, &fromAddr, &fromLen);
-    if (rlen < 8+24)
+    if (rlen < 16+24)
     {
         return 0;
     }
-    rlen -= 8;
+    rlen -= 16;
 
     if (ntohl(*(u32*)&PacketBuffer[0]) != 0x4946494E)
     {
@@ -387,10 +418,33 @@ int MP_RecvPacket(u8* data, bool block)
         return 0;
     }
 
-    memcpy(data, &PacketBuffer[8], rlen);
+    if (timestamp)
+        *timestamp = ((u64)ntohl(*(u32*)&PacketBuffer[8]) << 32) | ntohl(*(u32*)&PacketBuffer[12]);
+
+    memcpy(data, &PacketBuffer[16], rlen);
     return rlen;
 }
 
+bool MP_Lockstep()
+{
+    // only instances sharing memory can keep track of each other's progress
+    return MPLocal && Config::MPLockstep;
+}
+
+u64 MP_SyncTime(u64 timestamp, bool host, bool client)
+{
+    if (MP_Lockstep())
+        return LocalMP::SyncTime(timestamp, host, client);
+
+    return UINT64_MAX;
+}
+
+void MP_WaitReplies(u64 timestamp)
+{
+    if (MP_Lockstep())
+        LocalMP::WaitReplies(timestamp);
+}
+
 
 
 bool LAN_Init()
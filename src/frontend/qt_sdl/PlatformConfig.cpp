@@ -64,11 +64,18 @@ int ConsoleType;
 int DirectBoot;
 
 int SocketBindAnyAddr;
+int MPLockstep;
 char LANDevice[128];
 int DirectLAN;
 
 int SavestateRelocSRAM;
 
+int RewindEnable;
+int RewindDepth;
+int RewindInterval;
+int RewindKeyInterval;
+int RewindMaxMemory;
+
 int AudioInterp;
 int AudioVolume;
 int MicInputType;
@@ -126,6 +133,7 @@ ConfigEntry PlatformConfigFile[] =
     {"HKKey_SolarSensorDecrease", 0, &HKKeyMapping[HK_SolarSensorDecrease], -1, NULL, 0},
     {"HKKey_SolarSensorIncrease", 0, &HKKeyMapping[HK_SolarSensorIncrease], -1, NULL, 0},
     {"HKKey_FrameStep",           0, &HKKeyMapping[HK_FrameStep],           -1, NULL, 0},
+    {"HKKey_Rewind",              0, &HKKeyMapping[HK_Rewind],              -1, NULL, 0},
 
     {"HKJoy_Lid",                 0, &HKJoyMapping[HK_Lid],                 -1, NULL, 0},
     {"HKJoy_Mic",                 0, &HKJoyMapping[HK_Mic],                 -1, NULL, 0},
@@ -138,6 +146,7 @@ ConfigEntry PlatformConfigFile[] =
     {"HKJoy_SolarSensorDecrease", 0, &HKJoyMapping[HK_SolarSensorDecrease], -1, NULL, 0},
     {"HKJoy_SolarSensorIncrease", 0, &HKJoyMapping[HK_SolarSensorIncrease], -1, NULL, 0},
     {"HKJoy_FrameStep",           0, &HKJoyMapping[HK_FrameStep],           -1, NULL, 0},
+    {"HKJoy_Rewind",              0, &HKJoyMapping[HK_Rewind],              -1, NULL, 0},
 
     {"JoystickID", 0, &JoystickID, 0, NULL, 0},
 
@@ -173,11 +182,18 @@ ConfigEntry PlatformConfigFile[] =
     {"DirectBoot", 0, &DirectBoot, 1, NULL, 0},
 
     {"SockBindAnyAddr", 0, &SocketBindAnyAddr, 0, NULL, 0},
+    {"MPLockstep", 0, &MPLockstep, 0, NULL, 0},
     {"LANDevice", 1, LANDevice, 0, "", 127},
     {"DirectLAN", 0, &DirectLAN, 0, NULL, 0},
 
     {"SavStaRelocSRAM", 0, &SavestateRelocSRAM, 0, NULL, 0},
 
+    {"RewindEnable",      0, &RewindEnable,      0,    NULL, 0},
+    {"RewindDepth",       0, &RewindDepth,       3600, NULL, 0},
+    {"RewindInterval",    0, &RewindInterval,    1,    NULL, 0},
+    {"RewindKeyInterval", 0, &RewindKeyInterval, 60,   NULL, 0},
+    {"RewindMaxMemory",   0, &RewindMaxMemory,   512,  NULL, 0},
+
     {"AudioInterp", 0, &AudioInterp, 0, NULL, 0},
     {"AudioVolume", 0, &AudioVolume, 256, NULL, 0},
     {"MicInputType", 0, &MicInputType, 1, NULL, 0},
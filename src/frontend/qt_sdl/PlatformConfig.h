@@ -34,6 +34,7 @@ enum
     HK_SolarSensorDecrease,
     HK_SolarSensorIncrease,
     HK_FrameStep,
+    HK_Rewind,
     HK_MAX
 };
 
@@ -80,11 +81,18 @@ extern int ConsoleType;
 extern int DirectBoot;
 
 extern int SocketBindAnyAddr;
+extern int MPLockstep;
 extern char LANDevice[128];
 extern int DirectLAN;
 
 extern int SavestateRelocSRAM;
 
+extern int RewindEnable;
+extern int RewindDepth;
+extern int RewindInterval;
+extern int RewindKeyInterval;
+extern int RewindMaxMemory;
+
 extern int AudioInterp;
 extern int AudioVolume;
 extern int MicInputType;
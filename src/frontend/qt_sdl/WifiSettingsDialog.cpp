@@ -57,6 +57,7 @@ WifiSettingsDialog::WifiSettingsDialog(QWidget* parent) : QDialog(parent), ui(ne
     ui->rbDirectMode->setText("Direct mode (requires " PCAP_NAME " and ethernet connection)");
 
     ui->cbBindAnyAddr->setChecked(Config::SocketBindAnyAddr != 0);
+    ui->cbMPLockstep->setChecked(Config::MPLockstep != 0);
     ui->cbRandomizeMAC->setChecked(Config::RandomizeMAC != 0);
 
     int sel = 0;
@@ -101,6 +102,7 @@ void WifiSettingsDialog::done(int r)
         }
 
         Config::SocketBindAnyAddr = ui->cbBindAnyAddr->isChecked() ? 1:0;
+        Config::MPLockstep = ui->cbMPLockstep->isChecked() ? 1:0;
         Config::RandomizeMAC = randommac;
         Config::DirectLAN = ui->rbDirectMode->isChecked() ? 1:0;
 
@@ -35,6 +35,7 @@
 #include <QKeyEvent>
 #include <QMimeData>
 #include <QVector>
+#include <QScreen>
 #ifndef _WIN32
 #include <QSocketNotifier>
 #include <unistd.h>
@@ -71,6 +72,7 @@
 #include "GPU.h"
 #include "SPU.h"
 #include "Wifi.h"
+#include "DSi_DSP.h"
 #include "Platform.h"
 #include "Config.h"
 #include "PlatformConfig.h"
@@ -94,10 +96,12 @@ int videoRenderer;
 GPU::RenderSettings videoSettings;
 bool videoSettingsDirty;
 
+// refresh rate of the screen the main window is on, for the frame pacer
+// QScreen can only be used from the UI thread, so it is tracked there
+std::atomic<double> displayRefreshRate(0);
+
 SDL_AudioDeviceID audioDevice;
 int audioFreq;
-SDL_cond* audioSync;
-SDL_mutex* audioSyncLock;
 
 SDL_AudioDeviceID micDevice;
 s16 micExtBuffer[2048];
@@ -119,10 +123,7 @@ void audioCallback(void* data, Uint8* stream, int len)
     s16 buf_in[1024*2];
     int num_in;
 
-    SDL_LockMutex(audioSyncLock);
     num_in = SPU::ReadOutput(buf_in, len_in);
-    SDL_CondSignal(audioSync);
-    SDL_UnlockMutex(audioSyncLock);
 
     if (num_in < 1)
     {
@@ -399,18 +400,26 @@ void EmuThread::run()
         videoRenderer = 0;
     }
 
+    // the framebuffers are reallocated, the UI must not be drawing from them
+    FrontBufferLock.lock();
     GPU::InitRenderer(videoRenderer);
     GPU::SetRenderSettings(videoRenderer, videoSettings);
+    FrontBufferLock.unlock();
 
     SPU::SetInterpolation(Config::AudioInterp);
 
     Input::Init();
 
+    Frontend::Rewind_Init(Config::RewindEnable != 0, Config::RewindDepth, Config::RewindInterval,
+                          Config::RewindKeyInterval, Config::RewindMaxMemory);
+    bool rewinding = false;
+
+    Frontend::FramePacer_Init(Config::AudioSync ? Frontend::FramePacing_Audio : Frontend::FramePacing_Video);
+    updateDisplayRate();
+
     u32 nframes = 0;
     double perfCountsSec = 1.0 / SDL_GetPerformanceFrequency();
-    double lastTime = SDL_GetPerformanceCounter() * perfCountsSec;
-    double frameLimitError = 0.0;
-    double lastMeasureTime = lastTime;
+    double lastMeasureTime = SDL_GetPerformanceCounter() * perfCountsSec;
 
     char melontitle[100];
 
@@ -481,16 +490,18 @@ void EmuThread::run()
                 videoSettings.GL_ScaleFactor = Config::GL_ScaleFactor;
                 videoSettings.GL_BetterPolygons = Config::GL_BetterPolygons;
 
+                FrontBufferLock.lock();
                 GPU::SetRenderSettings(videoRenderer, videoSettings);
+                FrontBufferLock.unlock();
             }
 
             // process input and hotkeys
-            NDS::SetKeyMask(Input::InputMask);
+            Frontend::Input_SetKeyMask(Input::InputMask);
 
             if (Input::HotkeyPressed(HK_Lid))
             {
                 bool lid = !NDS::IsLidClosed();
-                NDS::SetLidClosed(lid);
+                Frontend::Input_SetLidClosed(lid);
                 OSD::AddMessage(0, lid ? "Lid closed" : "Lid opened");
             }
 
@@ -537,14 +548,46 @@ void EmuThread::run()
             }
 #endif
 
+            // rewind
+            // (not while a movie is active, the state has to follow the movie's input)
+            bool movie = Frontend::Movie_IsRecording() || Frontend::Movie_IsPlaying();
+            bool rewind = Config::RewindEnable && Input::HotkeyDown(HK_Rewind) && !movie;
+            if (rewind && !rewinding)
+            {
+                Frontend::RewindStats stats;
+                Frontend::Rewind_GetStats(&stats);
+
+                char msg[128];
+                sprintf(msg, "Rewind: %d states, %.1f MB, capture %.2f ms",
+                        stats.NumStates, stats.MemoryUsage / (1024.0 * 1024.0), stats.LastCaptureTime);
+                OSD::AddMessage(0, msg);
+            }
+            rewinding = rewind;
+
+            if (rewind && !Frontend::Rewind_Step())
+            {
+                // out of history, keep running from the oldest state
+                rewind = false;
+            }
+
+            Frontend::Input_Apply();
+            if (movie && !Frontend::Movie_IsRecording() && !Frontend::Movie_IsPlaying())
+                OSD::AddMessage(0, "Movie finished");
+
             // emulate
             u32 nlines = NDS::RunFrame();
 
-            FrontBufferLock.lock();
-            FrontBuffer = GPU::FrontBuffer;
+            if (!rewind) Frontend::Rewind_Capture();
+
+            Frontend::Capture_Frame();
+
+            // with the software renderer, frames are picked up by the UI
+            // through GPU::AcquirePresentBuffer(), without locking
 #ifdef OGLRENDERER_ENABLED
             if (videoRenderer == 1)
             {
+                FrontBufferLock.lock();
+                FrontBuffer = GPU::FrontBuffer;
                 if (FrontBufferSyncs[FrontBuffer])
                     glDeleteSync(FrontBufferSyncs[FrontBuffer]);
                 FrontBufferSyncs[FrontBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
@@ -552,9 +595,9 @@ void EmuThread::run()
                 // this function without dealling with a ton of
                 // macro mess
                 epoxy_glFlush();
+                FrontBufferLock.unlock();
             }
 #endif
-            FrontBufferLock.unlock();
 
 #ifdef MELONCAP
             MelonCap::Update();
@@ -566,41 +609,19 @@ void EmuThread::run()
 
             bool fastforward = Input::HotkeyDown(HK_FastForward);
 
-            if (Config::AudioSync && (!fastforward) && audioDevice)
-            {
-                SDL_LockMutex(audioSyncLock);
-                while (SPU::GetOutputSize() > 1024)
-                {
-                    int ret = SDL_CondWaitTimeout(audioSync, audioSyncLock, 500);
-                    if (ret == SDL_MUTEX_TIMEDOUT) break;
-                }
-                SDL_UnlockMutex(audioSyncLock);
-            }
-
             double frametimeStep = nlines / (60.0 * 263.0);
 
             {
-                bool limitfps = Config::LimitFPS && !fastforward;
+                // with audio sync, the pacer follows the audio device's clock
+                // even when the framerate limit is off
+                bool audiosync = Config::AudioSync && (!fastforward) && audioDevice;
+                bool limitfps = (Config::LimitFPS || audiosync) && !fastforward;
 
                 double practicalFramelimit = limitfps ? frametimeStep : 1.0 / 1000.0;
+                int audiofill = audiosync ? SPU::GetOutputSize() : -1;
 
-                double curtime = SDL_GetPerformanceCounter() * perfCountsSec;
-
-                frameLimitError += practicalFramelimit - (curtime - lastTime);
-                if (frameLimitError < -practicalFramelimit)
-                    frameLimitError = -practicalFramelimit;
-                if (frameLimitError > practicalFramelimit)
-                    frameLimitError = practicalFramelimit;
-
-                if (round(frameLimitError * 1000.0) > 0.0)
-                {
-                    SDL_Delay(round(frameLimitError * 1000.0));
-                    double timeBeforeSleep = curtime;
-                    curtime = SDL_GetPerformanceCounter() * perfCountsSec;
-                    frameLimitError -= curtime - timeBeforeSleep;
-                }
-
-                lastTime = curtime;
+                Frontend::FramePacer_SetMode(audiosync ? Frontend::FramePacing_Audio : Frontend::FramePacing_Video);
+                Frontend::FramePacer_Wait(practicalFramelimit, audiofill);
             }
 
             nframes++;
@@ -615,7 +636,13 @@ void EmuThread::run()
 
                 float fpstarget = 1.0/frametimeStep;
 
-                sprintf(melontitle, "[%d/%.0f] melonDS " MELONDS_VERSION, fps, fpstarget);
+                u32 numpresented = PresentCount.exchange(0);
+                u64 presentlatency = PresentLatency.exchange(0);
+                if (numpresented > 0)
+                    sprintf(melontitle, "[%d/%.0f, %.1fms] melonDS " MELONDS_VERSION, fps, fpstarget,
+                            presentlatency / (numpresented * 1000.0));
+                else
+                    sprintf(melontitle, "[%d/%.0f] melonDS " MELONDS_VERSION, fps, fpstarget);
                 changeWindowTitle(melontitle);
             }
         }
@@ -623,8 +650,9 @@ void EmuThread::run()
         {
             // paused
             nframes = 0;
-            lastTime = SDL_GetPerformanceCounter() * perfCountsSec;
-            lastMeasureTime = lastTime;
+            lastMeasureTime = SDL_GetPerformanceCounter() * perfCountsSec;
+            Frontend::FramePacer_Reset();
+            updateDisplayRate();
 
             emit windowUpdate();
 
@@ -639,7 +667,13 @@ void EmuThread::run()
 
     EmuStatus = 0;
 
+    printFramePacerStats();
+    if (NDS::ConsoleType == 1)
+        printDSPStats();
+
+    FrontBufferLock.lock();
     GPU::DeInitRenderer();
+    FrontBufferLock.unlock();
     NDS::DeInit();
     //Platform::LAN_DeInit();
 
@@ -650,6 +684,62 @@ void EmuThread::run()
     }
 }
 
+void EmuThread::updateDisplayRate()
+{
+    // the pacer locks onto the display's refresh period when it is close
+    // enough to the emulated framerate, so frames are shown evenly
+    if (Config::ScreenVSync)
+    {
+        Frontend::FramePacer_SetDisplayRate(displayRefreshRate, Config::ScreenVSyncInterval);
+    }
+    else
+        Frontend::FramePacer_SetDisplayRate(0, 0);
+}
+
+void EmuThread::printFramePacerStats()
+{
+    Frontend::FramePacerStats stats;
+    Frontend::FramePacer_GetStats(&stats);
+    if (stats.NumFrames < 1) return;
+
+    // percentiles are taken from the histogram, so they are
+    // only accurate to the bucket size
+    double pct[3] = {0.5, 0.99, 0.999};
+    double pctval[3] = {0, 0, 0};
+    for (int p = 0; p < 3; p++)
+    {
+        u32 target = (u32)(stats.NumFrames * pct[p]);
+        u32 count = 0;
+        for (int i = 0; i < Frontend::FramePacer_HistogramSize; i++)
+        {
+            count += stats.Histogram[i];
+            if (count > target)
+            {
+                pctval[p] = (i + 1) * stats.BucketSize;
+                break;
+            }
+        }
+    }
+
+    printf("frame pacing: %u frames, %u late, mean %.3fms, stddev %.3fms, max %.3fms\n",
+           stats.NumFrames, stats.NumLate, stats.MeanTime, stats.StdDev, stats.MaxTime);
+    printf("frame pacing: p50 <%.2fms, p99 <%.2fms, p99.9 <%.2fms\n",
+           pctval[0], pctval[1], pctval[2]);
+}
+
+void EmuThread::printDSPStats()
+{
+    DSi_DSP::DSPStats stats;
+    DSi_DSP::GetStats(&stats);
+
+    u64 total = stats.ExecutedCycles + stats.SkippedCycles;
+    if (total == 0) return;
+
+    printf("DSP: %llu cycles run, %llu skipped while waiting (%.1f%%), %u catch-ups\n",
+           (unsigned long long)stats.ExecutedCycles, (unsigned long long)stats.SkippedCycles,
+           stats.SkippedCycles * 100.0 / total, stats.NumCatchUps);
+}
+
 void EmuThread::changeWindowTitle(char* title)
 {
     emit windowTitleChange(QString(title));
@@ -789,7 +879,7 @@ void ScreenHandler::screenOnMousePress(QMouseEvent* event)
     if (Frontend::GetTouchCoords(x, y, false))
     {
         touching = true;
-        NDS::TouchScreen(x, y);
+        Frontend::Input_TouchScreen(x, y);
     }
 }
 
@@ -801,7 +891,7 @@ void ScreenHandler::screenOnMouseRelease(QMouseEvent* event)
     if (touching)
     {
         touching = false;
-        NDS::ReleaseScreen();
+        Frontend::Input_ReleaseScreen();
     }
 }
 
@@ -818,7 +908,7 @@ void ScreenHandler::screenOnMouseMove(QMouseEvent* event)
     int y = event->pos().y();
 
     if (Frontend::GetTouchCoords(x, y, true))
-        NDS::TouchScreen(x, y);
+        Frontend::Input_TouchScreen(x, y);
 }
 
 void ScreenHandler::screenHandleTablet(QTabletEvent* event)
@@ -836,14 +926,14 @@ void ScreenHandler::screenHandleTablet(QTabletEvent* event)
             if (Frontend::GetTouchCoords(x, y, event->type()==QEvent::TabletMove))
             {
                 touching = true;
-                NDS::TouchScreen(x, y);
+                Frontend::Input_TouchScreen(x, y);
             }
         }
         break;
     case QEvent::TabletRelease:
         if (touching)
         {
-            NDS::ReleaseScreen();
+            Frontend::Input_ReleaseScreen();
             touching = false;
         }
         break;
@@ -867,14 +957,14 @@ void ScreenHandler::screenHandleTouch(QTouchEvent* event)
             if (Frontend::GetTouchCoords(x, y, event->type()==QEvent::TouchUpdate))
             {
                 touching = true;
-                NDS::TouchScreen(x, y);
+                Frontend::Input_TouchScreen(x, y);
             }
         }
         break;
     case QEvent::TouchEnd:
         if (touching)
         {
-            NDS::ReleaseScreen();
+            Frontend::Input_ReleaseScreen();
             touching = false;
         }
         break;
@@ -899,9 +989,6 @@ QTimer* ScreenHandler::setupMouseTimer()
 
 ScreenPanelNative::ScreenPanelNative(QWidget* parent) : QWidget(parent)
 {
-    screen[0] = QImage(256, 192, QImage::Format_RGB32);
-    screen[1] = QImage(256, 192, QImage::Format_RGB32);
-
     screenTrans[0].reset();
     screenTrans[1].reset();
 
@@ -941,17 +1028,23 @@ void ScreenPanelNative::paintEvent(QPaintEvent* event)
     // fill background
     painter.fillRect(event->rect(), QColor::fromRgb(0, 0, 0));
 
+    // changing the render settings reallocates the framebuffers, which is
+    // done under this lock
     emuThread->FrontBufferLock.lock();
-    int frontbuf = emuThread->FrontBuffer;
+
+    u64 frametime;
+    int frontbuf = GPU::AcquirePresentBuffer(&frametime);
     if (!GPU::Framebuffer[frontbuf][0] || !GPU::Framebuffer[frontbuf][1])
     {
         emuThread->FrontBufferLock.unlock();
         return;
     }
 
-    memcpy(screen[0].scanLine(0), GPU::Framebuffer[frontbuf][0], 256*192*4);
-    memcpy(screen[1].scanLine(0), GPU::Framebuffer[frontbuf][1], 256*192*4);
-    emuThread->FrontBufferLock.unlock();
+    // the framebuffers are ours until the next AcquirePresentBuffer() call,
+    // so they can be drawn from directly
+    QImage screen[2];
+    screen[0] = QImage((const uchar*)GPU::Framebuffer[frontbuf][0], 256, 192, QImage::Format_RGB32);
+    screen[1] = QImage((const uchar*)GPU::Framebuffer[frontbuf][1], 256, 192, QImage::Format_RGB32);
 
     painter.setRenderHint(QPainter::SmoothPixmapTransform, Config::ScreenFilter!=0);
 
@@ -963,6 +1056,11 @@ void ScreenPanelNative::paintEvent(QPaintEvent* event)
         painter.drawImage(screenrc, screen[screenKind[i]]);
     }
 
+    emuThread->FrontBufferLock.unlock();
+
+    if (frametime)
+        emuThread->AddPresentLatency(GPU::GetTimestamp() - frametime);
+
     OSD::Update(nullptr);
     OSD::DrawNative(painter);
 }
@@ -1136,15 +1234,20 @@ void ScreenPanelGL::paintGL()
         screenShader->setUniformValue("uScreenSize", (float)w, (float)h);
         screenShader->setUniformValue("uScaleFactor", factor);
 
+        // the renderer is only switched under this lock, so it has to be
+        // checked with the lock held
         emuThread->FrontBufferLock.lock();
-        int frontbuf = emuThread->FrontBuffer;
+
+        bool accelerated = GPU::Renderer != 0;
+        u64 frametime = 0;
         glActiveTexture(GL_TEXTURE0);
 
     #ifdef OGLRENDERER_ENABLED
-        if (GPU::Renderer != 0)
+        if (accelerated)
         {
-            if (emuThread->FrontBufferSyncs[emuThread->FrontBuffer])
-                glWaitSync(emuThread->FrontBufferSyncs[emuThread->FrontBuffer], 0, GL_TIMEOUT_IGNORED);
+            int frontbuf = emuThread->FrontBuffer;
+            if (emuThread->FrontBufferSyncs[frontbuf])
+                glWaitSync(emuThread->FrontBufferSyncs[frontbuf], 0, GL_TIMEOUT_IGNORED);
             // hardware-accelerated render
             GPU::CurGLCompositor->BindOutputTexture(frontbuf);
         }
@@ -1154,6 +1257,7 @@ void ScreenPanelGL::paintGL()
             // regular render
             glBindTexture(GL_TEXTURE_2D, screenTexture);
 
+            int frontbuf = GPU::AcquirePresentBuffer(&frametime);
             if (GPU::Framebuffer[frontbuf][0] && GPU::Framebuffer[frontbuf][1])
             {
                 glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 192, GL_RGBA,
@@ -1180,10 +1284,20 @@ void ScreenPanelGL::paintGL()
 
         screenShader->release();
 
-        if (emuThread->FrontBufferReverseSyncs[emuThread->FrontBuffer])
-            glDeleteSync(emuThread->FrontBufferReverseSyncs[emuThread->FrontBuffer]);
-        emuThread->FrontBufferReverseSyncs[emuThread->FrontBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    #ifdef OGLRENDERER_ENABLED
+        if (accelerated)
+        {
+            int frontbuf = emuThread->FrontBuffer;
+            if (emuThread->FrontBufferReverseSyncs[frontbuf])
+                glDeleteSync(emuThread->FrontBufferReverseSyncs[frontbuf]);
+            emuThread->FrontBufferReverseSyncs[frontbuf] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    #endif
+
         emuThread->FrontBufferLock.unlock();
+
+        if (frametime)
+            emuThread->AddPresentLatency(GPU::GetTimestamp() - frametime);
     }
 
     OSD::Update(this);
@@ -1347,6 +1461,21 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
 
         menu->addSeparator();
 
+        actCaptureVideo = menu->addAction("Record video");
+        actCaptureVideo->setCheckable(true);
+        connect(actCaptureVideo, &QAction::triggered, this, &MainWindow::onCaptureVideo);
+
+        actRecordMovie = menu->addAction("Record movie...");
+        connect(actRecordMovie, &QAction::triggered, this, &MainWindow::onRecordMovie);
+
+        actPlayMovie = menu->addAction("Play movie...");
+        connect(actPlayMovie, &QAction::triggered, this, &MainWindow::onPlayMovie);
+
+        actStopMovie = menu->addAction("Stop movie");
+        connect(actStopMovie, &QAction::triggered, this, &MainWindow::onStopMovie);
+
+        menu->addSeparator();
+
         actQuit = menu->addAction("Quit");
         connect(actQuit, &QAction::triggered, this, &MainWindow::onQuit);
     }
@@ -1564,6 +1693,9 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     else
         show();
 
+    connect(windowHandle(), &QWindow::screenChanged, this, &MainWindow::onScreenChanged);
+    onScreenChanged(windowHandle()->screen());
+
     createScreenPanel();
 
     for (int i = 0; i < 9; i++)
@@ -1573,6 +1705,10 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     }
     actUndoStateLoad->setEnabled(false);
     actImportSavefile->setEnabled(false);
+    actCaptureVideo->setEnabled(false);
+    actRecordMovie->setEnabled(false);
+    actPlayMovie->setEnabled(false);
+    actStopMovie->setEnabled(false);
 
     actPause->setEnabled(false);
     actReset->setEnabled(false);
@@ -2302,6 +2438,134 @@ void MainWindow::onImportSavefile()
     emuThread->emuUnpause();
 }
 
+void MainWindow::onCaptureVideo(bool checked)
+{
+    if (!checked)
+    {
+        emuThread->emuPause();
+        Frontend::Capture_Stop();
+        emuThread->emuUnpause();
+
+        OSD::AddMessage(0, "Video recording stopped");
+        return;
+    }
+
+    // the OpenGL renderer doesn't output to GPU::Framebuffer
+    if (videoRenderer != 0)
+    {
+        QMessageBox::critical(this, "melonDS", "Video recording requires the software renderer.");
+        actCaptureVideo->setChecked(false);
+        return;
+    }
+
+    emuThread->emuPause();
+    QString path = QFileDialog::getSaveFileName(this,
+                                                "Record video",
+                                                Config::LastROMFolder,
+                                                "YUV4MPEG2 video + WAV audio (*.y4m)");
+
+    bool started = false;
+    if (!path.isEmpty())
+    {
+        if (path.endsWith(".y4m", Qt::CaseInsensitive))
+            path.chop(4);
+
+        // frames are dropped rather than slowing down emulation
+        started = Frontend::Capture_Start(path.toStdString().c_str(), false);
+        if (!started)
+            QMessageBox::critical(this, "melonDS", "Could not create the video files.");
+    }
+    emuThread->emuUnpause();
+
+    actCaptureVideo->setChecked(started);
+    if (started) OSD::AddMessage(0, "Video recording started");
+}
+
+void MainWindow::onRecordMovie()
+{
+    if (!RunningSomething) return;
+
+    emuThread->emuPause();
+    QString path = QFileDialog::getSaveFileName(this,
+                                                "Record movie",
+                                                Config::LastROMFolder,
+                                                "melonDS movies (*.mlm)");
+    if (path.isEmpty())
+    {
+        emuThread->emuUnpause();
+        return;
+    }
+
+    bool poweron = QMessageBox::question(this,
+                        "Record movie",
+                        "Start recording from power-on? The emulation will be reset.\n"
+                        "Otherwise, the recording starts from the current state.",
+                        QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes;
+
+    if (poweron)
+    {
+        actUndoStateLoad->setEnabled(false);
+
+        int res = Frontend::Reset();
+        if (res != Frontend::Load_OK)
+        {
+            QMessageBox::critical(this, "melonDS", "Reset failed\n" + loadErrorStr(res));
+            emuThread->emuUnpause();
+            return;
+        }
+    }
+
+    if (Frontend::Movie_StartRecording(path.toStdString().c_str(), !poweron))
+        OSD::AddMessage(0, "Movie recording started");
+    else
+        OSD::AddMessage(0xFFA0A0, "Could not create the movie file");
+
+    emuThread->emuUnpause();
+}
+
+void MainWindow::onPlayMovie()
+{
+    if (!RunningSomething) return;
+
+    emuThread->emuPause();
+    QString path = QFileDialog::getOpenFileName(this,
+                                                "Play movie",
+                                                Config::LastROMFolder,
+                                                "melonDS movies (*.mlm);;Any file (*.*)");
+    if (path.isEmpty())
+    {
+        emuThread->emuUnpause();
+        return;
+    }
+
+    // movies recorded from power-on need a freshly booted console
+    actUndoStateLoad->setEnabled(false);
+    int res = Frontend::Reset();
+    if (res != Frontend::Load_OK)
+    {
+        QMessageBox::critical(this, "melonDS", "Reset failed\n" + loadErrorStr(res));
+        emuThread->emuUnpause();
+        return;
+    }
+
+    if (Frontend::Movie_StartPlayback(path.toStdString().c_str()))
+        OSD::AddMessage(0, "Movie playback started");
+    else
+        OSD::AddMessage(0xFFA0A0, "Movie playback failed");
+
+    emuThread->emuUnpause();
+}
+
+void MainWindow::onStopMovie()
+{
+    emuThread->emuPause();
+    bool active = Frontend::Movie_IsRecording() || Frontend::Movie_IsPlaying();
+    Frontend::Movie_Stop();
+    emuThread->emuUnpause();
+
+    if (active) OSD::AddMessage(0, "Movie stopped");
+}
+
 void MainWindow::onQuit()
 {
 #ifndef _WIN32
@@ -2383,6 +2647,9 @@ void MainWindow::onSetupCheats()
 
 void MainWindow::onCheatsDialogFinished(int res)
 {
+    // have the core pick up the edited codes
+    Frontend::EnableCheats(Config::EnableCheats != 0);
+
     emuThread->emuUnpause();
 }
 
@@ -2659,6 +2926,10 @@ void MainWindow::onEmuStart()
     actStop->setEnabled(true);
     actFrameStep->setEnabled(true);
     actImportSavefile->setEnabled(true);
+    actCaptureVideo->setEnabled(true);
+    actRecordMovie->setEnabled(true);
+    actPlayMovie->setEnabled(true);
+    actStopMovie->setEnabled(true);
 
     actSetupCheats->setEnabled(true);
 
@@ -2677,6 +2948,18 @@ void MainWindow::onEmuStop()
     actUndoStateLoad->setEnabled(false);
     actImportSavefile->setEnabled(false);
 
+    if (Frontend::Capture_IsActive())
+    {
+        Frontend::Capture_Stop();
+        actCaptureVideo->setChecked(false);
+    }
+    actCaptureVideo->setEnabled(false);
+
+    Frontend::Movie_Stop();
+    actRecordMovie->setEnabled(false);
+    actPlayMovie->setEnabled(false);
+    actStopMovie->setEnabled(false);
+
     actPause->setEnabled(false);
     actReset->setEnabled(false);
     actStop->setEnabled(false);
@@ -2687,6 +2970,25 @@ void MainWindow::onEmuStop()
     actROMInfo->setEnabled(false);
 }
 
+void MainWindow::onScreenChanged(QScreen* screen)
+{
+    disconnect(refreshRateConn);
+
+    if (!screen)
+    {
+        displayRefreshRate = 0;
+        return;
+    }
+
+    refreshRateConn = connect(screen, &QScreen::refreshRateChanged, this, &MainWindow::onRefreshRateChanged);
+    onRefreshRateChanged(screen->refreshRate());
+}
+
+void MainWindow::onRefreshRateChanged(qreal rate)
+{
+    displayRefreshRate = rate;
+}
+
 void MainWindow::onUpdateVideoSettings(bool glchange)
 {
     if (glchange)
@@ -2787,8 +3089,6 @@ int main(int argc, char** argv)
     format.setSwapInterval(0);
     QSurfaceFormat::setDefaultFormat(format);
 
-    audioSync = SDL_CreateCond();
-    audioSyncLock = SDL_CreateMutex();
 
     audioFreq = 48000; // TODO: make configurable?
     SDL_AudioSpec whatIwant, whatIget;
@@ -2876,6 +3176,9 @@ int main(int argc, char** argv)
     emuThread->wait();
     delete emuThread;
 
+    Frontend::Capture_Stop();
+    Frontend::Movie_Stop();
+
     Input::CloseJoystick();
 
     Frontend::DeInit_ROM();
@@ -2883,8 +3186,6 @@ int main(int argc, char** argv)
     if (audioDevice) SDL_CloseAudioDevice(audioDevice);
     micClose();
 
-    SDL_DestroyCond(audioSync);
-    SDL_DestroyMutex(audioSyncLock);
 
     if (micWavBuffer) delete[] micWavBuffer;
 
@@ -19,6 +19,8 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <atomic>
+
 #include <QThread>
 #include <QWidget>
 #include <QWindow>
@@ -42,6 +44,10 @@ class EmuThread : public QThread
     Q_OBJECT
     void run() override;
 
+    void updateDisplayRate();
+    void printFramePacerStats();
+    void printDSPStats();
+
 public:
     explicit EmuThread(QObject* parent = nullptr);
 
@@ -59,12 +65,24 @@ public:
 
     bool emuIsRunning();
 
+    // only used with the OpenGL renderer, the software renderer's output
+    // goes through GPU::AcquirePresentBuffer()
     int FrontBuffer = 0;
     QMutex FrontBufferLock;
 
     GLsync FrontBufferReverseSyncs[2] = {nullptr, nullptr};
     GLsync FrontBufferSyncs[2] = {nullptr, nullptr};
 
+    // time from a frame being finished to it being drawn, shown in the title
+    void AddPresentLatency(u64 usecs)
+    {
+        PresentLatency += usecs;
+        PresentCount++;
+    }
+
+    std::atomic<u64> PresentLatency {0};
+    std::atomic<u32> PresentCount {0};
+
 signals:
     void windowUpdate();
     void windowTitleChange(QString title);
@@ -150,7 +168,6 @@ private slots:
 private:
     void setupScreenLayout();
 
-    QImage screen[2];
     QTransform screenTrans[Frontend::MaxScreenTransforms];
 };
 
@@ -226,6 +243,10 @@ private slots:
     void onLoadState();
     void onUndoStateLoad();
     void onImportSavefile();
+    void onCaptureVideo(bool checked);
+    void onRecordMovie();
+    void onPlayMovie();
+    void onStopMovie();
     void onQuit();
 
     void onPause(bool checked);
@@ -274,7 +295,12 @@ private slots:
 
     void onFullscreenToggled();
 
+    void onScreenChanged(QScreen* screen);
+    void onRefreshRateChanged(qreal rate);
+
 private:
+    QMetaObject::Connection refreshRateConn;
+
     QList<QString> recentFileList;
     QMenu *recentMenu;
     void updateRecentFilesMenu();
@@ -304,6 +330,10 @@ public:
     QAction* actLoadState[9];
     QAction* actUndoStateLoad;
     QAction* actImportSavefile;
+    QAction* actCaptureVideo;
+    QAction* actRecordMovie;
+    QAction* actPlayMovie;
+    QAction* actStopMovie;
     QAction* actQuit;
 
     QAction* actPause;
@@ -70,6 +70,20 @@ public:
     // core
     void Run(unsigned cycle);
 
+    // ticks the timers and audio output after every instruction instead of batching them,
+    // which is slower but useful to verify the batched path
+    void SetCycleExact(bool enable);
+
+    // if the last Run() ended with the core waiting in an idle or polling loop, the number of
+    // cycles it can be left alone for before one of its timers or other components fires,
+    // otherwise 0
+    std::uint64_t GetIdleCycles() const;
+
+    // cycles spent running instructions, and cycles skipped in bulk while the core was waiting,
+    // since the last reset
+    std::uint64_t GetExecutedCycles() const;
+    std::uint64_t GetSkippedCycles() const;
+
     void SetAHBMCallback(const AHBMCallback& callback);
 
     void SetAudioCallback(std::function<void(std::array<std::int16_t, 2>)> callback);
@@ -25,7 +25,48 @@ public:
         }
     }
 
+    // Accounts for one tick without ticking the components, if none of them can fire before it.
+    // The deferred ticks are applied in bulk by Sync(), which must be called before anything
+    // observes or modifies the state of the components.
+    bool TryDefer() {
+        if (deferred == deferrable) {
+            Sync();
+            if (cycle_exact)
+                return false;
+            deferrable = GetMaxSkip();
+            if (deferrable == 0)
+                return false;
+        }
+        ++deferred;
+        return true;
+    }
+
+    void Sync() {
+        if (deferred) {
+            for (const auto& callbacks : registered_callbacks) {
+                callbacks->Skip(deferred);
+            }
+        }
+        deferred = 0;
+        deferrable = 0;
+    }
+
+    // Ticks every component after every instruction, for verification of the batched path
+    void SetCycleExact(bool enable) {
+        Sync();
+        cycle_exact = enable;
+    }
+
+    u64 GetMaxSkip() const {
+        u64 ticks = Callbacks::Infinity;
+        for (const auto& callbacks : registered_callbacks) {
+            ticks = std::min(ticks, callbacks->GetMaxSkip());
+        }
+        return ticks;
+    }
+
     u64 Skip(u64 maximum) {
+        Sync();
         u64 ticks = maximum;
         for (const auto& callbacks : registered_callbacks) {
             ticks = std::min(ticks, callbacks->GetMaxSkip());
@@ -42,5 +83,8 @@ public:
 
 private:
     std::vector<Callbacks*> registered_callbacks;
+    u64 deferred = 0;
+    u64 deferrable = 0;
+    bool cycle_exact = false;
 };
 } // namespace Teakra
@@ -1,10 +1,15 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "bit.h"
 #include "core_timing.h"
 #include "crash.h"
@@ -23,7 +28,10 @@ public:
 class Interpreter {
 public:
     Interpreter(CoreTiming& core_timing, RegisterState& regs, MemoryInterface& mem)
-        : core_timing(core_timing), regs(regs), mem(mem) {}
+        : core_timing(core_timing), regs(regs), mem(mem) {
+        mem.SetProgramWriteHandler(
+            [this](u32 address, u32 length) { InvalidateBlocks(address, length); });
+    }
 
     void PushPC() {
         u16 l = (u16)(regs.pc & 0xFFFF);
@@ -58,35 +66,94 @@ public:
         UNREACHABLE();
     }
 
+    // Runs from decoded blocks instead of fetching and decoding every instruction. Disabling it
+    // falls back to the plain interpreter, which the block path must match exactly.
+    void SetBlockCache(bool enable) {
+        use_block_cache = enable;
+        InvalidateBlocks(0, ProgramSize);
+    }
+
     void Run(u64 cycles) {
+        if (use_block_cache) {
+            RunImpl<true>(cycles);
+        } else {
+            RunImpl<false>(cycles);
+        }
+    }
+
+    // If the last Run() ended while waiting in an idle or polling loop, the number of cycles
+    // that can still be skipped before one of the components fires, otherwise 0.
+    u64 GetIdleCycles() const {
+        return waiting ? core_timing.GetMaxSkip() : 0;
+    }
+
+    u64 GetExecutedCycles() const {
+        return executed_cycles;
+    }
+    u64 GetSkippedCycles() const {
+        return skipped_cycles;
+    }
+    void ResetStats() {
+        executed_cycles = 0;
+        skipped_cycles = 0;
+    }
+
+    template <bool cached>
+    void RunImpl(u64 cycles) {
         idle = false;
+        polling = false;
+        waiting = false;
+        // the other side may have changed what the loop is polling in the meantime
+        poll_start = InvalidAddress;
+        u64 skipped_before = skipped_cycles;
         for (u64 i = 0; i < cycles; ++i) {
             if (idle) {
                 u64 skipped = core_timing.Skip(cycles - i - 1);
                 i += skipped;
+                skipped_cycles += skipped;
+                waiting = i >= cycles - 1;
 
                 // Skip additional tick so to let components fire interrupts
                 if (i < cycles - 1) {
                     ++i;
+                    ++skipped_cycles;
                     core_timing.Tick();
                 }
-            }
 
-            for (std::size_t i = 0; i < 3; ++i) {
-                if (interrupt_pending[i].exchange(false)) {
-                    regs.ip[i] = 1;
+                // a polling loop has to go through another iteration to see if anything changed
+                if (polling) {
+                    idle = false;
+                    polling = false;
                 }
             }
 
-            if (vinterrupt_pending.exchange(false)) {
-                regs.ipv = 1;
+            if (interrupt_pending.load(std::memory_order_relaxed)) {
+                u32 pending = interrupt_pending.exchange(0);
+                for (std::size_t i = 0; i < 3; ++i) {
+                    if (pending & (1 << i)) {
+                        regs.ip[i] = 1;
+                    }
+                }
+                if (pending & VectoredInterruptBit) {
+                    regs.ipv = 1;
+                }
             }
 
-            u16 opcode = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
-            auto& decoder = decoders[opcode];
+            const Matcher<Interpreter>* decoder;
+            u16 opcode;
             u16 expand_value = 0;
-            if (decoder.NeedExpansion()) {
-                expand_value = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
+            if constexpr (cached) {
+                const CachedInstruction& inst = FetchCached();
+                decoder = inst.decoder;
+                opcode = inst.opcode;
+                expand_value = inst.expansion;
+                regs.pc += inst.size;
+            } else {
+                opcode = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
+                decoder = &decoders[opcode];
+                if (decoder->NeedExpansion()) {
+                    expand_value = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
+                }
             }
 
             if (regs.rep) {
@@ -108,7 +175,12 @@ public:
                 }
             }
 
-            decoder.call(*this, opcode, expand_value);
+            if constexpr (cached) {
+                // already checked when the block was built
+                decoder->CallUnchecked(*this, opcode, expand_value);
+            } else {
+                decoder->call(*this, opcode, expand_value);
+            }
 
             // I am not sure if a single-instruction loop is interruptable and how it is handled,
             // so just disable interrupt for it for now.
@@ -121,6 +193,7 @@ public:
                         PushPC();
                         regs.pc = 0x0006 + i * 8;
                         idle = false;
+                        waiting = false;
                         interrupt_handled = true;
                         if (regs.ic[i]) {
                             ContextStore();
@@ -134,23 +207,30 @@ public:
                     PushPC();
                     regs.pc = vinterrupt_address;
                     idle = false;
+                    waiting = false;
                     if (vinterrupt_context_switch) {
                         ContextStore();
                     }
                 }
             }
 
-            core_timing.Tick();
+            // components only need to be ticked one by one when one of them is about to fire
+            if (!core_timing.TryDefer()) {
+                core_timing.Tick();
+            }
         }
+
+        core_timing.Sync();
+        executed_cycles += cycles - (skipped_cycles - skipped_before);
     }
 
     void SignalInterrupt(u32 i) {
-        interrupt_pending[i] = true;
+        interrupt_pending.fetch_or(1 << i);
     }
     void SignalVectoredInterrupt(u32 address, bool context_switch) {
         vinterrupt_address = address;
-        vinterrupt_pending = true;
         vinterrupt_context_switch = context_switch;
+        interrupt_pending.fetch_or(VectoredInterruptBit);
     }
 
     using instruction_return_type = void;
@@ -1094,7 +1174,11 @@ public:
 
     void br(Address18_16 addr_low, Address18_2 addr_high, Cond cond) {
         if (regs.ConditionPass(cond)) {
+            u32 from = regs.pc;
             SetPC(Address32(addr_low, addr_high));
+            if (regs.pc < from) {
+                CheckPollingLoop();
+            }
         }
     }
 
@@ -1103,10 +1187,35 @@ public:
             regs.pc += addr.Relative32(); // note: pc is the address of the NEXT instruction
             if (addr.Relative32() == 0xFFFFFFFF) {
                 idle = true;
+            } else if (addr.Relative32() & 0x80000000) {
+                CheckPollingLoop();
             }
         }
     }
 
+    // Called after taking a backward branch. A loop that comes back to its start in exactly the
+    // same state, without having written anything in between, can only be left because of
+    // something outside of the core: an interrupt, a component changing its registers, or the
+    // CPU side. So it can be skipped in bulk until one of the components fires, like an idle loop.
+    // Loops reading registers that change by themselves (timer counters, BTDMP status) are not
+    // skipped, as they may exit long before the component fires, e.g. delay loops on a timer.
+    void CheckPollingLoop() {
+        u64 writes = mem.GetWriteCount();
+        u64 volatile_reads = mem.GetVolatileReadCount();
+        if (regs.pc == poll_start && writes == poll_writes &&
+            volatile_reads == poll_volatile_reads &&
+            std::memcmp(&regs, &poll_regs, sizeof(RegisterState)) == 0) {
+            idle = true;
+            polling = true;
+            return;
+        }
+
+        poll_start = regs.pc;
+        poll_writes = writes;
+        poll_volatile_reads = volatile_reads;
+        std::memcpy(&poll_regs, &regs, sizeof(RegisterState));
+    }
+
     void break_() {
         ASSERT(regs.lp);
         --regs.bcn;
@@ -2934,13 +3043,117 @@ private:
     RegisterState& regs;
     MemoryInterface& mem;
 
-    std::array<std::atomic<bool>, 3> interrupt_pending{{false, false, false}};
-    std::atomic<bool> vinterrupt_pending{false};
+    // bits 0-2: interrupts 0-2, bit 3: vectored interrupt
+    static constexpr u32 VectoredInterruptBit = 1 << 3;
+    std::atomic<u32> interrupt_pending{0};
     std::atomic<bool> vinterrupt_context_switch;
     std::atomic<u32> vinterrupt_address;
 
+    static constexpr u32 InvalidAddress = 0xFFFFFFFF;
+
     bool idle = false;
 
+    // polling loop detection, see CheckPollingLoop
+    bool polling = false;
+    bool waiting = false;
+    u32 poll_start = InvalidAddress;
+    u64 poll_writes = 0;
+    u64 poll_volatile_reads = 0;
+    RegisterState poll_regs;
+
+    u64 executed_cycles = 0;
+    u64 skipped_cycles = 0;
+
+    // Decoded instructions, in runs of consecutive program addresses starting at the address of
+    // the first one. Only fetching and decoding is skipped: everything else, including the
+    // rep/bkrep bookkeeping and interrupt checks, still happens between every two instructions.
+    // When the PC doesn't land on the next instruction of the current block (branch, loop,
+    // interrupt...), the block for the new address is looked up instead.
+    // Blocks don't cross BlockPageSize boundaries, so that program writes only need to discard
+    // the blocks of the page they land in, and of the previous one for the expansion words of
+    // two-word instructions.
+    struct CachedInstruction {
+        const Matcher<Interpreter>* decoder;
+        u16 opcode;
+        u16 expansion;
+        u32 size;
+    };
+
+    struct Block {
+        u32 address;
+        std::vector<CachedInstruction> code;
+    };
+
+    static constexpr u32 ProgramSize = 0x40000;
+    static constexpr u32 BlockPageSize = 0x40;
+    static constexpr u32 MaxBlockLength = 32;
+
+    bool use_block_cache = true;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::array<bool, ProgramSize / BlockPageSize> page_has_blocks{};
+    const CachedInstruction* cached_next = nullptr;
+    const CachedInstruction* cached_end = nullptr;
+    u32 cached_address = InvalidAddress;
+
+    const CachedInstruction& FetchCached() {
+        u32 address = regs.pc | (regs.prpage << 18);
+        if (address != cached_address || cached_next == cached_end) {
+            const Block& block = GetBlock(address);
+            cached_next = block.code.data();
+            cached_end = cached_next + block.code.size();
+        }
+        const CachedInstruction& inst = *cached_next++;
+        cached_address = address + inst.size;
+        return inst;
+    }
+
+    const Block& GetBlock(u32 address) {
+        if (blocks.empty()) {
+            blocks.resize(ProgramSize);
+        }
+
+        std::unique_ptr<Block>& block = blocks[address & (ProgramSize - 1)];
+        if (block && block->address == address) {
+            return *block;
+        }
+
+        block = std::make_unique<Block>();
+        block->address = address;
+        u32 current = address;
+        do {
+            CachedInstruction inst;
+            inst.opcode = mem.ProgramRead(current);
+            inst.decoder = &decoders[inst.opcode];
+            ASSERT(inst.decoder->Matches(inst.opcode));
+            inst.expansion = inst.decoder->NeedExpansion() ? mem.ProgramRead(current + 1) : 0;
+            inst.size = inst.decoder->NeedExpansion() ? 2 : 1;
+            block->code.push_back(inst);
+            current += inst.size;
+        } while (block->code.size() < MaxBlockLength &&
+                 (current & ~(BlockPageSize - 1)) == (address & ~(BlockPageSize - 1)));
+
+        page_has_blocks[(address & (ProgramSize - 1)) / BlockPageSize] = true;
+        return *block;
+    }
+
+    void InvalidateBlocks(u32 address, u32 length) {
+        // the word before the range may be the start of a two-word instruction
+        address &= ProgramSize - 1;
+        u32 first = address > 0 ? address - 1 : 0;
+        u32 last = std::min(address + length, ProgramSize) - 1;
+        for (u32 page = first / BlockPageSize; page <= last / BlockPageSize; ++page) {
+            if (!page_has_blocks[page])
+                continue;
+            page_has_blocks[page] = false;
+            for (u32 i = 0; i < BlockPageSize; ++i) {
+                blocks[page * BlockPageSize + i].reset();
+            }
+        }
+
+        // the block being run may be gone
+        cached_address = InvalidAddress;
+    }
+
     u64 GetAcc(RegName name) const {
         switch (name) {
         case RegName::a0:
@@ -55,6 +55,12 @@ public:
         return fn(v, instruction, instruction_expansion);
     }
 
+    // for callers that have already checked Matches() for this instruction
+    handler_return_type CallUnchecked(Visitor& v, u16 instruction,
+                                      u16 instruction_expansion = 0) const {
+        return fn(v, instruction, instruction_expansion);
+    }
+
 private:
     const char* name;
     u16 mask;
@@ -1,3 +1,4 @@
+#include "core_timing.h"
 #include "memory_interface.h"
 #include "mmio.h"
 #include "shared_memory.h"
@@ -11,15 +12,39 @@ void MemoryInterface::SetMMIO(MMIORegion& mmio) {
     this->mmio = &mmio;
 }
 
+void MemoryInterface::SetCoreTiming(CoreTiming& core_timing) {
+    this->core_timing = &core_timing;
+}
+
+void MemoryInterface::SetProgramWriteHandler(
+    std::function<void(u32 address, u32 length)> handler) {
+    program_write_handler = std::move(handler);
+}
+
+void MemoryInterface::InvalidateProgram() {
+    if (program_write_handler)
+        program_write_handler(0, (u32)shared_memory.raw.size() / 2);
+}
+
+void MemoryInterface::SyncMMIO() {
+    // the components behind MMIO may be lagging behind the interpreter, see CoreTiming::TryDefer
+    if (core_timing)
+        core_timing->Sync();
+}
+
 u16 MemoryInterface::ProgramRead(u32 address) const {
     return shared_memory.ReadWord(address);
 }
 void MemoryInterface::ProgramWrite(u32 address, u16 value) {
+    ++write_count;
     shared_memory.WriteWord(address, value);
+    if (program_write_handler)
+        program_write_handler(address, 1);
 }
 u16 MemoryInterface::DataRead(u16 address, bool bypass_mmio) {
     if (memory_interface_unit.InMMIO(address) && !bypass_mmio) {
         ASSERT(mmio != nullptr);
+        SyncMMIO();
         return mmio->Read(memory_interface_unit.ToMMIO(address));
     }
     u32 converted = memory_interface_unit.ConvertDataAddress(address);
@@ -27,13 +52,19 @@ u16 MemoryInterface::DataRead(u16 address, bool bypass_mmio) {
     return value;
 }
 void MemoryInterface::DataWrite(u16 address, u16 value, bool bypass_mmio) {
+    ++write_count;
     if (memory_interface_unit.InMMIO(address) && !bypass_mmio) {
         ASSERT(mmio != nullptr);
+        SyncMMIO();
         return mmio->Write(memory_interface_unit.ToMMIO(address), value);
     }
     u32 converted = memory_interface_unit.ConvertDataAddress(address);
     shared_memory.WriteWord(converted, value);
 }
+u64 MemoryInterface::GetVolatileReadCount() const {
+    return mmio ? mmio->GetVolatileReadCount() : 0;
+}
+
 u16 MemoryInterface::DataReadA32(u32 address) const {
     u32 converted = (address & ((MemoryInterfaceUnit::DataMemoryBankSize*2)-1))
         + MemoryInterfaceUnit::DataMemoryOffset;
@@ -46,11 +77,13 @@ void MemoryInterface::DataWriteA32(u32 address, u16 value) {
 }
 u16 MemoryInterface::MMIORead(u16 address) {
     ASSERT(mmio != nullptr);
+    SyncMMIO();
     // according to GBATek ("DSi Teak I/O Ports (on ARM9 Side)"), these are mirrored
     return mmio->Read(address & (MemoryInterfaceUnit::MMIOSize - 1));
 }
 void MemoryInterface::MMIOWrite(u16 address, u16 value) {
     ASSERT(mmio != nullptr);
+    SyncMMIO();
     mmio->Write(address & (MemoryInterfaceUnit::MMIOSize - 1), value);
 }
 
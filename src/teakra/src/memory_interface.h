@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include "common_types.h"
 #include "crash.h"
 
@@ -50,11 +51,17 @@ public:
 
 struct SharedMemory;
 class MMIORegion;
+class CoreTiming;
 
 class MemoryInterface {
 public:
     MemoryInterface(SharedMemory& shared_memory, MemoryInterfaceUnit& memory_interface_unit);
     void SetMMIO(MMIORegion& mmio);
+    void SetCoreTiming(CoreTiming& core_timing);
+    // called with the range of every program memory change, to discard decoded code
+    void SetProgramWriteHandler(std::function<void(u32 address, u32 length)> handler);
+    // for program memory changes that don't go through ProgramWrite
+    void InvalidateProgram();
     u16 ProgramRead(u32 address) const;
     void ProgramWrite(u32 address, u16 value);
     u16 DataRead(u16 address, bool bypass_mmio = false); // not const because it can be a FIFO register
@@ -64,10 +71,22 @@ public:
     u16 MMIORead(u16 address);
     void MMIOWrite(u16 address, u16 value);
 
+    // number of writes done by the core so far, to tell whether a loop modifies anything
+    u64 GetWriteCount() const {
+        return write_count;
+    }
+    // number of reads from registers that change by themselves, see MMIORegion
+    u64 GetVolatileReadCount() const;
+
 private:
     SharedMemory& shared_memory;
     MemoryInterfaceUnit& memory_interface_unit;
     MMIORegion* mmio;
+    CoreTiming* core_timing = nullptr;
+    u64 write_count = 0;
+    std::function<void(u32 address, u32 length)> program_write_handler;
+
+    void SyncMMIO();
 };
 
 } // namespace Teakra
@@ -45,6 +45,7 @@ struct Cell {
     std::function<void(u16)> set;
     std::function<u16(void)> get;
     u16 index = 0;
+    bool changes_by_itself = false; // see MMIORegion::GetVolatileReadCount
 
     Cell(std::function<void(u16)> set, std::function<u16(void)> get)
         : set(std::move(set)), get(std::move(get)) {}
@@ -153,6 +154,8 @@ MMIORegion::MMIORegion(MemoryInterfaceUnit& miu, ICU& icu, Apbp& apbp_from_cpu,
         impl->cells[0x26 + i * 0x10] = Cell::RefCell(timer[i].start_high);   // TIMERx_SCH
         impl->cells[0x28 + i * 0x10] = Cell::RefCell(timer[i].counter_low);  // TIMERx_CCL
         impl->cells[0x2A + i * 0x10] = Cell::RefCell(timer[i].counter_high); // TIMERx_CCH
+        impl->cells[0x28 + i * 0x10].changes_by_itself = true;
+        impl->cells[0x2A + i * 0x10].changes_by_itself = true;
         impl->cells[0x2C + i * 0x10] = Cell();                               // TIMERx_SPWMCL
         impl->cells[0x2E + i * 0x10] = Cell();                               // TIMERx_SPWMCH
     }
@@ -343,6 +346,7 @@ MMIORegion::MMIORegion(MemoryInterfaceUnit& miu, ICU& icu, Apbp& apbp_from_cpu,
             BitFieldSlot{3, 1, {}, std::bind(&Btdmp::GetTransmitFull, &btdmp[i])},
             BitFieldSlot{4, 1, {}, std::bind(&Btdmp::GetTransmitEmpty, &btdmp[i])},
         });
+        impl->cells[0x2C2 + i * 0x80].changes_by_itself = true;
         impl->cells[0x2C6 + i * 0x80].set = std::bind(&Btdmp::Send, &btdmp[i], _1);
         impl->cells[0x2CA + i * 0x80].set = std::bind(&Btdmp::SetTransmitFlush, &btdmp[i], _1);
         impl->cells[0x2CA + i * 0x80].get = std::bind(&Btdmp::GetTransmitFlush, &btdmp[i]);
@@ -352,6 +356,8 @@ MMIORegion::MMIORegion(MemoryInterfaceUnit& miu, ICU& icu, Apbp& apbp_from_cpu,
 MMIORegion::~MMIORegion() = default;
 
 u16 MMIORegion::Read(u16 addr) {
+    if (impl->cells[addr].changes_by_itself)
+        ++volatile_read_count;
     u16 value = impl->cells[addr].get();
     return value;
 }
@@ -21,9 +21,16 @@ public:
     u16 Read(u16 addr); // not const because it can be a FIFO register
     void Write(u16 addr, u16 value);
 
+    // number of reads so far from registers that change by themselves as time passes, like the
+    // timer counters, rather than only when a component fires
+    u64 GetVolatileReadCount() const {
+        return volatile_read_count;
+    }
+
 private:
     class Impl;
     std::unique_ptr<Impl> impl;
+    u64 volatile_read_count = 0;
 };
 
 } // namespace Teakra
@@ -18,6 +18,7 @@ Processor::~Processor() = default;
 
 void Processor::Reset() {
     impl->regs = RegisterState();
+    impl->interpreter.ResetStats();
 }
 
 void Processor::Run(unsigned cycles) {
@@ -31,4 +32,14 @@ void Processor::SignalVectoredInterrupt(u32 address, bool context_switch) {
     impl->interpreter.SignalVectoredInterrupt(address, context_switch);
 }
 
+u64 Processor::GetIdleCycles() const {
+    return impl->interpreter.GetIdleCycles();
+}
+u64 Processor::GetExecutedCycles() const {
+    return impl->interpreter.GetExecutedCycles();
+}
+u64 Processor::GetSkippedCycles() const {
+    return impl->interpreter.GetSkippedCycles();
+}
+
 } // namespace Teakra
@@ -17,6 +17,10 @@ public:
     void SignalInterrupt(u32 i);
     void SignalVectoredInterrupt(u32 address, bool context_switch);
 
+    u64 GetIdleCycles() const;
+    u64 GetExecutedCycles() const;
+    u64 GetSkippedCycles() const;
+
 private:
     struct Impl;
     std::unique_ptr<Impl> impl;
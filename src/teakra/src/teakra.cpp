@@ -31,6 +31,7 @@ struct Teakra::Impl {
 
     Impl() {
         memory_interface.SetMMIO(mmio);
+        memory_interface.SetCoreTiming(core_timing);
         using namespace std::placeholders;
         icu.SetInterruptHandler(std::bind(&Processor::SignalInterrupt, &processor, _1),
                                 std::bind(&Processor::SignalVectoredInterrupt, &processor, _1, _2));
@@ -61,6 +62,7 @@ struct Teakra::Impl {
         btdmp[0].Reset();
         btdmp[1].Reset();
         processor.Reset();
+        memory_interface.InvalidateProgram();
     }
 };
 
@@ -72,6 +74,8 @@ void Teakra::Reset() {
 }
 
 std::array<std::uint8_t, 0x80000>& Teakra::GetDspMemory() {
+    // the caller may modify program memory behind our back
+    impl->memory_interface.InvalidateProgram();
     return impl->shared_memory.raw;
 }
 
@@ -83,6 +87,20 @@ void Teakra::Run(unsigned cycle) {
     impl->processor.Run(cycle);
 }
 
+void Teakra::SetCycleExact(bool enable) {
+    impl->core_timing.SetCycleExact(enable);
+}
+
+std::uint64_t Teakra::GetIdleCycles() const {
+    return impl->processor.GetIdleCycles();
+}
+std::uint64_t Teakra::GetExecutedCycles() const {
+    return impl->processor.GetExecutedCycles();
+}
+std::uint64_t Teakra::GetSkippedCycles() const {
+    return impl->processor.GetSkippedCycles();
+}
+
 bool Teakra::SendDataIsEmpty(std::uint8_t index) const {
     return !impl->apbp_from_cpu.IsDataReady(index);
 }
@@ -2,6 +2,7 @@
 #include <cstdio>
 #include <iomanip>
 #include <memory>
+#include <string>
 #include <teakra/disassembler.h>
 #include "../core_timing.h"
 #include "../interpreter.h"
@@ -24,6 +25,10 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    // by default the plain interpreter is verified, this checks the block cache against the same
+    // vectors instead
+    bool block_cache = argc >= 3 && std::string(argv[2]) == "--block-cache";
+
     std::unique_ptr<std::FILE, decltype(&std::fclose)> file{std::fopen(argv[1], "rb"), std::fclose};
     if (!file) {
         std::fprintf(stderr, "Unable to open file %s. Exiting...\n", argv[1]);
@@ -36,6 +41,8 @@ int main(int argc, char** argv) {
     Teakra::MemoryInterface memory_interface{shared_memory, miu};
     Teakra::RegisterState regs;
     Teakra::Interpreter interpreter(core_timing, regs, memory_interface);
+    core_timing.SetCycleExact(true);
+    interpreter.SetBlockCache(block_cache);
 
     int i = 0;
     int passed = 0;